@@ -0,0 +1,238 @@
+// Archiver and Splitter
+// aes.cpp
+
+#include "aes.h"
+
+#include <cstring>
+
+#include "cpufeatures.h"
+
+#ifdef CPU_X86
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+////////////////
+//   TABLES
+////////////////
+
+namespace {
+
+const int AES256_ROUNDS = 14;
+
+uint32_t rotateRight(uint32_t value, int bits) {
+	return (value >> bits) | (value << (32 - bits));
+}
+
+unsigned char rotateLeft8(unsigned char value, int bits) {
+	return (unsigned char)((value << bits) | (value >> (8 - bits)));
+}
+
+//S-box and the combined SubBytes/ShiftRows/MixColumns tables, built once on first use
+struct AesTables {
+	unsigned char sbox[256];
+	uint32_t te[4][256];
+
+	AesTables() {
+		//Walk the multiplicative group with generator 3, pairing each
+		//element with its inverse, and apply the affine transform
+		unsigned char p = 1;
+		unsigned char q = 1;
+		do {
+			p = (unsigned char)(p ^ (p << 1) ^ ((p & 0x80) ? 0x1B : 0));
+
+			q ^= (unsigned char)(q << 1);
+			q ^= (unsigned char)(q << 2);
+			q ^= (unsigned char)(q << 4);
+			if (q & 0x80) {
+				q ^= 0x09;
+			}
+
+			sbox[p] = (unsigned char)(q ^ rotateLeft8(q, 1) ^ rotateLeft8(q, 2)
+				^ rotateLeft8(q, 3) ^ rotateLeft8(q, 4) ^ 0x63);
+		} while (p != 1);
+		sbox[0] = 0x63;
+
+		for (int i = 0; i < 256; i ++) {
+			uint32_t s = sbox[i];
+			uint32_t s2 = (s << 1) ^ ((s & 0x80) ? 0x1B : 0);
+			s2 &= 0xFF;
+			uint32_t s3 = s2 ^ s;
+			te[0][i] = (s2 << 24) | (s << 16) | (s << 8) | s3;
+			te[1][i] = rotateRight(te[0][i], 8);
+			te[2][i] = rotateRight(te[0][i], 16);
+			te[3][i] = rotateRight(te[0][i], 24);
+		}
+	}
+};
+
+const AesTables &aesTables() {
+	static const AesTables tables;
+	return tables;
+}
+
+uint32_t loadBigEndian(const unsigned char *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+void storeBigEndian(unsigned char *p, uint32_t value) {
+	p[0] = (unsigned char)(value >> 24);
+	p[1] = (unsigned char)(value >> 16);
+	p[2] = (unsigned char)(value >> 8);
+	p[3] = (unsigned char)value;
+}
+
+//Adds one to a little-endian 128-bit counter
+void incrementCounter(unsigned char counter[16]) {
+	for (int i = 0; i < 16; i ++) {
+		if (++ counter[i] != 0) {
+			break;
+		}
+	}
+}
+
+#ifdef CPU_X86
+
+//Four blocks at a time so the AESENC latencies overlap
+CPU_TARGET("aes,sse2")
+void aesNiCtr(const unsigned char *roundKeyBytes, unsigned char counter[16], unsigned char *data, size_t blocks) {
+	__m128i keys[AES256_ROUNDS + 1];
+	for (int r = 0; r <= AES256_ROUNDS; r ++) {
+		keys[r] = _mm_loadu_si128((const __m128i *)(roundKeyBytes + 16 * r));
+	}
+
+	unsigned long long low = 0;
+	unsigned long long high = 0;
+	for (int i = 7; i >= 0; i --) {
+		low = (low << 8) | counter[i];
+		high = (high << 8) | counter[i + 8];
+	}
+
+	while (blocks > 0) {
+		size_t count = blocks < 4 ? blocks : 4;
+		__m128i x[4];
+
+		for (size_t b = 0; b < count; b ++) {
+			x[b] = _mm_xor_si128(_mm_set_epi64x((long long)high, (long long)low), keys[0]);
+			if (++ low == 0) {
+				high ++;
+			}
+		}
+		for (int r = 1; r < AES256_ROUNDS; r ++) {
+			for (size_t b = 0; b < count; b ++) {
+				x[b] = _mm_aesenc_si128(x[b], keys[r]);
+			}
+		}
+		for (size_t b = 0; b < count; b ++) {
+			x[b] = _mm_aesenclast_si128(x[b], keys[AES256_ROUNDS]);
+			__m128i in = _mm_loadu_si128((const __m128i *)(data + 16 * b));
+			_mm_storeu_si128((__m128i *)(data + 16 * b), _mm_xor_si128(in, x[b]));
+		}
+
+		data += 16 * count;
+		blocks -= count;
+	}
+
+	for (int i = 0; i < 8; i ++) {
+		counter[i] = (unsigned char)(low >> (8 * i));
+		counter[i + 8] = (unsigned char)(high >> (8 * i));
+	}
+}
+
+#endif
+
+}
+
+////////////////
+//   AES256
+////////////////
+
+Aes256::Aes256() : useAesNi(cpuHasAesNi()) {
+	memset(roundKeys, 0, sizeof(roundKeys));
+	memset(roundKeyBytes, 0, sizeof(roundKeyBytes));
+}
+
+void Aes256::setKey(const unsigned char key[32]) {
+	const AesTables &t = aesTables();
+	uint32_t roundConstant = 0x01;
+
+	for (int i = 0; i < 8; i ++) {
+		roundKeys[i] = loadBigEndian(key + 4 * i);
+	}
+	for (int i = 8; i < 60; i ++) {
+		uint32_t temp = roundKeys[i - 1];
+		if (i % 8 == 0) {
+			//RotWord, SubWord and the round constant
+			temp = ((uint32_t)t.sbox[(temp >> 16) & 0xFF] << 24) | ((uint32_t)t.sbox[(temp >> 8) & 0xFF] << 16)
+				| ((uint32_t)t.sbox[temp & 0xFF] << 8) | (uint32_t)t.sbox[temp >> 24];
+			temp ^= roundConstant << 24;
+			roundConstant <<= 1;
+		} else if (i % 8 == 4) {
+			temp = ((uint32_t)t.sbox[temp >> 24] << 24) | ((uint32_t)t.sbox[(temp >> 16) & 0xFF] << 16)
+				| ((uint32_t)t.sbox[(temp >> 8) & 0xFF] << 8) | (uint32_t)t.sbox[temp & 0xFF];
+		}
+		roundKeys[i] = roundKeys[i - 8] ^ temp;
+	}
+
+	//AES-NI takes the same schedule as a byte string
+	for (int i = 0; i < 60; i ++) {
+		storeBigEndian(roundKeyBytes + 4 * i, roundKeys[i]);
+	}
+}
+
+void Aes256::encryptBlock(const unsigned char in[16], unsigned char out[16]) const {
+	const AesTables &t = aesTables();
+	const uint32_t *rk = roundKeys;
+
+	uint32_t s0 = loadBigEndian(in) ^ rk[0];
+	uint32_t s1 = loadBigEndian(in + 4) ^ rk[1];
+	uint32_t s2 = loadBigEndian(in + 8) ^ rk[2];
+	uint32_t s3 = loadBigEndian(in + 12) ^ rk[3];
+
+	for (int r = 1; r < AES256_ROUNDS; r ++) {
+		rk += 4;
+		uint32_t t0 = t.te[0][s0 >> 24] ^ t.te[1][(s1 >> 16) & 0xFF] ^ t.te[2][(s2 >> 8) & 0xFF] ^ t.te[3][s3 & 0xFF] ^ rk[0];
+		uint32_t t1 = t.te[0][s1 >> 24] ^ t.te[1][(s2 >> 16) & 0xFF] ^ t.te[2][(s3 >> 8) & 0xFF] ^ t.te[3][s0 & 0xFF] ^ rk[1];
+		uint32_t t2 = t.te[0][s2 >> 24] ^ t.te[1][(s3 >> 16) & 0xFF] ^ t.te[2][(s0 >> 8) & 0xFF] ^ t.te[3][s1 & 0xFF] ^ rk[2];
+		uint32_t t3 = t.te[0][s3 >> 24] ^ t.te[1][(s0 >> 16) & 0xFF] ^ t.te[2][(s1 >> 8) & 0xFF] ^ t.te[3][s2 & 0xFF] ^ rk[3];
+		s0 = t0;
+		s1 = t1;
+		s2 = t2;
+		s3 = t3;
+	}
+
+	//Last round has no MixColumns
+	rk += 4;
+	const unsigned char *sbox = t.sbox;
+	storeBigEndian(out, (((uint32_t)sbox[s0 >> 24] << 24) | ((uint32_t)sbox[(s1 >> 16) & 0xFF] << 16)
+		| ((uint32_t)sbox[(s2 >> 8) & 0xFF] << 8) | (uint32_t)sbox[s3 & 0xFF]) ^ rk[0]);
+	storeBigEndian(out + 4, (((uint32_t)sbox[s1 >> 24] << 24) | ((uint32_t)sbox[(s2 >> 16) & 0xFF] << 16)
+		| ((uint32_t)sbox[(s3 >> 8) & 0xFF] << 8) | (uint32_t)sbox[s0 & 0xFF]) ^ rk[1]);
+	storeBigEndian(out + 8, (((uint32_t)sbox[s2 >> 24] << 24) | ((uint32_t)sbox[(s3 >> 16) & 0xFF] << 16)
+		| ((uint32_t)sbox[(s0 >> 8) & 0xFF] << 8) | (uint32_t)sbox[s1 & 0xFF]) ^ rk[2]);
+	storeBigEndian(out + 12, (((uint32_t)sbox[s3 >> 24] << 24) | ((uint32_t)sbox[(s0 >> 16) & 0xFF] << 16)
+		| ((uint32_t)sbox[(s1 >> 8) & 0xFF] << 8) | (uint32_t)sbox[s2 & 0xFF]) ^ rk[3]);
+}
+
+void Aes256::ctrLittleEndian(unsigned char counter[16], unsigned char *data, size_t blocks) const {
+#ifdef CPU_X86
+	if (useAesNi) {
+		aesNiCtr(roundKeyBytes, counter, data, blocks);
+		return;
+	}
+#endif
+
+	unsigned char keystream[16];
+	for (size_t b = 0; b < blocks; b ++) {
+		encryptBlock(counter, keystream);
+		incrementCounter(counter);
+		for (int i = 0; i < 16; i ++) {
+			data[i] ^= keystream[i];
+		}
+		data += 16;
+	}
+}
+
+bool Aes256::hardwareAccelerated() const {
+	return useAesNi;
+}
@@ -0,0 +1,30 @@
+// Archiver and Splitter
+// aes.h
+// AES-256 encryption, using AES-NI when the processor has it
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Aes256 {
+public:
+	Aes256();
+
+	void setKey(const unsigned char key[32]);
+
+	void encryptBlock(const unsigned char in[16], unsigned char out[16]) const;
+
+	//Counter mode with a little-endian 128-bit counter (the WinZip AES layout):
+	//XORs 'blocks' 16-byte blocks of data with AES(counter), AES(counter + 1), ...
+	//and leaves counter at the next unused value
+	void ctrLittleEndian(unsigned char counter[16], unsigned char *data, size_t blocks) const;
+
+	bool hardwareAccelerated() const;
+
+private:
+	//Expanded key as words (portable code) and as bytes (AES-NI)
+	uint32_t roundKeys[60];
+	unsigned char roundKeyBytes[240];
+	bool useAesNi;
+};
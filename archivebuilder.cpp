@@ -0,0 +1,509 @@
+// Archiver and Splitter
+// archivebuilder.cpp
+
+#include "archivebuilder.h"
+
+#include <cstdio>
+#include <thread>
+
+#include "utilities.h"
+#include "zipwriter.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//How often running 7-Zip processes are checked on
+const unsigned int ARCHIVER_POLL_MILLISECONDS = 100;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Size of a file another process is still writing, or -1.  On Windows, the
+//size in the directory lags behind while the file is open, so it is asked
+//of the file itself.
+long long growingFileSize(const std::string &path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), FILE_READ_ATTRIBUTES,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return -1;
+	}
+	LARGE_INTEGER size;
+	BOOL ok = GetFileSizeEx(file, &size);
+	CloseHandle(file);
+	return ok ? (long long)size.QuadPart : -1;
+#else
+	struct stat status;
+	return stat(path.c_str(), &status) == 0 ? (long long)status.st_size : -1;
+#endif
+}
+
+}
+
+////////////////
+//   BUILDER
+////////////////
+
+ArchiveBuilder::ArchiveBuilder(const ArchiveBuilderSettings &settings, IoThrottle &throttle, ManifestWriter &manifest,
+							   ProgressReporter &progress, const CancellationToken &cancel)
+	: settings(settings), throttle(throttle), manifest(manifest), progress(progress), cancel(cancel),
+	  compressionPool(NULL), verificationPool(NULL), verifier(NULL), planner(NULL) {
+	if (settings.useBuiltinCompressor) {
+		compressionPool = new ThreadPool(0);
+	}
+
+	if (settings.verifyArchives) {
+		verificationPool = new ThreadPool(0);
+		verifier = new ArchiveVerifier(*verificationPool, settings.sevenZipFile, settings.password);
+	}
+
+	//The levels picked for ZIP files are the built-in compressor's
+	if (settings.compressionDeadlineSeconds > 0 || settings.compressionTargetBytesPerSecond > 0) {
+		planner = new CompressionPlanner(!settings.useBuiltinCompressor);
+		if (settings.compressionDeadlineSeconds > 0) {
+			planner->setDeadline(settings.compressionDeadlineSeconds);
+		} else {
+			planner->setThroughputTarget(settings.compressionTargetBytesPerSecond);
+		}
+	}
+
+	if (throttle.settingsChanged()) {
+		reportThrottleSettings();
+	}
+}
+
+ArchiveBuilder::~ArchiveBuilder() {
+	for (size_t i = 0; i < pendingArchives.size(); i ++) {
+		pendingArchives[i].process->kill();
+		deleteDirectory(pendingArchives[i].stagingDirectory);
+		delete pendingArchives[i].process;
+	}
+
+	delete planner;
+	delete verifier;
+	delete verificationPool;
+	delete compressionPool;
+}
+
+void ArchiveBuilder::build(const ArchiveJob &job, unsigned long long remainingBytes) {
+	//Wait until there is room for another 7-Zip process (and, with only one,
+	//until the temp directory is no longer in use)
+	waitForSlot(settings.maxArchiverProcesses);
+	if (cancel.cancelled()) {
+		return;
+	}
+
+	if (throttle.settingsChanged()) {
+		reportThrottleSettings();
+	}
+
+	//The time is measured from when the files start being read
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	CompressionChoice compression = chooseCompression(job, remainingBytes);
+
+	//What the archive should hold, for verification
+	ArchivePlan plan;
+	plan.archiveId = job.archiveId;
+	plan.archiveName = job.archiveName;
+	plan.archivePath = job.archivePath;
+	plan.sevenZip = settings.sevenZip;
+	if (verifier != NULL) {
+		plan.fileNames = job.entryNames;
+		for (size_t i = 0; i < job.files.size(); i ++) {
+			plan.fileSizes.push_back(job.files[i].fileSize);
+		}
+	}
+
+	if (settings.useBuiltinCompressor) {
+		buildBuiltin(job, plan, compression, started);
+	} else {
+		startSevenZip(job, plan, compression, started);
+	}
+
+	//Report on the archives that have been checked so far
+	collectVerification(false);
+}
+
+void ArchiveBuilder::finish() {
+	waitForSlot(0);
+}
+
+void ArchiveBuilder::collectVerification(bool wait) {
+	if (verifier == NULL) {
+		return;
+	}
+
+	std::vector<VerificationResult> results = verifier->collect(wait);
+	for (size_t i = 0; i < results.size(); i ++) {
+		if (results[i].ok) {
+			progress.report(PROGRESS_MESSAGE, "Verified archive #" + itos(results[i].archiveId) + " ("
+				+ itos(results[i].filesChecked) + " files)", results[i].archiveId);
+		} else {
+			std::string message = "Verification of " + results[i].archiveName + " failed:";
+			for (size_t j = 0; j < results[i].problems.size(); j ++) {
+				message += "\n " + results[i].problems[j];
+			}
+			progress.report(PROGRESS_ERROR, message, results[i].archiveId);
+		}
+		verified.push_back(results[i]);
+	}
+}
+
+const std::vector<VerificationResult> &ArchiveBuilder::verificationResults() const {
+	return verified;
+}
+
+const CompressionPlanner *ArchiveBuilder::compressionPlanner() const {
+	return planner;
+}
+
+unsigned int ArchiveBuilder::archivesMade() const {
+	return madeArchives.size();
+}
+
+bool ArchiveBuilder::archiveMade(int archiveId) const {
+	return madeArchives.count(archiveId) > 0;
+}
+
+//Picks the compression level from the speed the rest of the run needs
+CompressionChoice ArchiveBuilder::chooseCompression(const ArchiveJob &job, unsigned long long remainingBytes) {
+	CompressionChoice compression;
+	compression.level = settings.builtinCompressionLevel;
+	compression.requiredBytesPerSecond = 0;
+	compression.estimatedBytesPerSecond = 0;
+	compression.measured = false;
+	if (planner == NULL) {
+		return compression;
+	}
+
+	compression = planner->choose(remainingBytes);
+	std::string message = "Compression level " + itos(compression.level) + " for archive #" + itos(job.archiveId)
+		+ " (" + compression.reason + "; needs "
+		+ getFormattedSizeTitle((long long)compression.requiredBytesPerSecond) + "/s";
+	if (compression.estimatedBytesPerSecond > 0) {
+		message += ", expected " + getFormattedSizeTitle((long long)compression.estimatedBytesPerSecond) + "/s";
+	}
+	progress.report(PROGRESS_MESSAGE, message + ")", job.archiveId);
+	return compression;
+}
+
+//Compresses with the built-in compressor, reading the files from where they are
+void ArchiveBuilder::buildBuiltin(const ArchiveJob &job, const ArchivePlan &plan,
+								  const CompressionChoice &compression, std::chrono::steady_clock::time_point started) {
+	std::vector<ZipEntrySource> zipSources;
+	for (size_t i = 0; i < job.files.size(); i ++) {
+		ZipEntrySource source;
+		source.sourcePath = job.files[i].fileName;
+		source.entryName = job.entryNames[i];
+		stringReplaceAll(source.entryName, "\\", "/");
+		zipSources.push_back(source);
+	}
+
+	progress.report(PROGRESS_ARCHIVE_STARTED, "Finished preparation for " + job.archiveName + " Size: "
+		+ getFormattedSizeTitle(job.inputSize), job.archiveId);
+
+	ZipWriter zipWriter(*compressionPool, compression.level);
+	zipWriter.setPassword(settings.password);
+	zipWriter.setThrottle(&throttle);
+	zipWriter.setCancellation(cancel);
+	bool ok = zipWriter.open(job.archivePath) && zipWriter.addFiles(zipSources) && zipWriter.close();
+
+	//Don't leave half an archive behind (without a central directory, it
+	//would only look like one)
+	if (!ok) {
+		std::string errorMessage = zipWriter.errorMessage();
+		zipWriter.close();
+		remove(job.archivePath.c_str());
+		if (cancel.cancelled()) {
+			progress.report(PROGRESS_WARNING, "Stopped making " + job.archiveName, job.archiveId);
+		} else {
+			progress.report(PROGRESS_ERROR, errorMessage + " (" + job.archiveName + " was removed)",
+				job.archiveId);
+		}
+		return;
+	}
+
+	std::vector<ZipEntryResult> zipEntries = zipWriter.entries();
+	for (size_t i = 0; i < zipEntries.size(); i ++) {
+		if (!zipEntries[i].ok) {
+			progress.report(PROGRESS_ERROR, "Could not read " + zipSources[i].sourcePath, job.archiveId);
+			ok = false;
+		}
+	}
+	manifest.setLocations(job.archiveId, zipEntries);
+
+	progress.report(PROGRESS_ARCHIVE_FINISHED, "Finished creating archive #" + itos(job.archiveId) + " in "
+		+ dtos(floorDoubleAt(secondsSince(started), 0.1)) + " seconds", job.archiveId);
+	if (ok) {
+		madeArchives.insert(job.archiveId);
+	}
+
+	recordCompression(job.archiveId, job.archiveName, job.archivePath, job.inputSize, secondsSince(started),
+		compression);
+
+	if (verifier != NULL) {
+		verifier->submit(plan);
+	}
+}
+
+//Copies the files to the staging directory and starts 7-Zip on them
+void ArchiveBuilder::startSevenZip(const ArchiveJob &job, const ArchivePlan &plan,
+								   const CompressionChoice &compression, std::chrono::steady_clock::time_point started) {
+	//Each archive gets its own temp directory if several can be in progress
+	std::string stagingDirectory = settings.stagingDirectory;
+	if (settings.maxArchiverProcesses > 1) {
+		std::string idString = itos(job.archiveId);
+		padWithZeroes(idString, 4);
+		stagingDirectory += DIRECTORY_SEPARATOR + idString;
+	}
+
+	//Delete it if it already exists
+	clearTempDirectory(stagingDirectory);
+
+	std::string lastDirectory = "";
+	for (size_t i = 0; i < job.files.size(); i ++) {
+		if (cancel.cancelled()) {
+			deleteDirectory(stagingDirectory);
+			return;
+		}
+
+		//Same relative path inside the staging directory
+		std::string destinationPath = stagingDirectory + DIRECTORY_SEPARATOR + job.entryNames[i];
+		std::string destinationDirectory = destinationPath.substr(0, destinationPath.find_last_of("/\\"));
+		if (destinationDirectory != lastDirectory) {
+			if (!directoryCreate(destinationDirectory)) {
+				progress.report(PROGRESS_ERROR, "Directory creation failed: " + destinationDirectory, job.archiveId);
+				continue;
+			}
+			lastDirectory = destinationDirectory;
+		}
+
+		bool copied = throttle.limitsIo() ? throttledCopyFile(job.files[i].fileName, destinationPath, throttle)
+			: fileCopy(job.files[i].fileName, destinationPath);
+		if (!copied) {
+			progress.report(PROGRESS_WARNING, "Could not copy " + job.files[i].fileName, job.archiveId);
+		}
+
+		//The 7-Zip processes still running are kept to the limits meanwhile
+		paceArchivers();
+	}
+
+	progress.report(PROGRESS_ARCHIVE_STARTED, "Finished preparation for " + job.archiveName + " Size: "
+		+ getFormattedSizeTitle(job.inputSize), job.archiveId);
+
+	//Arguments are passed to 7-Zip as they are (no shell), so paths
+	//and passwords with spaces or quotes need no escaping
+	std::vector<std::string> arguments;
+	arguments.push_back(settings.sevenZipFile);
+	arguments.push_back("a");
+	arguments.push_back(settings.sevenZip ? "-t7z" : "-tzip");
+	arguments.push_back(job.archivePath);
+
+	//Add the recursive option to store directories
+	arguments.push_back("-r");
+
+	//Set the compression to zero if the user does not want compression
+	if (planner != NULL) {
+		arguments.push_back("-mx=" + itos(compression.level));
+	} else if (!settings.compressFiles) {
+		arguments.push_back("-mx=0");
+	}
+
+	//Add a password, if the user wants one
+	if (settings.password != "") {
+		arguments.push_back("-p" + settings.password);
+		if (settings.sevenZip) {
+			arguments.push_back("-mhe");
+		}
+	}
+
+	//Cap the threads 7-Zip compresses with
+	if (throttle.compressionThreads() > 0) {
+		arguments.push_back("-mmt=" + itos(throttle.compressionThreads()));
+	}
+
+	//Print progress percentages so they can be shown while waiting
+	arguments.push_back("-bsp1");
+
+	arguments.push_back(stagingDirectory + DIRECTORY_SEPARATOR + "*");
+
+	//Start 7-Zip; it is checked on (and its temp directory deleted)
+	//once it is done
+	PendingArchive pending;
+	pending.archiveId = job.archiveId;
+	pending.archiveName = job.archiveName;
+	pending.stagingDirectory = stagingDirectory;
+	pending.process = new ChildProcess();
+	pending.plan = plan;
+	pending.inputSize = job.inputSize;
+	pending.started = started;
+	pending.compression = compression;
+	pending.bytesCharged = 0;
+
+	if (pending.process->start(arguments, settings.workingDirectory)) {
+		pendingArchives.push_back(pending);
+	} else {
+		progress.report(PROGRESS_ERROR, "Could not start " + settings.sevenZipFile, job.archiveId);
+		delete pending.process;
+		deleteDirectory(stagingDirectory);
+	}
+}
+
+//Waits until fewer than maxRunning 7-Zip processes are running (0 = until none are),
+//reporting on each one that finishes.  The status shows their progress.
+void ArchiveBuilder::waitForSlot(unsigned int maxRunning) {
+	while (true) {
+		std::string status = "";
+		paceArchivers();
+
+		for (size_t i = 0; i < pendingArchives.size(); i ++) {
+			pendingArchives[i].process->poll();
+			pendingArchives[i].process->killIfOverTime(settings.archiverTimeoutSeconds);
+			if (cancel.cancelled()) {
+				pendingArchives[i].process->kill();
+			}
+
+			if (!pendingArchives[i].process->running()) {
+				finishArchive(pendingArchives[i]);
+				pendingArchives.erase(pendingArchives.begin() + i);
+				i --;
+			} else if (pendingArchives[i].process->progress() >= 0) {
+				status += "Archive #" + itos(pendingArchives[i].archiveId) + ": "
+					+ itos(pendingArchives[i].process->progress()) + "%"
+					+ (pendingArchives[i].process->suspended() ? " (throttled)  " : "  ");
+			}
+		}
+
+		if (pendingArchives.size() < maxRunning || pendingArchives.empty()) {
+			return;
+		}
+
+		if (status != "") {
+			progress.report(PROGRESS_STATUS, status);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(ARCHIVER_POLL_MILLISECONDS));
+	}
+}
+
+//Keeps the 7-Zip processes to the write limit.  Whatever each one has added
+//to its archive since the last check is counted against the limit, and
+//while that leaves the limit in debt, the process is suspended.  Its reads
+//aren't counted: it reads the staged files, which the copy to the staging
+//directory has paid for already (and which are mostly still cached).
+void ArchiveBuilder::paceArchivers() {
+	bool limited = throttle.limitsIo();
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < pendingArchives.size(); i ++) {
+		PendingArchive &archive = pendingArchives[i];
+		if (!archive.process->running()) {
+			continue;
+		}
+		if (archive.process->suspended()) {
+			if (limited && now < archive.resumeAt) {
+				continue;
+			}
+			archive.process->resume();
+		}
+
+		//Without limits the bytes cost nothing, but they are still counted,
+		//so turning a limit on doesn't charge for everything written before
+		long long size = growingFileSize(archive.plan.archivePath);
+		if (size <= archive.bytesCharged) {
+			continue;
+		}
+		double holdSeconds = throttle.chargeWrite((unsigned long long)(size - archive.bytesCharged));
+		archive.bytesCharged = size;
+		if (limited && holdSeconds > 0) {
+			archive.resumeAt = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(holdSeconds));
+			archive.process->suspend();
+		}
+	}
+}
+
+//Reports how a 7-Zip process ended and cleans up after it.
+//Archives that were made are queued for verification, and measured for
+//picking the next compression levels.
+void ArchiveBuilder::finishArchive(PendingArchive &archive) {
+	const ProcessResult &result = archive.process->result();
+	bool made = false;
+
+	if (cancel.cancelled() && result.exitCode != 0) {
+		//Don't leave half an archive behind
+		remove(archive.plan.archivePath.c_str());
+		progress.report(PROGRESS_WARNING, "Stopped 7-Zip on " + archive.archiveName, archive.archiveId);
+	} else if (result.timedOut) {
+		//What 7-Zip wrote so far has the archive's name, but isn't one
+		remove(archive.plan.archivePath.c_str());
+		progress.report(PROGRESS_ERROR, "7-Zip was stopped after " + dtos(floorDoubleAt(result.seconds, 0.1))
+			+ " seconds on " + archive.archiveName + ", and the archive was removed", archive.archiveId);
+	} else if (result.exitCode == 0) {
+		progress.report(PROGRESS_ARCHIVE_FINISHED, "Finished creating archive #" + itos(archive.archiveId) + " in "
+			+ dtos(floorDoubleAt(result.seconds, 0.1)) + " seconds", archive.archiveId);
+		made = true;
+	} else if (result.exitCode == 1) {
+		//Warning (for example, a file could not be opened)
+		progress.report(PROGRESS_WARNING, "7-Zip reported problems with " + archive.archiveName + ":\n"
+			+ result.output, archive.archiveId);
+	} else {
+		progress.report(PROGRESS_ERROR, "7-Zip failed on " + archive.archiveName + " (exit code "
+			+ itos(result.exitCode) + "):\n" + result.output, archive.archiveId);
+	}
+
+	if (verifier != NULL && !cancel.cancelled() && !result.timedOut && (result.exitCode == 0 || result.exitCode == 1)) {
+		verifier->submit(archive.plan);
+	}
+
+	if (made) {
+		madeArchives.insert(archive.archiveId);
+		recordCompression(archive.archiveId, archive.archiveName, archive.plan.archivePath, archive.inputSize,
+			secondsSince(archive.started), archive.compression);
+	}
+
+	deleteDirectory(archive.stagingDirectory);
+
+	delete archive.process;
+	archive.process = NULL;
+}
+
+//Tells the compression planner how big a finished archive came out and how
+//long it took (from when its files started being copied)
+void ArchiveBuilder::recordCompression(int archiveId, const std::string &archiveName, const std::string &archivePath,
+									   long long inputSize, double seconds, const CompressionChoice &choice) {
+	long long outputSize = 0;
+	if (planner == NULL || FileSize(archivePath, outputSize) != 0) {
+		return;
+	}
+
+	CompressionMeasurement measurement;
+	measurement.archiveId = archiveId;
+	measurement.archiveName = archiveName;
+	measurement.choice = choice;
+	measurement.inputBytes = inputSize;
+	measurement.outputBytes = outputSize;
+	measurement.seconds = seconds;
+	planner->record(measurement);
+}
+
+//Reports the throttle settings in effect
+void ArchiveBuilder::reportThrottleSettings() {
+	ThrottleSettings current = throttle.settings();
+	progress.report(PROGRESS_MESSAGE, "Throttle: reading " + (current.readBytesPerSecond > 0
+		? getFormattedSizeTitle(current.readBytesPerSecond) + "/s" : std::string("unlimited"))
+		+ ", writing " + (current.writeBytesPerSecond > 0
+		? getFormattedSizeTitle(current.writeBytesPerSecond) + "/s" : std::string("unlimited"))
+		+ ", compression threads " + (current.compressionThreads > 0 ? itos(current.compressionThreads) : "all")
+		+ ", latency target " + (current.latencyTargetMilliseconds > 0
+		? itos(current.latencyTargetMilliseconds) + " ms" : "off"));
+}
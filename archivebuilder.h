@@ -0,0 +1,146 @@
+// Archiver and Splitter
+// archivebuilder.h
+// Makes the archives, with 7-Zip or the built-in compressor
+
+#pragma once
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "archiveverifier.h"
+#include "cancellation.h"
+#include "compressionplanner.h"
+#include "filescanner.h"
+#include "iothrottle.h"
+#include "manifestwriter.h"
+#include "process.h"
+#include "progress.h"
+#include "threadpool.h"
+
+struct ArchiveBuilderSettings {
+	//7z archives (made by 7-Zip), or ZIP archives
+	bool sevenZip;
+	//False stores the files (7-Zip's -mx=0)
+	bool compressFiles;
+	//ZIP archives made by the built-in compressor instead of 7-Zip, at this level
+	bool useBuiltinCompressor;
+	int builtinCompressionLevel;
+	std::string password;
+	std::string sevenZipFile;
+	//Where 7-Zip runs ("" = the current directory)
+	std::string workingDirectory;
+	//Temp directory the files are copied to for 7-Zip.  With more than one
+	//7-Zip process, each archive gets a numbered directory inside it.
+	std::string stagingDirectory;
+	unsigned int maxArchiverProcesses;
+	//0 = no limit
+	unsigned int archiverTimeoutSeconds;
+	//Check each archive once it is made, on other threads
+	bool verifyArchives;
+	//Automatic compression level: finish within this many seconds, or keep
+	//up this many bytes per second (both 0 = the level is fixed)
+	double compressionDeadlineSeconds;
+	double compressionTargetBytesPerSecond;
+};
+
+//One archive to make
+struct ArchiveJob {
+	int archiveId;
+	//Name as it appears in the summary file, and the path to write
+	std::string archiveName;
+	std::string archivePath;
+	//The files, and their paths relative to the input directory (the names
+	//they get in the archive)
+	std::vector<FileInformationPiece> files;
+	std::vector<std::string> entryNames;
+	long long inputSize;
+};
+
+//Makes archives one at a time, or hands them to several 7-Zip processes at
+//once.  Finished archives are queued for verification and measured for the
+//automatic compression level; positions of the files the built-in
+//compressor writes go to the manifest's locator index.
+class ArchiveBuilder {
+public:
+	ArchiveBuilder(const ArchiveBuilderSettings &settings, IoThrottle &throttle, ManifestWriter &manifest,
+				   ProgressReporter &progress, const CancellationToken &cancel);
+	//Stops any 7-Zip processes that are still running
+	~ArchiveBuilder();
+
+	//Makes one archive.  With 7-Zip, this waits for a free slot, copies the
+	//files to the staging directory and starts 7-Zip, which is checked on
+	//by the later calls.  remainingBytes (including this archive) is what
+	//the automatic compression level has left to get through.
+	void build(const ArchiveJob &job, unsigned long long remainingBytes);
+
+	//Waits for all the 7-Zip processes (or stops them, once cancelled)
+	void finish();
+
+	//Reports the verification results that are ready (all of them, with wait)
+	void collectVerification(bool wait);
+	const std::vector<VerificationResult> &verificationResults() const;
+
+	//NULL without an automatic compression level
+	const CompressionPlanner *compressionPlanner() const;
+
+	//Archives finished without errors
+	unsigned int archivesMade() const;
+	bool archiveMade(int archiveId) const;
+
+private:
+	ArchiveBuilder(const ArchiveBuilder &);
+	ArchiveBuilder &operator=(const ArchiveBuilder &);
+
+	//An archive that 7-Zip is still working on
+	struct PendingArchive {
+		int archiveId;
+		std::string archiveName;
+		//Temp directory the files were copied to (deleted when 7-Zip is done)
+		std::string stagingDirectory;
+		ChildProcess *process;
+		//What to check the archive against once it is done (with verification on)
+		ArchivePlan plan;
+		//Size of the files in it, when copying them started, and the level
+		//picked for it (with an automatic compression level)
+		long long inputSize;
+		std::chrono::steady_clock::time_point started;
+		CompressionChoice compression;
+		//How much of the archive has been counted against the write limit,
+		//and when 7-Zip may go on while it is held back for it
+		long long bytesCharged;
+		std::chrono::steady_clock::time_point resumeAt;
+	};
+
+	CompressionChoice chooseCompression(const ArchiveJob &job, unsigned long long remainingBytes);
+	void buildBuiltin(const ArchiveJob &job, const ArchivePlan &plan, const CompressionChoice &compression,
+					  std::chrono::steady_clock::time_point started);
+	void startSevenZip(const ArchiveJob &job, const ArchivePlan &plan, const CompressionChoice &compression,
+					   std::chrono::steady_clock::time_point started);
+	void waitForSlot(unsigned int maxRunning);
+	void paceArchivers();
+	void finishArchive(PendingArchive &archive);
+	void recordCompression(int archiveId, const std::string &archiveName, const std::string &archivePath,
+						   long long inputSize, double seconds, const CompressionChoice &choice);
+	void reportThrottleSettings();
+
+	ArchiveBuilderSettings settings;
+	IoThrottle &throttle;
+	ManifestWriter &manifest;
+	ProgressReporter &progress;
+	CancellationToken cancel;
+
+	//Worker threads for the built-in compressor (one per core), shared by all archives
+	ThreadPool *compressionPool;
+	//Threads that check the finished archives, separate from the compression
+	//threads so verification never holds up the next archive
+	ThreadPool *verificationPool;
+	ArchiveVerifier *verifier;
+	std::vector<VerificationResult> verified;
+	//Picks each archive's compression level from how the ones before it went
+	CompressionPlanner *planner;
+
+	std::vector<PendingArchive> pendingArchives;
+	std::set<int> madeArchives;
+};
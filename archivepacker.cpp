@@ -0,0 +1,165 @@
+// Archiver and Splitter
+// archivepacker.cpp
+
+#include "archivepacker.h"
+
+#include <algorithm>
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//Number of files the rolling hash looks at: the file that may end the
+//archive and the ones just before it
+const size_t STABLE_WINDOW_FILES = 3;
+
+//An archive is at least this fraction of the maximum size before it can end,
+//and past that, goes on for about this much more on average
+const long long STABLE_MINIMUM_DIVISOR = 4;
+const long long STABLE_AVERAGE_EXTRA_DIVISOR = 4;
+
+}
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+//Final mix of splitmix64, so every input bit affects every output bit
+uint64_t mix64(uint64_t value) {
+	value ^= value >> 30;
+	value *= 0xbf58476d1ce4e5b9ULL;
+	value ^= value >> 27;
+	value *= 0x94d049bb133111ebULL;
+	value ^= value >> 31;
+	return value;
+}
+
+uint64_t rotateLeft(uint64_t value, unsigned int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+}
+
+////////////////
+//   PACKER
+////////////////
+
+//Taken from
+//http://stackoverflow.com/questions/4892680/sorting-a-vector-of-structs
+bool compareFileInformationPiece(const FileInformationPiece &a,
+								 const FileInformationPiece &b) {
+	//sort from greatest to least
+	return a.fileSize > b.fileSize;
+}
+
+ArchivePacker::ArchivePacker(PackingMode mode, long long maxFileSize, const std::string &baseDirectory)
+	: mode(mode), maxFileSize(maxFileSize), baseDirectory(baseDirectory) {
+}
+
+void ArchivePacker::sortFiles(std::vector<FileInformationPiece> &files) const {
+	if (mode == PACK_FIT_SIZE) {
+		std::stable_sort(files.begin(), files.end(), compareFileInformationPiece);
+	}
+}
+
+std::vector<FileInformationPiece> ArchivePacker::nextArchive(std::vector<FileInformationPiece> &files) {
+	std::vector<FileInformationPiece> archiveFiles;
+	long long archiveSize = 0;
+
+	if (mode == PACK_FIT_SIZE) {
+		//The files that don't fit stay (still sorted) for the next archives
+		std::vector<FileInformationPiece> remaining;
+		for (size_t i = 0; i < files.size(); i ++) {
+			if (i == 0 || files[i].fileSize + archiveSize < maxFileSize) {
+				archiveFiles.push_back(files[i]);
+				archiveSize += files[i].fileSize;
+			} else {
+				remaining.push_back(files[i]);
+			}
+		}
+		files.swap(remaining);
+		return archiveFiles;
+	}
+
+	size_t count = 0;
+	if (mode == PACK_STABLE) {
+		count = stableArchiveLength(files);
+	} else {
+		//Stop at the first file that doesn't fit; we do not want to mess up the file order
+		while (count < files.size() && (count == 0 || files[count].fileSize + archiveSize < maxFileSize)) {
+			archiveSize += files[count].fileSize;
+			count ++;
+		}
+	}
+
+	archiveFiles.assign(files.begin(), files.begin() + count);
+	files.erase(files.begin(), files.begin() + count);
+	return archiveFiles;
+}
+
+size_t ArchivePacker::stableArchiveLength(const std::vector<FileInformationPiece> &files) {
+	long long minimumSize = maxFileSize / STABLE_MINIMUM_DIVISOR;
+	long long archiveSize = 0;
+	size_t count = 0;
+
+	while (count < files.size()) {
+		const FileInformationPiece &file = files[count];
+
+		//The maximum size ends an archive wherever it is reached
+		if (count > 0 && file.fileSize + archiveSize >= maxFileSize) {
+			break;
+		}
+
+		archiveSize += file.fileSize;
+		count ++;
+		window.push_back(fileFingerprint(file));
+		if (window.size() > STABLE_WINDOW_FILES) {
+			window.pop_front();
+		}
+
+		//A file bigger than the maximum goes in an archive of its own
+		if (file.fileSize >= maxFileSize) {
+			break;
+		}
+		if (archiveSize >= minimumSize && endsArchive(file.fileSize)) {
+			break;
+		}
+	}
+	return count;
+}
+
+//FNV-1a of the path relative to the base directory, mixed with the size.
+//The modification time is left out, so rewriting a file in place doesn't
+//move any boundaries (only the archive holding it changes).
+uint64_t ArchivePacker::fileFingerprint(const FileInformationPiece &file) const {
+	size_t start = file.fileName.compare(0, baseDirectory.length(), baseDirectory) == 0 ? baseDirectory.length() : 0;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = start; i < file.fileName.length(); i ++) {
+		hash ^= (unsigned char)file.fileName[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return mix64(hash ^ mix64((uint64_t)file.fileSize));
+}
+
+//Decides from the window whether the last file taken ends the archive.
+//The chance is the file's share of the average extra size, so a big file
+//is as likely to end an archive as the many small files it replaces.
+bool ArchivePacker::endsArchive(long long fileSize) const {
+	uint64_t hash = 0;
+	for (size_t i = 0; i < window.size(); i ++) {
+		hash = rotateLeft(hash, 21) ^ window[i];
+	}
+	hash = mix64(hash);
+
+	double averageExtra = (double)(maxFileSize / STABLE_AVERAGE_EXTRA_DIVISOR);
+	if (averageExtra <= 0) {
+		return true;
+	}
+	//Top 53 bits as a number from 0 to 1
+	double position = (double)(hash >> 11) / 9007199254740992.0;
+	return position < (double)fileSize / averageExtra;
+}
@@ -0,0 +1,64 @@
+// Archiver and Splitter
+// archivepacker.h
+// Divides the files that were found into groups, one per archive
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "filescanner.h"
+
+enum PackingMode {
+	//Files in the order they were found; each archive ends before the
+	//first file that doesn't fit
+	PACK_IN_ORDER,
+	//Biggest files first; every file that still fits goes in, for the
+	//fewest archives.  The original file order is not preserved.
+	PACK_FIT_SIZE,
+	//In order, with the ends of the archives picked by a rolling hash of
+	//the files' paths and sizes (like content-defined chunking), so adding
+	//or removing a file only moves the boundaries next to it
+	PACK_STABLE
+};
+
+//Use for sorting: greatest to least
+bool compareFileInformationPiece(const FileInformationPiece &a,
+								 const FileInformationPiece &b);
+
+//Takes the files for each archive off the list of files that were found.
+//A file bigger than maxFileSize always gets an archive of its own.
+//
+//PACK_STABLE keeps each archive between a quarter of maxFileSize and
+//maxFileSize.  Past the minimum, an archive ends after a file if the hash
+//of that file and the ones just before it falls under a threshold that
+//grows with the file's size, which makes the archives half of maxFileSize
+//on average however big the files are.  Whether a file ends an archive
+//depends only on the files next to it, so after a change the boundaries
+//fall back into the same places within an archive or two.
+class ArchivePacker {
+public:
+	//baseDirectory is taken off the paths before they are hashed, so moving
+	//the whole tree doesn't move the boundaries
+	ArchivePacker(PackingMode mode, long long maxFileSize, const std::string &baseDirectory);
+
+	//Puts newly found files in the order nextArchive needs
+	void sortFiles(std::vector<FileInformationPiece> &files) const;
+
+	//Takes the files for the next archive out of files.  Calls follow each
+	//other through the list (the rolling hash carries over).
+	std::vector<FileInformationPiece> nextArchive(std::vector<FileInformationPiece> &files);
+
+private:
+	size_t stableArchiveLength(const std::vector<FileInformationPiece> &files);
+	uint64_t fileFingerprint(const FileInformationPiece &file) const;
+	bool endsArchive(long long fileSize) const;
+
+	PackingMode mode;
+	long long maxFileSize;
+	std::string baseDirectory;
+	//Fingerprints of the last few files taken (PACK_STABLE)
+	std::deque<uint64_t> window;
+};
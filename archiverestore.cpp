@@ -0,0 +1,377 @@
+// Archiver and Splitter
+// archiverestore.cpp
+
+#include "archiverestore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <sstream>
+
+#include "process.h"
+#include "zipreader.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <direct.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+#ifdef _WIN32
+const char PATH_SEPARATOR = '\\';
+#else
+const char PATH_SEPARATOR = '/';
+#endif
+
+std::string numberString(unsigned long long value) {
+	std::ostringstream convert;
+	convert << value;
+	return convert.str();
+}
+
+//Entry names must stay inside the destination directory
+bool isSafeRelativePath(const std::string &name) {
+	if (name.empty() || name[0] == '/' || name[0] == '\\' || name.find(':') != std::string::npos) {
+		return false;
+	}
+	size_t start = 0;
+	while (start <= name.length()) {
+		size_t end = name.find_first_of("/\\", start);
+		if (end == std::string::npos) {
+			end = name.length();
+		}
+		if (name.compare(start, end - start, "..") == 0 && end - start == 2) {
+			return false;
+		}
+		start = end + 1;
+	}
+	return true;
+}
+
+std::string destinationPath(const std::string &destinationDirectory, const std::string &entryName) {
+	std::string path = destinationDirectory;
+	if (!path.empty() && path[path.length() - 1] != '/' && path[path.length() - 1] != '\\') {
+		path += PATH_SEPARATOR;
+	}
+	for (size_t i = 0; i < entryName.length(); i ++) {
+		path += (entryName[i] == '/' || entryName[i] == '\\') ? PATH_SEPARATOR : entryName[i];
+	}
+	return path;
+}
+
+//Creates the directories leading up to a file.  Other threads may be
+//creating the same ones, so existing directories are fine.
+void makeParentDirectories(const std::string &filePath) {
+	for (size_t i = 1; i < filePath.length(); i ++) {
+		if (filePath[i] != '/' && filePath[i] != '\\') {
+			continue;
+		}
+		std::string directory = filePath.substr(0, i);
+#ifdef _WIN32
+		if (directory.length() == 2 && directory[1] == ':') {
+			continue;
+		}
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0777);
+#endif
+	}
+}
+
+//A file that gets its full size allocated when it is created, so a big
+//file is laid out in one piece instead of growing a write at a time
+class PreallocatedFile {
+public:
+	PreallocatedFile()
+#ifdef _WIN32
+		: handle(INVALID_HANDLE_VALUE) {
+#else
+		: fileDescriptor(-1) {
+#endif
+	}
+
+	~PreallocatedFile() {
+		close();
+	}
+
+	bool open(const std::string &path, unsigned long long size) {
+#ifdef _WIN32
+		handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (handle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER distance;
+		distance.QuadPart = (long long)size;
+		if (size > 0 && SetFilePointerEx(handle, distance, NULL, FILE_BEGIN) && SetEndOfFile(handle)) {
+			distance.QuadPart = 0;
+			SetFilePointerEx(handle, distance, NULL, FILE_BEGIN);
+		}
+		return true;
+#else
+		fileDescriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fileDescriptor < 0) {
+			return false;
+		}
+#ifdef __linux__
+		if (size > 0) {
+			posix_fallocate(fileDescriptor, 0, (off_t)size);
+		}
+#endif
+		return true;
+#endif
+	}
+
+	bool write(const unsigned char *data, size_t length) {
+#ifdef _WIN32
+		while (length > 0) {
+			DWORD chunk = length > 0x40000000 ? 0x40000000 : (DWORD)length;
+			DWORD written = 0;
+			if (!WriteFile(handle, data, chunk, &written, NULL) || written == 0) {
+				return false;
+			}
+			data += written;
+			length -= written;
+		}
+#else
+		while (length > 0) {
+			ssize_t written = ::write(fileDescriptor, data, length);
+			if (written < 0 && errno == EINTR) {
+				continue;
+			}
+			if (written <= 0) {
+				return false;
+			}
+			data += written;
+			length -= (size_t)written;
+		}
+#endif
+		return true;
+	}
+
+	bool close() {
+		bool ok = true;
+#ifdef _WIN32
+		if (handle != INVALID_HANDLE_VALUE) {
+			ok = CloseHandle(handle) != 0;
+			handle = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (fileDescriptor >= 0) {
+			ok = ::close(fileDescriptor) == 0;
+			fileDescriptor = -1;
+		}
+#endif
+		return ok;
+	}
+
+private:
+	PreallocatedFile(const PreallocatedFile &);
+	PreallocatedFile &operator=(const PreallocatedFile &);
+
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	int fileDescriptor;
+#endif
+};
+
+bool compareEntryOffset(const LocatorEntry &a, const LocatorEntry &b) {
+	return a.entryOffset < b.entryOffset;
+}
+
+void restoreWithSevenZip(const RestoreArchivePlan &plan, const std::string &destinationDirectory,
+						 const std::string &sevenZipFile, const std::string &password, RestoreResult &result) {
+	std::vector<std::string> arguments;
+	arguments.push_back(sevenZipFile);
+	arguments.push_back("x");
+	arguments.push_back(plan.archivePath);
+	arguments.push_back("-o" + destinationDirectory);
+	arguments.push_back("-y");
+	if (password != "") {
+		arguments.push_back("-p" + password);
+	}
+
+	ChildProcess process;
+	if (!process.start(arguments, "")) {
+		result.problems.push_back("Could not start " + sevenZipFile);
+		return;
+	}
+	process.wait(0);
+	const ProcessResult &processResult = process.result();
+
+	if (processResult.exitCode != 0) {
+		result.problems.push_back("7-Zip failed (exit code " + numberString(processResult.exitCode) + "):");
+		result.problems.push_back(processResult.output);
+		return;
+	}
+
+	result.filesRestored = (unsigned int)plan.entries.size();
+	for (size_t i = 0; i < plan.entries.size(); i ++) {
+		result.bytesRestored += plan.entries[i].uncompressedSize;
+	}
+}
+
+}
+
+////////////////
+//   RESTORE
+////////////////
+
+std::vector<RestoreArchivePlan> restorePlanArchives(const LocatorIndex &locatorIndex,
+													const std::string &archiveDirectory) {
+	std::map<int, RestoreArchivePlan> plans;
+	LocatorEntry entry;
+	for (unsigned long long i = 0; locatorIndex.entry(i, entry); i ++) {
+		RestoreArchivePlan &plan = plans[entry.archiveId];
+		if (plan.entries.empty()) {
+			plan.archiveId = entry.archiveId;
+			plan.archiveName = entry.archiveName;
+			plan.archivePath = archiveDirectory + entry.archiveName;
+		}
+		plan.entries.push_back(entry);
+	}
+
+	std::vector<RestoreArchivePlan> ordered;
+	for (std::map<int, RestoreArchivePlan>::iterator it = plans.begin(); it != plans.end(); it ++) {
+		ordered.push_back(it->second);
+	}
+	return ordered;
+}
+
+RestoreResult restoreArchive(const RestoreArchivePlan &plan, const std::string &destinationDirectory,
+							 const std::string &sevenZipFile, const std::string &password) {
+	RestoreResult result;
+	result.archiveId = plan.archiveId;
+	result.archiveName = plan.archiveName;
+	result.filesRestored = 0;
+	result.bytesRestored = 0;
+
+	ZipReader reader;
+	if (!reader.open(plan.archivePath)) {
+		result.problems.push_back(reader.errorMessage());
+		return result;
+	}
+
+	std::vector<LocatorEntry> entries = plan.entries;
+
+	//Files without an offset are looked up in the central directory; if
+	//there isn't one, this isn't a ZIP archive and 7-Zip has to do it
+	bool offsetsKnown = true;
+	for (size_t i = 0; i < entries.size(); i ++) {
+		if (entries[i].entryOffset == LOCATOR_UNKNOWN_OFFSET) {
+			offsetsKnown = false;
+		}
+	}
+	if (!offsetsKnown) {
+		std::vector<ZipEntryInfo> centralEntries;
+		if (!reader.readCentralDirectory(centralEntries)) {
+			reader.close();
+			restoreWithSevenZip(plan, destinationDirectory, sevenZipFile, password, result);
+			return result;
+		}
+
+		std::map<std::string, size_t> byName;
+		for (size_t i = 0; i < centralEntries.size(); i ++) {
+			byName[locatorNormalizeName(centralEntries[i].entryName)] = i;
+		}
+		for (size_t i = 0; i < entries.size(); i ++) {
+			std::map<std::string, size_t>::iterator match = byName.find(locatorNormalizeName(entries[i].entryName));
+			if (match != byName.end()) {
+				const ZipEntryInfo &info = centralEntries[match->second];
+				entries[i].entryOffset = info.localHeaderOffset;
+				entries[i].compressedSize = info.compressedSize;
+				entries[i].uncompressedSize = info.uncompressedSize;
+				entries[i].crc = info.crc;
+			}
+		}
+	}
+
+	//Reading in offset order goes through the archive front to back
+	std::sort(entries.begin(), entries.end(), compareEntryOffset);
+
+	for (size_t i = 0; i < entries.size(); i ++) {
+		const LocatorEntry &entry = entries[i];
+		if (entry.entryOffset == LOCATOR_UNKNOWN_OFFSET) {
+			result.problems.push_back("Not in the archive: " + entry.entryName);
+			continue;
+		}
+		if (!isSafeRelativePath(entry.entryName)) {
+			result.problems.push_back("Unsafe path skipped: " + entry.entryName);
+			continue;
+		}
+
+		std::string path = destinationPath(destinationDirectory, entry.entryName);
+		makeParentDirectories(path);
+
+		PreallocatedFile file;
+		if (!file.open(path, entry.uncompressedSize)) {
+			result.problems.push_back("Could not create " + path);
+			continue;
+		}
+
+		ZipEntryInfo info;
+		info.entryName = entry.entryName;
+		info.crc = entry.crc;
+		info.compressedSize = entry.compressedSize;
+		info.uncompressedSize = entry.uncompressedSize;
+		info.localHeaderOffset = entry.entryOffset;
+		info.method = 0;
+		info.encrypted = false;
+
+		bool writeFailed = false;
+		bool ok = reader.extractEntry(info, password, [&file, &writeFailed](const unsigned char *data, size_t size) {
+			writeFailed = !file.write(data, size);
+			return !writeFailed;
+		});
+		ok = file.close() && ok;
+
+		if (!ok) {
+			result.problems.push_back(entry.entryName + ": "
+				+ (writeFailed ? "could not write " + path : reader.errorMessage()));
+			remove(path.c_str());
+			continue;
+		}
+
+		result.filesRestored ++;
+		result.bytesRestored += entry.uncompressedSize;
+	}
+	return result;
+}
+
+ArchiveRestorer::ArchiveRestorer(ThreadPool &pool, const std::string &destinationDirectory,
+								 const std::string &sevenZipFile, const std::string &password)
+	: pool(pool), destinationDirectory(destinationDirectory), sevenZipFile(sevenZipFile), password(password) {
+}
+
+void ArchiveRestorer::submit(const RestoreArchivePlan &plan) {
+	std::string destination = destinationDirectory;
+	std::string sevenZip = sevenZipFile;
+	std::string archivePassword = password;
+	pending.push_back(pool.submit([plan, destination, sevenZip, archivePassword]() {
+		return restoreArchive(plan, destination, sevenZip, archivePassword);
+	}));
+}
+
+std::vector<RestoreResult> ArchiveRestorer::collect(bool wait) {
+	std::vector<RestoreResult> results;
+	while (!pending.empty()) {
+		if (!wait && pending.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			break;
+		}
+		results.push_back(pending.front().get());
+		pending.pop_front();
+	}
+	return results;
+}
@@ -0,0 +1,61 @@
+// Archiver and Splitter
+// archiverestore.h
+// Extracts a whole set of archives back into the original directory layout
+
+#pragma once
+
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "locatorindex.h"
+#include "threadpool.h"
+
+//One archive to restore, with the files the locator index has for it
+struct RestoreArchivePlan {
+	int archiveId;
+	std::string archiveName;
+	std::string archivePath;
+	std::vector<LocatorEntry> entries;
+};
+
+struct RestoreResult {
+	int archiveId;
+	std::string archiveName;
+	unsigned int filesRestored;
+	unsigned long long bytesRestored;
+	//One line per file (or archive) that couldn't be restored
+	std::vector<std::string> problems;
+};
+
+//Restores archives on a thread pool, one archive per task, so the pool's size
+//is how many archives are read and written at once.
+//ZIP entries are read at their indexed offsets in offset order, and each
+//file is preallocated to its full size before it is written.  Archives that
+//aren't ZIP files are extracted by 7-Zip.
+class ArchiveRestorer {
+public:
+	ArchiveRestorer(ThreadPool &pool, const std::string &destinationDirectory, const std::string &sevenZipFile,
+					const std::string &password);
+
+	void submit(const RestoreArchivePlan &plan);
+
+	//Returns the results that are ready, in the order the archives were
+	//submitted.  With wait set, waits for all of them.
+	std::vector<RestoreResult> collect(bool wait);
+
+private:
+	ThreadPool &pool;
+	std::string destinationDirectory;
+	std::string sevenZipFile;
+	std::string password;
+	std::deque<std::future<RestoreResult> > pending;
+};
+
+//Groups the files of an index by archive, in archive ID order
+std::vector<RestoreArchivePlan> restorePlanArchives(const LocatorIndex &locatorIndex,
+													const std::string &archiveDirectory);
+
+RestoreResult restoreArchive(const RestoreArchivePlan &plan, const std::string &destinationDirectory,
+							 const std::string &sevenZipFile, const std::string &password);
@@ -0,0 +1,284 @@
+// Archiver and Splitter
+// archivesetindex.cpp
+
+#include "archivesetindex.h"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "sha1.h"
+#include "utilities.h"
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//Added to a previous archive's name while it is moved aside
+const char *MOVED_ASIDE_SUFFIX = ".previous";
+
+const char *INDEX_HEADER = "# Archiver and Splitter file sets";
+
+//Start of the line with the password verifier
+const char *PASSWORD_PREFIX = "password ";
+
+//As slow to test a password against as 7-Zip's own key derivation (2^19
+//rounds), so the index is no easier to guess the password from than the
+//archives are
+const unsigned int PASSWORD_ITERATIONS = 1 << 19;
+const size_t PASSWORD_SALT_SIZE = 16;
+
+}
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+void hashString(Sha1 &sha1, const std::string &text) {
+	//Length first, so the fields can't run into each other
+	unsigned long long length = text.length();
+	sha1.update(&length, sizeof(length));
+	sha1.update(text.data(), text.length());
+}
+
+void hashNumber(Sha1 &sha1, long long number) {
+	unsigned char bytes[8];
+	for (int i = 0; i < 8; i ++) {
+		bytes[i] = (unsigned char)((unsigned long long)number >> (8 * i));
+	}
+	sha1.update(bytes, sizeof(bytes));
+}
+
+std::string hexString(const unsigned char *bytes, size_t length) {
+	static const char HEX_DIGITS[] = "0123456789abcdef";
+	std::string hex;
+	for (size_t i = 0; i < length; i ++) {
+		hex += HEX_DIGITS[bytes[i] >> 4];
+		hex += HEX_DIGITS[bytes[i] & 0x0f];
+	}
+	return hex;
+}
+
+//The salt is kept as hex and used as it is written
+std::string makePasswordVerifier(const std::string &password, const std::string &salt) {
+	unsigned char verifier[SHA1_DIGEST_SIZE];
+	pbkdf2HmacSha1(password.data(), password.length(), (const unsigned char *)salt.data(), salt.length(),
+		PASSWORD_ITERATIONS, verifier, sizeof(verifier));
+	return hexString(verifier, sizeof(verifier));
+}
+
+bool fileExists(const std::string &path) {
+	long long size = 0;
+	return FileSize(path, size) == 0;
+}
+
+}
+
+////////////////
+//   INDEX
+////////////////
+
+ArchiveSetIndex::ArchiveSetIndex()
+	: passwordChanged(false) {
+}
+
+bool ArchiveSetIndex::load(const std::string &outputDirectory, const std::string &indexFilename) {
+	this->outputDirectory = outputDirectory;
+	indexPath = outputDirectory + indexFilename;
+	previous.clear();
+	current.clear();
+	passwordSalt.clear();
+	passwordVerifier.clear();
+	passwordChanged = false;
+
+	std::ifstream file(indexPath.c_str(), std::ios::in);
+	if (!file.is_open()) {
+		return true;
+	}
+
+	std::string line;
+	while (std::getline(file, line)) {
+		if (!line.empty() && line[line.length() - 1] == '\r') {
+			line.erase(line.length() - 1);
+		}
+		size_t space = line.find(' ');
+		if (line.empty() || line[0] == '#' || space == std::string::npos) {
+			continue;
+		}
+		if (line.compare(0, space + 1, PASSWORD_PREFIX) == 0) {
+			std::istringstream fields(line.substr(space + 1));
+			fields >> passwordSalt >> passwordVerifier;
+			continue;
+		}
+
+		SetRecord record;
+		record.hash = line.substr(0, space);
+		record.archiveName = line.substr(space + 1);
+		previous.push_back(record);
+	}
+
+	if (file.bad()) {
+		error = "Could not read " + indexPath;
+		return false;
+	}
+	return true;
+}
+
+std::string ArchiveSetIndex::fileSetHash(const std::string &settings, const std::vector<std::string> &entryNames,
+										 const std::vector<FileInformationPiece> &files) {
+	Sha1 sha1;
+	hashString(sha1, settings);
+	hashNumber(sha1, (long long)files.size());
+	for (size_t i = 0; i < files.size(); i ++) {
+		hashString(sha1, entryNames[i]);
+		hashNumber(sha1, files[i].fileSize);
+		hashNumber(sha1, files[i].modifiedTime);
+	}
+
+	unsigned char digest[SHA1_DIGEST_SIZE];
+	sha1.final(digest);
+	return hexString(digest, sizeof(digest));
+}
+
+bool ArchiveSetIndex::setPassword(const std::string &password) {
+	if (password.empty()) {
+		passwordChanged = !passwordVerifier.empty();
+		passwordSalt.clear();
+		passwordVerifier.clear();
+		return !passwordChanged || previous.empty();
+	}
+
+	passwordChanged = passwordVerifier.empty() || makePasswordVerifier(password, passwordSalt) != passwordVerifier;
+	if (passwordChanged) {
+		std::random_device saltSource;
+		unsigned char salt[PASSWORD_SALT_SIZE];
+		for (size_t i = 0; i < sizeof(salt); i ++) {
+			salt[i] = (unsigned char)saltSource();
+		}
+		passwordSalt = hexString(salt, sizeof(salt));
+		passwordVerifier = makePasswordVerifier(password, passwordSalt);
+	}
+	return !passwordChanged || previous.empty();
+}
+
+bool ArchiveSetIndex::reuse(const std::string &hash, const std::string &archiveName) {
+	//Archives made with another password are made again
+	if (passwordChanged) {
+		return false;
+	}
+	for (size_t i = 0; i < previous.size(); i ++) {
+		if (previous[i].hash != hash) {
+			continue;
+		}
+		if (!fileExists(outputDirectory + previous[i].archiveName)) {
+			//Deleted since; it has to be made again
+			previous.erase(previous.begin() + i);
+			return false;
+		}
+
+		SetRecord found = previous[i];
+		previous.erase(previous.begin() + i);
+		if (found.archiveName != archiveName) {
+			clearPath(archiveName);
+			if (!moveArchive(found.archiveName, archiveName)) {
+				return false;
+			}
+		}
+		record(hash, archiveName);
+		return true;
+	}
+	return false;
+}
+
+void ArchiveSetIndex::clearPath(const std::string &archiveName) {
+	long long index = previousAt(archiveName);
+	if (index < 0) {
+		return;
+	}
+
+	std::string asideName = archiveName + MOVED_ASIDE_SUFFIX;
+	for (unsigned int attempt = 2; previousAt(asideName) >= 0 || fileExists(outputDirectory + asideName); attempt ++) {
+		asideName = archiveName + MOVED_ASIDE_SUFFIX + itos(attempt);
+	}
+
+	if (moveArchive(archiveName, asideName)) {
+		previous[(size_t)index].archiveName = asideName;
+	} else {
+		//It is about to be overwritten
+		previous.erase(previous.begin() + index);
+	}
+}
+
+void ArchiveSetIndex::keep(const std::string &archiveName) {
+	long long index = previousAt(archiveName);
+	if (index >= 0) {
+		current.push_back(previous[(size_t)index]);
+		previous.erase(previous.begin() + index);
+	}
+}
+
+void ArchiveSetIndex::record(const std::string &hash, const std::string &archiveName) {
+	SetRecord record;
+	record.hash = hash;
+	record.archiveName = archiveName;
+	current.push_back(record);
+}
+
+std::vector<std::string> ArchiveSetIndex::removeUnused() {
+	std::vector<std::string> removed;
+	for (size_t i = 0; i < previous.size(); i ++) {
+		if (remove((outputDirectory + previous[i].archiveName).c_str()) == 0) {
+			removed.push_back(previous[i].archiveName);
+		}
+	}
+	previous.clear();
+	return removed;
+}
+
+bool ArchiveSetIndex::write() {
+	std::ofstream file(indexPath.c_str(), std::ios::out | std::ios::trunc);
+	file << INDEX_HEADER << "\n";
+	if (!passwordVerifier.empty()) {
+		file << PASSWORD_PREFIX << passwordSalt << " " << passwordVerifier << "\n";
+	}
+	for (size_t i = 0; i < current.size(); i ++) {
+		file << current[i].hash << " " << current[i].archiveName << "\n";
+	}
+	for (size_t i = 0; i < previous.size(); i ++) {
+		if (fileExists(outputDirectory + previous[i].archiveName)) {
+			file << previous[i].hash << " " << previous[i].archiveName << "\n";
+		}
+	}
+	file.close();
+
+	if (file.fail()) {
+		error = "Could not write " + indexPath;
+		return false;
+	}
+	return true;
+}
+
+const std::string &ArchiveSetIndex::errorMessage() const {
+	return error;
+}
+
+long long ArchiveSetIndex::previousAt(const std::string &archiveName) const {
+	for (size_t i = 0; i < previous.size(); i ++) {
+		if (previous[i].archiveName == archiveName) {
+			return (long long)i;
+		}
+	}
+	return -1;
+}
+
+bool ArchiveSetIndex::moveArchive(const std::string &fromName, const std::string &toName) {
+	std::string toPath = outputDirectory + toName;
+	//rename() won't replace a file on Windows
+	remove(toPath.c_str());
+	return rename((outputDirectory + fromName).c_str(), toPath.c_str()) == 0;
+}
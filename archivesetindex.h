@@ -0,0 +1,85 @@
+// Archiver and Splitter
+// archivesetindex.h
+// Remembers which files went into each archive, so unchanged archives can be kept on the next run
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "filescanner.h"
+
+//A text file in the output directory with one line per archive:
+//	<file set hash> <archive name, relative to the output directory>
+//On the next run, an archive whose file set hashes the same as one of the
+//previous run's archives is kept instead of being made again.  If the kept
+//archive's number changed (archives were added or removed before it), the
+//file is renamed.  A previous archive that is in the way of a new one is
+//moved aside (to "<name>.previous") until it is either reused or removed.
+//The password isn't part of the hashes (they would give it away to
+//anyone who can read the index).  Instead, the index keeps a salted
+//PBKDF2 verifier of it, on a line of its own:
+//	password <salt> <verifier>
+//and nothing is reused after the password changes.
+class ArchiveSetIndex {
+public:
+	ArchiveSetIndex();
+
+	//Reads the previous run's index.  A missing index is fine (nothing can
+	//be reused); returns false only if it couldn't be read.
+	bool load(const std::string &outputDirectory, const std::string &indexFilename);
+
+	//The password of this run's archives ("" = none), checked against the
+	//previous run's.  Call after load.  Returns false if it changed, in which
+	//case none of the previous run's archives are reused.
+	bool setPassword(const std::string &password);
+
+	//Hash of an archive's settings and each of its files' name (relative to
+	//the input directory), size and modification time
+	static std::string fileSetHash(const std::string &settings, const std::vector<std::string> &entryNames,
+								   const std::vector<FileInformationPiece> &files);
+
+	//If the previous run made an archive with this hash that is still there,
+	//moves it to archiveName (if it isn't there already) and returns true
+	bool reuse(const std::string &hash, const std::string &archiveName);
+
+	//Moves a previous archive that hasn't been reused out of the way of a new
+	//archive about to be written at archiveName
+	void clearPath(const std::string &archiveName);
+
+	//Keeps the previous run's entry for an archive that is skipped this time
+	void keep(const std::string &archiveName);
+
+	//An archive made (or reused) by this run
+	void record(const std::string &hash, const std::string &archiveName);
+
+	//Deletes the previous archives that weren't reused.  Returns their names.
+	std::vector<std::string> removeUnused();
+
+	//Writes this run's archives, along with any previous ones that are still
+	//there (after a cancelled run, so they can be reused next time)
+	bool write();
+
+	const std::string &errorMessage() const;
+
+private:
+	struct SetRecord {
+		std::string hash;
+		std::string archiveName;
+	};
+
+	//Index in previous of the unused archive at archiveName, or -1
+	long long previousAt(const std::string &archiveName) const;
+	bool moveArchive(const std::string &fromName, const std::string &toName);
+
+	std::string outputDirectory;
+	std::string indexPath;
+	//Previous archives that haven't been reused, kept, or removed yet
+	std::vector<SetRecord> previous;
+	std::vector<SetRecord> current;
+	//Hex salt and verifier of the password ("" = no password)
+	std::string passwordSalt;
+	std::string passwordVerifier;
+	bool passwordChanged;
+	std::string error;
+};
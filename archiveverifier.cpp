@@ -0,0 +1,160 @@
+// Archiver and Splitter
+// archiveverifier.cpp
+
+#include "archiveverifier.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+
+#include "locatorindex.h"
+#include "process.h"
+#include "zipreader.h"
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+std::string numberString(unsigned long long value) {
+	std::ostringstream convert;
+	convert << value;
+	return convert.str();
+}
+
+bool isDirectoryEntry(const ZipEntryInfo &entry) {
+	return !entry.entryName.empty() && entry.uncompressedSize == 0
+		&& (entry.entryName[entry.entryName.length() - 1] == '/'
+		|| entry.entryName[entry.entryName.length() - 1] == '\\');
+}
+
+void verifyZip(const ArchivePlan &plan, const std::string &password, VerificationResult &result) {
+	ZipReader reader;
+	std::vector<ZipEntryInfo> entries;
+	if (!reader.open(plan.archivePath) || !reader.readCentralDirectory(entries)) {
+		result.problems.push_back(reader.errorMessage());
+		return;
+	}
+
+	//Planned files by normalized name
+	std::map<std::string, size_t> planned;
+	for (size_t i = 0; i < plan.fileNames.size(); i ++) {
+		planned[locatorNormalizeName(plan.fileNames[i])] = i;
+	}
+
+	std::vector<bool> found(plan.fileNames.size(), false);
+	for (size_t i = 0; i < entries.size(); i ++) {
+		if (isDirectoryEntry(entries[i])) {
+			continue;
+		}
+
+		std::map<std::string, size_t>::iterator match = planned.find(locatorNormalizeName(entries[i].entryName));
+		if (match == planned.end()) {
+			result.problems.push_back("Not in the plan: " + entries[i].entryName);
+			continue;
+		}
+		found[match->second] = true;
+
+		if ((unsigned long long)plan.fileSizes[match->second] != entries[i].uncompressedSize) {
+			result.problems.push_back("Size differs: " + entries[i].entryName + " (planned "
+				+ numberString(plan.fileSizes[match->second]) + " bytes, archived "
+				+ numberString(entries[i].uncompressedSize) + " bytes)");
+		}
+
+		//Decompressing checks the CRC (or AES authentication code) and the size
+		if (!reader.extractEntry(entries[i], password, [](const unsigned char *, size_t) { return true; })) {
+			result.problems.push_back(entries[i].entryName + ": " + reader.errorMessage());
+		}
+		result.filesChecked ++;
+	}
+
+	for (size_t i = 0; i < found.size(); i ++) {
+		if (!found[i]) {
+			result.problems.push_back("Missing from the archive: " + plan.fileNames[i]);
+		}
+	}
+}
+
+void verifySevenZip(const ArchivePlan &plan, const std::string &sevenZipFile, const std::string &password,
+					VerificationResult &result) {
+	std::vector<std::string> arguments;
+	arguments.push_back(sevenZipFile);
+	arguments.push_back("t");
+	arguments.push_back(plan.archivePath);
+	if (password != "") {
+		arguments.push_back("-p" + password);
+	}
+
+	ChildProcess process;
+	if (!process.start(arguments, "")) {
+		result.problems.push_back("Could not start " + sevenZipFile);
+		return;
+	}
+	process.wait(0);
+	const ProcessResult &processResult = process.result();
+
+	if (processResult.exitCode != 0) {
+		result.problems.push_back("7-Zip test failed (exit code " + numberString(processResult.exitCode) + "):");
+		result.problems.push_back(processResult.output);
+		return;
+	}
+
+	//"Files: N" is in the summary 7-Zip prints at the end (with one file it only says "Size:")
+	size_t filesLine = processResult.output.rfind("Files: ");
+	unsigned long long files = filesLine == std::string::npos ? 1
+		: strtoull(processResult.output.c_str() + filesLine + 7, NULL, 10);
+	if (files != plan.fileNames.size()) {
+		result.problems.push_back("Holds " + numberString(files) + " files instead of "
+			+ numberString(plan.fileNames.size()));
+	}
+	result.filesChecked = (unsigned int)files;
+}
+
+}
+
+////////////////
+//   VERIFIER
+////////////////
+
+VerificationResult verifyArchive(const ArchivePlan &plan, const std::string &sevenZipFile,
+								 const std::string &password) {
+	VerificationResult result;
+	result.archiveId = plan.archiveId;
+	result.archiveName = plan.archiveName;
+	result.filesChecked = 0;
+
+	if (plan.sevenZip) {
+		verifySevenZip(plan, sevenZipFile, password, result);
+	} else {
+		verifyZip(plan, password, result);
+	}
+
+	result.ok = result.problems.empty();
+	return result;
+}
+
+ArchiveVerifier::ArchiveVerifier(ThreadPool &pool, const std::string &sevenZipFile, const std::string &password)
+	: pool(pool), sevenZipFile(sevenZipFile), password(password) {
+}
+
+void ArchiveVerifier::submit(const ArchivePlan &plan) {
+	std::string sevenZip = sevenZipFile;
+	std::string archivePassword = password;
+	pending.push_back(pool.submit([plan, sevenZip, archivePassword]() {
+		return verifyArchive(plan, sevenZip, archivePassword);
+	}));
+}
+
+std::vector<VerificationResult> ArchiveVerifier::collect(bool wait) {
+	std::vector<VerificationResult> results;
+	while (!pending.empty()) {
+		if (!wait && pending.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			break;
+		}
+		results.push_back(pending.front().get());
+		pending.pop_front();
+	}
+	return results;
+}
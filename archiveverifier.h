@@ -0,0 +1,58 @@
+// Archiver and Splitter
+// archiveverifier.h
+// Checks finished archives against the files planned for them, in the background
+
+#pragma once
+
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "threadpool.h"
+
+//What was supposed to go in one archive
+struct ArchivePlan {
+	int archiveId;
+	//Name as it appears in the summary file
+	std::string archiveName;
+	std::string archivePath;
+	//True for 7z archives (tested with 7-Zip); ZIP archives are read directly
+	bool sevenZip;
+	//Paths relative to the input directory, and the sizes the files had when they were found
+	std::vector<std::string> fileNames;
+	std::vector<long long> fileSizes;
+};
+
+struct VerificationResult {
+	int archiveId;
+	std::string archiveName;
+	bool ok;
+	unsigned int filesChecked;
+	//One line per mismatch or error
+	std::vector<std::string> problems;
+};
+
+//Re-reads archives on a thread pool while the next ones are being built.
+//ZIP archives are decompressed (and decrypted) entry by entry and each CRC is
+//checked; the entries have to match the plan's names and sizes one to one.
+//7z archives are tested by running "7za t" and checking the number of files.
+class ArchiveVerifier {
+public:
+	ArchiveVerifier(ThreadPool &pool, const std::string &sevenZipFile, const std::string &password);
+
+	void submit(const ArchivePlan &plan);
+
+	//Returns the results that are ready, in the order the archives were
+	//submitted.  With wait set, waits for all of them.
+	std::vector<VerificationResult> collect(bool wait);
+
+private:
+	ThreadPool &pool;
+	std::string sevenZipFile;
+	std::string password;
+	std::deque<std::future<VerificationResult> > pending;
+};
+
+VerificationResult verifyArchive(const ArchivePlan &plan, const std::string &sevenZipFile,
+								 const std::string &password);
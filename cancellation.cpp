@@ -0,0 +1,16 @@
+// Archiver and Splitter
+// cancellation.cpp
+
+#include "cancellation.h"
+
+CancellationToken::CancellationToken()
+	: flag(new std::atomic<bool>(false)) {
+}
+
+void CancellationToken::cancel() {
+	flag->store(true);
+}
+
+bool CancellationToken::cancelled() const {
+	return flag->load();
+}
@@ -0,0 +1,24 @@
+// Archiver and Splitter
+// cancellation.h
+// Lets whoever started a run stop it from another thread
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+//Copies share one flag: the caller keeps a copy and hands another to the
+//run.  cancel() is safe to call from any thread (or a console control
+//handler).  The run checks the flag between files and archives, stops the
+//7-Zip processes it started, and still writes the summary and the locator
+//index for the archives that were finished.
+class CancellationToken {
+public:
+	CancellationToken();
+
+	void cancel();
+	bool cancelled() const;
+
+private:
+	std::shared_ptr<std::atomic<bool> > flag;
+};
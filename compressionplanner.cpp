@@ -0,0 +1,179 @@
+// Archiver and Splitter
+// compressionplanner.cpp
+
+#include "compressionplanner.h"
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//A level is only picked if it is expected to be this much faster than needed
+const double SPEED_MARGIN = 1.1;
+
+//Data that saves less than this much when compressed is stored instead
+const double INCOMPRESSIBLE_RATIO = 0.98;
+
+//While the data is being stored, an archive is compressed again after this
+//many stored ones in a row, in case the data has changed.  Each test that
+//finds it still doesn't compress doubles the wait, up to the maximum.
+const size_t RETEST_MINIMUM_STORED = 2;
+const size_t RETEST_MAXIMUM_STORED = 16;
+
+//Rough speeds of the levels compared to level 1, used until a level has been
+//measured.  Storing is limited by the disks rather than the processor.
+const int DEFLATE_LEVELS[] = {0, 1, 3, 6, 9};
+const double DEFLATE_RELATIVE_SPEEDS[] = {8.0, 1.0, 0.8, 0.45, 0.15};
+
+const int SEVEN_ZIP_LEVELS[] = {0, 1, 3, 5, 7, 9};
+const double SEVEN_ZIP_RELATIVE_SPEEDS[] = {8.0, 1.0, 0.6, 0.25, 0.15, 0.1};
+
+}
+
+////////////////
+//   PLANNER
+////////////////
+
+CompressionPlanner::CompressionPlanner(bool sevenZip)
+	: deadlineSeconds(0), targetBytesPerSecond(0), startTime(std::chrono::steady_clock::now()) {
+	const int *levelList = sevenZip ? SEVEN_ZIP_LEVELS : DEFLATE_LEVELS;
+	const double *speedList = sevenZip ? SEVEN_ZIP_RELATIVE_SPEEDS : DEFLATE_RELATIVE_SPEEDS;
+	size_t count = sevenZip ? sizeof(SEVEN_ZIP_LEVELS) / sizeof(int) : sizeof(DEFLATE_LEVELS) / sizeof(int);
+
+	for (size_t i = 0; i < count; i ++) {
+		LevelStats stats;
+		stats.level = levelList[i];
+		stats.relativeSpeed = speedList[i];
+		stats.inputBytes = 0;
+		stats.outputBytes = 0;
+		stats.seconds = 0;
+		levels.push_back(stats);
+	}
+}
+
+void CompressionPlanner::setDeadline(double seconds) {
+	deadlineSeconds = seconds;
+	targetBytesPerSecond = 0;
+	startTime = std::chrono::steady_clock::now();
+}
+
+void CompressionPlanner::setThroughputTarget(double bytesPerSecond) {
+	targetBytesPerSecond = bytesPerSecond;
+	deadlineSeconds = 0;
+}
+
+CompressionChoice CompressionPlanner::choose(unsigned long long remainingBytes) {
+	CompressionChoice choice;
+	choice.measured = false;
+	choice.estimatedBytesPerSecond = 0;
+
+	if (targetBytesPerSecond > 0) {
+		choice.requiredBytesPerSecond = targetBytesPerSecond;
+	} else {
+		double secondsLeft = deadlineSeconds
+			- std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		//Past the deadline, the fastest level is the best that can be done
+		choice.requiredBytesPerSecond = secondsLeft > 0 ? (double)remainingBytes / secondsLeft : 1e300;
+	}
+
+	//Nothing measured yet: the fastest level that compresses shows how fast the processor is
+	if (history.empty()) {
+		choice.level = levels[1].level;
+		choice.reason = "first archive, measuring";
+		return choice;
+	}
+
+	//Compressing data that doesn't get smaller only costs time.  The latest
+	//compressed archive says whether the data compresses; the ones before it
+	//may have held different data.
+	size_t storedSince = 0;
+	size_t incompressibleRun = 0;
+	for (size_t i = history.size(); i > 0; i --) {
+		const CompressionMeasurement &measurement = history[i - 1];
+		if (measurement.choice.level == levels[0].level) {
+			if (incompressibleRun == 0) {
+				storedSince ++;
+			}
+			continue;
+		}
+		if (measurement.inputBytes <= 0
+			|| (double)measurement.outputBytes / (double)measurement.inputBytes <= INCOMPRESSIBLE_RATIO) {
+			break;
+		}
+		incompressibleRun ++;
+	}
+	if (incompressibleRun > 0) {
+		size_t retestAfter = RETEST_MINIMUM_STORED;
+		for (size_t i = 1; i < incompressibleRun && retestAfter < RETEST_MAXIMUM_STORED; i ++) {
+			retestAfter *= 2;
+		}
+		if (storedSince >= retestAfter) {
+			choice.level = levels[1].level;
+			choice.estimatedBytesPerSecond = estimatedSpeed(1, choice.measured);
+			choice.reason = "checking whether the data compresses now";
+			return choice;
+		}
+
+		choice.level = levels[0].level;
+		choice.estimatedBytesPerSecond = estimatedSpeed(0, choice.measured);
+		choice.reason = "the data barely compresses";
+		return choice;
+	}
+
+	//The highest level that keeps up, with some room to spare
+	for (size_t i = levels.size(); i > 0; i --) {
+		bool measured = false;
+		double speed = estimatedSpeed(i - 1, measured);
+		if (speed >= choice.requiredBytesPerSecond * SPEED_MARGIN) {
+			choice.level = levels[i - 1].level;
+			choice.estimatedBytesPerSecond = speed;
+			choice.measured = measured;
+			choice.reason = i == levels.size() ? "highest level is fast enough" : "highest level expected to keep up";
+			return choice;
+		}
+	}
+
+	choice.level = levels[0].level;
+	choice.estimatedBytesPerSecond = estimatedSpeed(0, choice.measured);
+	choice.reason = "no level is expected to keep up";
+	return choice;
+}
+
+void CompressionPlanner::record(const CompressionMeasurement &measurement) {
+	for (size_t i = 0; i < levels.size(); i ++) {
+		if (levels[i].level == measurement.choice.level) {
+			levels[i].inputBytes += (double)measurement.inputBytes;
+			levels[i].outputBytes += (double)measurement.outputBytes;
+			levels[i].seconds += measurement.seconds;
+		}
+	}
+	history.push_back(measurement);
+}
+
+const std::vector<CompressionMeasurement> &CompressionPlanner::measurements() const {
+	return history;
+}
+
+double CompressionPlanner::estimatedSpeed(size_t levelIndex, bool &measured) const {
+	const LevelStats &stats = levels[levelIndex];
+	measured = stats.seconds > 0 && stats.inputBytes > 0;
+	if (measured) {
+		return stats.inputBytes / stats.seconds;
+	}
+
+	//Scale the nearest level that has been measured
+	for (size_t distance = 1; distance < levels.size(); distance ++) {
+		for (int direction = -1; direction <= 1; direction += 2) {
+			long long index = (long long)levelIndex + direction * (long long)distance;
+			if (index < 0 || index >= (long long)levels.size()) {
+				continue;
+			}
+			const LevelStats &nearest = levels[(size_t)index];
+			if (nearest.seconds > 0 && nearest.inputBytes > 0) {
+				return nearest.inputBytes / nearest.seconds * stats.relativeSpeed / nearest.relativeSpeed;
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,75 @@
+// Archiver and Splitter
+// compressionplanner.h
+// Picks a compression level for each archive so a run finishes on time
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+//The level picked for one archive, and why
+struct CompressionChoice {
+	int level;
+	//Speed the rest of the run needs (bytes of input per second)
+	double requiredBytesPerSecond;
+	//Speed expected at this level, from the archives made so far
+	double estimatedBytesPerSecond;
+	//False if the estimate was scaled from another level's measurements
+	bool measured;
+	//Short explanation for the summary
+	std::string reason;
+};
+
+//How one finished archive went
+struct CompressionMeasurement {
+	int archiveId;
+	std::string archiveName;
+	CompressionChoice choice;
+	long long inputBytes;
+	long long outputBytes;
+	double seconds;
+};
+
+//Measures the speed and compression ratio of each level on the archives as
+//they are made, and picks the highest level that is still expected to meet
+//the target.  Levels that haven't been tried are estimated from the nearest
+//level that has, scaled by how fast the levels usually are compared to each
+//other.  The first archive is made at the fastest level that compresses.
+//If the latest compressed archive barely got smaller, files are stored
+//instead, with an archive compressed again now and then in case the data
+//has changed.
+class CompressionPlanner {
+public:
+	//Levels of the built-in deflate compressor, or 7-Zip's -mx levels
+	explicit CompressionPlanner(bool sevenZip);
+
+	//Finish everything within this many seconds from now
+	void setDeadline(double seconds);
+	//Or keep up at least this speed
+	void setThroughputTarget(double bytesPerSecond);
+
+	//remainingBytes includes the archive the level is for
+	CompressionChoice choose(unsigned long long remainingBytes);
+
+	void record(const CompressionMeasurement &measurement);
+	const std::vector<CompressionMeasurement> &measurements() const;
+
+private:
+	struct LevelStats {
+		int level;
+		//Speed compared to the other levels, before anything is measured
+		double relativeSpeed;
+		double inputBytes;
+		double outputBytes;
+		double seconds;
+	};
+
+	double estimatedSpeed(size_t levelIndex, bool &measured) const;
+
+	std::vector<LevelStats> levels;
+	double deadlineSeconds;
+	double targetBytesPerSecond;
+	std::chrono::steady_clock::time_point startTime;
+	std::vector<CompressionMeasurement> history;
+};
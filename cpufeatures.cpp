@@ -0,0 +1,72 @@
+// Archiver and Splitter
+// cpufeatures.cpp
+
+#include "cpufeatures.h"
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+//What the processor supports, read once with CPUID
+struct CpuFeatures {
+	bool aesNi;
+	bool shaNi;
+
+	CpuFeatures() : aesNi(false), shaNi(false) {
+#ifdef CPU_X86
+		unsigned int leaf1[4] = {0, 0, 0, 0};
+		unsigned int leaf7[4] = {0, 0, 0, 0};
+		unsigned int maxLeaf = 0;
+
+#ifdef _MSC_VER
+		int regs[4];
+		__cpuid(regs, 0);
+		maxLeaf = (unsigned int)regs[0];
+		__cpuid(regs, 1);
+		for (int i = 0; i < 4; i ++) {
+			leaf1[i] = (unsigned int)regs[i];
+		}
+		if (maxLeaf >= 7) {
+			__cpuidex(regs, 7, 0);
+			for (int i = 0; i < 4; i ++) {
+				leaf7[i] = (unsigned int)regs[i];
+			}
+		}
+#else
+		maxLeaf = __get_cpuid_max(0, 0);
+		__get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+		if (maxLeaf >= 7) {
+			__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+		}
+#endif
+
+		//ECX bit 25 = AES, ECX bit 19 = SSE4.1, ECX bit 9 = SSSE3
+		bool ssse3 = (leaf1[2] & (1u << 9)) != 0;
+		bool sse41 = (leaf1[2] & (1u << 19)) != 0;
+		aesNi = (leaf1[2] & (1u << 25)) != 0;
+		//Leaf 7 EBX bit 29 = SHA
+		shaNi = ssse3 && sse41 && (leaf7[1] & (1u << 29)) != 0;
+#endif
+	}
+};
+
+const CpuFeatures &cpuFeatures() {
+	static const CpuFeatures features;
+	return features;
+}
+
+}
+
+bool cpuHasAesNi() {
+	return cpuFeatures().aesNi;
+}
+
+bool cpuHasShaNi() {
+	return cpuFeatures().shaNi;
+}
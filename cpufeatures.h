@@ -0,0 +1,23 @@
+// Archiver and Splitter
+// cpufeatures.h
+// Run-time checks for optional instruction set extensions
+
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+//GCC and Clang only allow intrinsics in functions compiled for the instruction set;
+//MSVC allows them everywhere
+#if defined(__GNUC__)
+#define CPU_TARGET(features) __attribute__((target(features)))
+#else
+#define CPU_TARGET(features)
+#endif
+
+//AES-NI (AESENC and friends)
+bool cpuHasAesNi();
+
+//SHA extensions (SHA1RNDS4 and friends)
+bool cpuHasShaNi();
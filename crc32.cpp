@@ -0,0 +1,131 @@
+// Archiver and Splitter
+// crc32.cpp
+
+#include "crc32.h"
+
+////////////////
+//   TABLES
+////////////////
+
+namespace {
+
+//Slicing-by-8 tables, built once on first use
+struct Crc32Tables {
+	uint32_t table[8][256];
+
+	Crc32Tables() {
+		for (uint32_t i = 0; i < 256; i ++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k ++) {
+				c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+			}
+			table[0][i] = c;
+		}
+		for (uint32_t i = 0; i < 256; i ++) {
+			for (int t = 1; t < 8; t ++) {
+				table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+			}
+		}
+	}
+};
+
+const Crc32Tables &crc32Tables() {
+	static const Crc32Tables tables;
+	return tables;
+}
+
+//Multiplies a 32x32 GF(2) matrix by a vector
+uint32_t gf2MatrixTimes(const uint32_t *matrix, uint32_t vec) {
+	uint32_t sum = 0;
+	while (vec) {
+		if (vec & 1) {
+			sum ^= *matrix;
+		}
+		vec >>= 1;
+		matrix ++;
+	}
+	return sum;
+}
+
+void gf2MatrixSquare(uint32_t *square, const uint32_t *matrix) {
+	for (int n = 0; n < 32; n ++) {
+		square[n] = gf2MatrixTimes(matrix, matrix[n]);
+	}
+}
+
+}
+
+////////////////
+//   FUNCTIONS
+////////////////
+
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length) {
+	const Crc32Tables &t = crc32Tables();
+	const unsigned char *p = (const unsigned char *)data;
+
+	crc = ~crc;
+
+	//Eight bytes at a time
+	while (length >= 8) {
+		uint32_t one = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+		uint32_t two = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+		crc = t.table[7][one & 0xFF] ^ t.table[6][(one >> 8) & 0xFF]
+			^ t.table[5][(one >> 16) & 0xFF] ^ t.table[4][one >> 24]
+			^ t.table[3][two & 0xFF] ^ t.table[2][(two >> 8) & 0xFF]
+			^ t.table[1][(two >> 16) & 0xFF] ^ t.table[0][two >> 24];
+		p += 8;
+		length -= 8;
+	}
+
+	//Whatever is left
+	while (length > 0) {
+		crc = t.table[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+		p ++;
+		length --;
+	}
+
+	return ~crc;
+}
+
+//Same method as zlib's crc32_combine: apply lengthB zero bytes to crcA
+//through repeated squaring of the "one zero bit" operator
+uint32_t crc32Combine(uint32_t crcA, uint32_t crcB, unsigned long long lengthB) {
+	if (lengthB == 0) {
+		return crcA;
+	}
+
+	uint32_t even[32];
+	uint32_t odd[32];
+
+	//Operator for one zero bit
+	odd[0] = 0xEDB88320u;
+	uint32_t row = 1;
+	for (int n = 1; n < 32; n ++) {
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	//Two zero bits, then four
+	gf2MatrixSquare(even, odd);
+	gf2MatrixSquare(odd, even);
+
+	//Apply lengthB zero bytes (the first square gives one zero byte)
+	do {
+		gf2MatrixSquare(even, odd);
+		if (lengthB & 1) {
+			crcA = gf2MatrixTimes(even, crcA);
+		}
+		lengthB >>= 1;
+		if (lengthB == 0) {
+			break;
+		}
+
+		gf2MatrixSquare(odd, even);
+		if (lengthB & 1) {
+			crcA = gf2MatrixTimes(odd, crcA);
+		}
+		lengthB >>= 1;
+	} while (lengthB != 0);
+
+	return crcA ^ crcB;
+}
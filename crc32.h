@@ -0,0 +1,15 @@
+// Archiver and Splitter
+// crc32.h
+// CRC-32 (the polynomial used by ZIP and deflate)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//Continues a CRC-32 over more data.  Start with crc = 0.
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length);
+
+//Returns the CRC-32 of A followed by B, given crcA, crcB and the length of B.
+//This lets blocks be checksummed on separate threads and joined in order.
+uint32_t crc32Combine(uint32_t crcA, uint32_t crcB, unsigned long long lengthB);
@@ -0,0 +1,859 @@
+// Archiver and Splitter
+// deflate.cpp
+
+#include "deflate.h"
+
+#include <algorithm>
+#include <cstring>
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+const int MIN_MATCH = 3;
+const int MAX_MATCH = 258;
+const int HASH_BITS = 15;
+const int HASH_SIZE = 1 << HASH_BITS;
+
+//Matches of the minimum length that reach back further than this
+//usually cost more bits than the literals they replace
+const unsigned int TOO_FAR = 4096;
+
+//Number of symbols collected before a block is written with its own Huffman codes
+const size_t SYMBOLS_PER_BLOCK = 16384;
+
+const size_t STORED_BLOCK_MAX = 65535;
+
+const int LITLEN_CODES = 286;
+const int DIST_CODES = 30;
+const int CODELEN_CODES = 19;
+const int END_OF_BLOCK = 256;
+
+const int lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const int lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const int distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const int distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+//Order in which the code length code lengths are sent
+const int codeLengthOrder[CODELEN_CODES] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+//Same tuning as zlib's configuration table.
+//For the greedy levels, lazyLength is the longest match whose positions
+//are still added to the hash chains.
+struct LevelConfig {
+	int goodLength;
+	int lazyLength;
+	int niceLength;
+	int maxChain;
+	bool greedy;
+};
+
+const LevelConfig levelConfigs[10] = {
+	{0, 0, 0, 0, true},
+	{4, 4, 8, 4, true},
+	{4, 5, 16, 8, true},
+	{4, 6, 32, 32, true},
+	{4, 4, 16, 16, false},
+	{8, 16, 32, 32, false},
+	{8, 16, 128, 128, false},
+	{8, 32, 128, 256, false},
+	{32, 128, 258, 1024, false},
+	{32, 258, 258, 4096, false}
+};
+
+////////////////
+//   TABLES
+////////////////
+
+struct DeflateTables {
+	unsigned char lengthCode[MAX_MATCH + 1];
+	unsigned char distCodeSmall[256];
+	unsigned char distCodeLarge[256];
+
+	unsigned char fixedLitLengths[288];
+	unsigned short fixedLitCodes[288];
+	unsigned char fixedDistLengths[DIST_CODES];
+	unsigned short fixedDistCodes[DIST_CODES];
+
+	DeflateTables();
+};
+
+const DeflateTables &deflateTables() {
+	static const DeflateTables tables;
+	return tables;
+}
+
+//Reverses the lowest 'length' bits (deflate sends Huffman codes starting with the top bit)
+unsigned short reverseBits(unsigned int code, int length) {
+	unsigned int result = 0;
+	for (int i = 0; i < length; i ++) {
+		result = (result << 1) | (code & 1);
+		code >>= 1;
+	}
+	return (unsigned short)result;
+}
+
+//Assigns canonical codes to a set of code lengths
+void huffmanBuildCodes(const unsigned char *lengths, int symbolCount, unsigned short *codes) {
+	unsigned int lengthCount[16] = {0};
+	unsigned int nextCode[16] = {0};
+
+	for (int i = 0; i < symbolCount; i ++) {
+		lengthCount[lengths[i]] ++;
+	}
+	lengthCount[0] = 0;
+
+	unsigned int code = 0;
+	for (int bits = 1; bits < 16; bits ++) {
+		code = (code + lengthCount[bits - 1]) << 1;
+		nextCode[bits] = code;
+	}
+
+	for (int i = 0; i < symbolCount; i ++) {
+		if (lengths[i] != 0) {
+			codes[i] = reverseBits(nextCode[lengths[i]] ++, lengths[i]);
+		} else {
+			codes[i] = 0;
+		}
+	}
+}
+
+DeflateTables::DeflateTables() {
+	for (int code = 0; code < 29; code ++) {
+		for (int extra = 0; extra < (1 << lengthExtra[code]); extra ++) {
+			int length = lengthBase[code] + extra;
+			if (length <= MAX_MATCH) {
+				lengthCode[length] = (unsigned char)code;
+			}
+		}
+	}
+	//258 has its own code rather than being the top of code 27's range
+	lengthCode[MAX_MATCH] = 28;
+
+	for (int code = 0; code < DIST_CODES; code ++) {
+		for (int extra = 0; extra < (1 << distExtra[code]); extra ++) {
+			int dist = distBase[code] + extra - 1;
+			if (dist < 256) {
+				distCodeSmall[dist] = (unsigned char)code;
+			} else {
+				distCodeLarge[dist >> 7] = (unsigned char)code;
+			}
+		}
+	}
+
+	for (int i = 0; i < 288; i ++) {
+		if (i < 144) {
+			fixedLitLengths[i] = 8;
+		} else if (i < 256) {
+			fixedLitLengths[i] = 9;
+		} else if (i < 280) {
+			fixedLitLengths[i] = 7;
+		} else {
+			fixedLitLengths[i] = 8;
+		}
+	}
+	huffmanBuildCodes(fixedLitLengths, 288, fixedLitCodes);
+
+	for (int i = 0; i < DIST_CODES; i ++) {
+		fixedDistLengths[i] = 5;
+	}
+	huffmanBuildCodes(fixedDistLengths, DIST_CODES, fixedDistCodes);
+}
+
+int distanceCode(unsigned int dist) {
+	const DeflateTables &t = deflateTables();
+	dist --;
+	return dist < 256 ? t.distCodeSmall[dist] : t.distCodeLarge[dist >> 7];
+}
+
+////////////////
+//   HUFFMAN
+////////////////
+
+struct SymbolFrequency {
+	unsigned int key;
+	unsigned short symbol;
+};
+
+bool compareSymbolFrequency(const SymbolFrequency &a, const SymbolFrequency &b) {
+	return a.key < b.key;
+}
+
+//Moffat and Katajainen's in-place minimum redundancy code calculation.
+//A must be sorted by frequency (lowest first); each key becomes a code length.
+void calculateMinimumRedundancy(SymbolFrequency *a, int n) {
+	if (n == 0) {
+		return;
+	} else if (n == 1) {
+		a[0].key = 1;
+		return;
+	}
+
+	a[0].key += a[1].key;
+	int root = 0;
+	int leaf = 2;
+	for (int next = 1; next < n - 1; next ++) {
+		if (leaf >= n || a[root].key < a[leaf].key) {
+			a[next].key = a[root].key;
+			a[root ++].key = next;
+		} else {
+			a[next].key = a[leaf ++].key;
+		}
+		if (leaf >= n || (root < next && a[root].key < a[leaf].key)) {
+			a[next].key = a[next].key + a[root].key;
+			a[root ++].key = next;
+		} else {
+			a[next].key = a[next].key + a[leaf ++].key;
+		}
+	}
+
+	a[n - 2].key = 0;
+	for (int next = n - 3; next >= 0; next --) {
+		a[next].key = a[a[next].key].key + 1;
+	}
+
+	int available = 1;
+	int used = 0;
+	int depth = 0;
+	root = n - 2;
+	int next = n - 1;
+	while (available > 0) {
+		while (root >= 0 && (int)a[root].key == depth) {
+			used ++;
+			root --;
+		}
+		while (available > used) {
+			a[next --].key = depth;
+			available --;
+		}
+		available = 2 * used;
+		depth ++;
+		used = 0;
+	}
+}
+
+//Builds code lengths no longer than maxLength for the given frequencies
+void huffmanBuildLengths(const unsigned int *frequencies, int symbolCount, int maxLength,
+						 unsigned char *lengths) {
+	SymbolFrequency sorted[LITLEN_CODES + 2];
+	int used = 0;
+
+	for (int i = 0; i < symbolCount; i ++) {
+		lengths[i] = 0;
+		if (frequencies[i] != 0) {
+			sorted[used].key = frequencies[i];
+			sorted[used].symbol = (unsigned short)i;
+			used ++;
+		}
+	}
+
+	if (used == 0) {
+		return;
+	}
+
+	std::stable_sort(sorted, sorted + used, compareSymbolFrequency);
+	calculateMinimumRedundancy(sorted, used);
+
+	//Count how many codes there are of each length
+	int lengthCount[32] = {0};
+	for (int i = 0; i < used; i ++) {
+		lengthCount[sorted[i].key < 31 ? sorted[i].key : 31] ++;
+	}
+
+	//Fold anything too long into the longest allowed length, then
+	//lengthen shorter codes until the Kraft sum is exactly one again
+	if (used > 1) {
+		for (int i = maxLength + 1; i < 32; i ++) {
+			lengthCount[maxLength] += lengthCount[i];
+			lengthCount[i] = 0;
+		}
+
+		unsigned int total = 0;
+		for (int i = maxLength; i > 0; i --) {
+			total += ((unsigned int)lengthCount[i]) << (maxLength - i);
+		}
+		while (total != (1u << maxLength)) {
+			lengthCount[maxLength] --;
+			for (int i = maxLength - 1; i > 0; i --) {
+				if (lengthCount[i] != 0) {
+					lengthCount[i] --;
+					lengthCount[i + 1] += 2;
+					break;
+				}
+			}
+			total --;
+		}
+	}
+
+	//The least frequent symbols get the longest codes
+	int position = 0;
+	for (int length = maxLength; length > 0; length --) {
+		for (int count = lengthCount[length]; count > 0; count --) {
+			lengths[sorted[position ++].symbol] = (unsigned char)length;
+		}
+	}
+}
+
+////////////////
+//   BIT OUTPUT
+////////////////
+
+class BitWriter {
+public:
+	BitWriter(std::vector<unsigned char> &output) : output(output), bitBuffer(0), bitCount(0) {}
+
+	//Appends the lowest 'count' bits of 'bits', least significant first
+	void put(unsigned int bits, int count) {
+		bitBuffer |= (unsigned long long)bits << bitCount;
+		bitCount += count;
+		while (bitCount >= 8) {
+			output.push_back((unsigned char)bitBuffer);
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
+
+	void alignToByte() {
+		if (bitCount > 0) {
+			output.push_back((unsigned char)bitBuffer);
+		}
+		bitBuffer = 0;
+		bitCount = 0;
+	}
+
+	//Only valid after alignToByte
+	void putBytes(const unsigned char *data, size_t length) {
+		output.insert(output.end(), data, data + length);
+	}
+
+private:
+	std::vector<unsigned char> &output;
+	unsigned long long bitBuffer;
+	int bitCount;
+};
+
+////////////////
+//   BLOCKS
+////////////////
+
+//A literal (distance == 0) or a back reference
+struct LzSymbol {
+	unsigned short literalOrLength;
+	unsigned short distance;
+};
+
+//Writes raw bytes as stored blocks
+void writeStoredBlocks(BitWriter &bits, const unsigned char *data, size_t length, bool finalBlock) {
+	do {
+		size_t chunk = length < STORED_BLOCK_MAX ? length : STORED_BLOCK_MAX;
+		bool last = chunk == length;
+
+		bits.put(finalBlock && last ? 1 : 0, 1);
+		bits.put(0, 2);
+		bits.alignToByte();
+
+		unsigned char header[4];
+		header[0] = (unsigned char)(chunk & 0xFF);
+		header[1] = (unsigned char)(chunk >> 8);
+		header[2] = (unsigned char)(~chunk & 0xFF);
+		header[3] = (unsigned char)((~chunk >> 8) & 0xFF);
+		bits.putBytes(header, 4);
+		bits.putBytes(data, chunk);
+
+		data += chunk;
+		length -= chunk;
+	} while (length > 0);
+}
+
+void writeSymbols(BitWriter &bits, const std::vector<LzSymbol> &symbols,
+				  const unsigned char *litLengths, const unsigned short *litCodes,
+				  const unsigned char *distLengths, const unsigned short *distCodes) {
+	const DeflateTables &t = deflateTables();
+
+	for (size_t i = 0; i < symbols.size(); i ++) {
+		const LzSymbol &s = symbols[i];
+		if (s.distance == 0) {
+			bits.put(litCodes[s.literalOrLength], litLengths[s.literalOrLength]);
+		} else {
+			int lcode = t.lengthCode[s.literalOrLength];
+			bits.put(litCodes[257 + lcode], litLengths[257 + lcode]);
+			if (lengthExtra[lcode] != 0) {
+				bits.put(s.literalOrLength - lengthBase[lcode], lengthExtra[lcode]);
+			}
+			int dcode = distanceCode(s.distance);
+			bits.put(distCodes[dcode], distLengths[dcode]);
+			if (distExtra[dcode] != 0) {
+				bits.put(s.distance - distBase[dcode], distExtra[dcode]);
+			}
+		}
+	}
+	bits.put(litCodes[END_OF_BLOCK], litLengths[END_OF_BLOCK]);
+}
+
+//Writes one block using whichever of dynamic Huffman, fixed Huffman
+//or stored is smallest.  raw is the data the symbols cover.
+void writeBlock(BitWriter &bits, const std::vector<LzSymbol> &symbols,
+				const unsigned char *raw, size_t rawLength, bool finalBlock) {
+	const DeflateTables &t = deflateTables();
+
+	unsigned int litFreq[LITLEN_CODES] = {0};
+	unsigned int distFreq[DIST_CODES] = {0};
+
+	for (size_t i = 0; i < symbols.size(); i ++) {
+		const LzSymbol &s = symbols[i];
+		if (s.distance == 0) {
+			litFreq[s.literalOrLength] ++;
+		} else {
+			litFreq[257 + t.lengthCode[s.literalOrLength]] ++;
+			distFreq[distanceCode(s.distance)] ++;
+		}
+	}
+	litFreq[END_OF_BLOCK] = 1;
+
+	//Extra bits cost the same in both Huffman modes
+	unsigned long long extraBits = 0;
+	for (int i = 0; i < 29; i ++) {
+		extraBits += (unsigned long long)litFreq[257 + i] * lengthExtra[i];
+	}
+	for (int i = 0; i < DIST_CODES; i ++) {
+		extraBits += (unsigned long long)distFreq[i] * distExtra[i];
+	}
+
+	//Keep both code sets complete (at least two codes each) so any decoder accepts them
+	unsigned int litFreqForCodes[LITLEN_CODES];
+	unsigned int distFreqForCodes[DIST_CODES];
+	memcpy(litFreqForCodes, litFreq, sizeof(litFreq));
+	memcpy(distFreqForCodes, distFreq, sizeof(distFreq));
+	int usedLit = 0;
+	int usedDist = 0;
+	for (int i = 0; i < LITLEN_CODES; i ++) {
+		usedLit += litFreq[i] != 0;
+	}
+	for (int i = 0; i < DIST_CODES; i ++) {
+		usedDist += distFreq[i] != 0;
+	}
+	if (usedLit < 2) {
+		litFreqForCodes[litFreq[0] == 0 ? 0 : 1] = 1;
+	}
+	if (usedDist < 2) {
+		distFreqForCodes[distFreq[0] == 0 ? 0 : 1] = 1;
+	}
+
+	unsigned char litLengths[LITLEN_CODES];
+	unsigned char distLengths[DIST_CODES];
+	huffmanBuildLengths(litFreqForCodes, LITLEN_CODES, 15, litLengths);
+	huffmanBuildLengths(distFreqForCodes, DIST_CODES, 15, distLengths);
+
+	int litCount = LITLEN_CODES;
+	while (litCount > 257 && litLengths[litCount - 1] == 0) {
+		litCount --;
+	}
+	int distCount = DIST_CODES;
+	while (distCount > 1 && distLengths[distCount - 1] == 0) {
+		distCount --;
+	}
+
+	//Run-length encode the code lengths
+	unsigned char allLengths[LITLEN_CODES + DIST_CODES];
+	memcpy(allLengths, litLengths, litCount);
+	memcpy(allLengths + litCount, distLengths, distCount);
+	int allCount = litCount + distCount;
+
+	unsigned char rleSymbols[LITLEN_CODES + DIST_CODES];
+	unsigned char rleExtra[LITLEN_CODES + DIST_CODES];
+	int rleCount = 0;
+	unsigned int codeLengthFreq[CODELEN_CODES] = {0};
+
+	for (int i = 0; i < allCount;) {
+		unsigned char current = allLengths[i];
+		int run = 1;
+		while (i + run < allCount && allLengths[i + run] == current) {
+			run ++;
+		}
+		i += run;
+
+		if (current == 0) {
+			while (run >= 11) {
+				int r = run < 138 ? run : 138;
+				rleSymbols[rleCount] = 18;
+				rleExtra[rleCount ++] = (unsigned char)(r - 11);
+				run -= r;
+			}
+			if (run >= 3) {
+				rleSymbols[rleCount] = 17;
+				rleExtra[rleCount ++] = (unsigned char)(run - 3);
+				run = 0;
+			}
+		} else {
+			rleSymbols[rleCount] = current;
+			rleExtra[rleCount ++] = 0;
+			run --;
+			while (run >= 3) {
+				int r = run < 6 ? run : 6;
+				rleSymbols[rleCount] = 16;
+				rleExtra[rleCount ++] = (unsigned char)(r - 3);
+				run -= r;
+			}
+		}
+		while (run > 0) {
+			rleSymbols[rleCount] = current;
+			rleExtra[rleCount ++] = 0;
+			run --;
+		}
+	}
+
+	int usedCodeLength = 0;
+	for (int i = 0; i < rleCount; i ++) {
+		if (codeLengthFreq[rleSymbols[i]] ++ == 0) {
+			usedCodeLength ++;
+		}
+	}
+	if (usedCodeLength < 2) {
+		codeLengthFreq[rleSymbols[0] == 0 ? 1 : 0] ++;
+	}
+
+	unsigned char codeLengthLengths[CODELEN_CODES];
+	unsigned short codeLengthCodes[CODELEN_CODES];
+	huffmanBuildLengths(codeLengthFreq, CODELEN_CODES, 7, codeLengthLengths);
+	huffmanBuildCodes(codeLengthLengths, CODELEN_CODES, codeLengthCodes);
+
+	int codeLengthCount = CODELEN_CODES;
+	while (codeLengthCount > 4 && codeLengthLengths[codeLengthOrder[codeLengthCount - 1]] == 0) {
+		codeLengthCount --;
+	}
+
+	//Compare the sizes of the three block types
+	unsigned long long dynamicBits = 3 + 5 + 5 + 4 + 3 * (unsigned long long)codeLengthCount + extraBits;
+	for (int i = 0; i < rleCount; i ++) {
+		dynamicBits += codeLengthLengths[rleSymbols[i]];
+		if (rleSymbols[i] == 16) {
+			dynamicBits += 2;
+		} else if (rleSymbols[i] == 17) {
+			dynamicBits += 3;
+		} else if (rleSymbols[i] == 18) {
+			dynamicBits += 7;
+		}
+	}
+	unsigned long long fixedBits = 3 + extraBits;
+	for (int i = 0; i < LITLEN_CODES; i ++) {
+		dynamicBits += (unsigned long long)litFreq[i] * litLengths[i];
+		fixedBits += (unsigned long long)litFreq[i] * t.fixedLitLengths[i];
+	}
+	for (int i = 0; i < DIST_CODES; i ++) {
+		dynamicBits += (unsigned long long)distFreq[i] * distLengths[i];
+		fixedBits += (unsigned long long)distFreq[i] * t.fixedDistLengths[i];
+	}
+	unsigned long long storedBits = ((unsigned long long)rawLength
+		+ 5 * (rawLength / STORED_BLOCK_MAX + 1)) * 8 + 7;
+
+	if (storedBits <= dynamicBits && storedBits <= fixedBits) {
+		writeStoredBlocks(bits, raw, rawLength, finalBlock);
+	} else if (fixedBits <= dynamicBits) {
+		bits.put(finalBlock ? 1 : 0, 1);
+		bits.put(1, 2);
+		writeSymbols(bits, symbols, t.fixedLitLengths, t.fixedLitCodes,
+			t.fixedDistLengths, t.fixedDistCodes);
+	} else {
+		unsigned short litCodes[LITLEN_CODES];
+		unsigned short distCodes[DIST_CODES];
+		huffmanBuildCodes(litLengths, LITLEN_CODES, litCodes);
+		huffmanBuildCodes(distLengths, DIST_CODES, distCodes);
+
+		bits.put(finalBlock ? 1 : 0, 1);
+		bits.put(2, 2);
+		bits.put(litCount - 257, 5);
+		bits.put(distCount - 1, 5);
+		bits.put(codeLengthCount - 4, 4);
+		for (int i = 0; i < codeLengthCount; i ++) {
+			bits.put(codeLengthLengths[codeLengthOrder[i]], 3);
+		}
+		for (int i = 0; i < rleCount; i ++) {
+			bits.put(codeLengthCodes[rleSymbols[i]], codeLengthLengths[rleSymbols[i]]);
+			if (rleSymbols[i] == 16) {
+				bits.put(rleExtra[i], 2);
+			} else if (rleSymbols[i] == 17) {
+				bits.put(rleExtra[i], 3);
+			} else if (rleSymbols[i] == 18) {
+				bits.put(rleExtra[i], 7);
+			}
+		}
+		writeSymbols(bits, symbols, litLengths, litCodes, distLengths, distCodes);
+	}
+}
+
+////////////////
+//   MATCHING
+////////////////
+
+class LzMatcher {
+public:
+	LzMatcher(const unsigned char *window, size_t windowSize, const LevelConfig &config)
+		: window(window), windowSize(windowSize), config(config),
+		head(HASH_SIZE, -1), previous(windowSize, -1) {}
+
+	//Adds a position to the hash chains and returns the previous head of its chain
+	int insert(size_t position) {
+		if (position + MIN_MATCH > windowSize) {
+			return -1;
+		}
+		unsigned int h = hash(position);
+		int oldHead = head[h];
+		previous[position] = oldHead;
+		head[h] = (int)position;
+		return oldHead;
+	}
+
+	//Finds the longest match for 'position' that beats previousLength.
+	//Returns the length (less than MIN_MATCH if nothing useful was found).
+	int longestMatch(size_t position, int candidate, int previousLength, unsigned int &distance) {
+		int maxLength = (int)(windowSize - position < (size_t)MAX_MATCH ? windowSize - position : MAX_MATCH);
+		if (maxLength < MIN_MATCH || previousLength >= maxLength) {
+			return 0;
+		}
+
+		int chain = config.maxChain;
+		if (previousLength >= config.goodLength) {
+			chain >>= 2;
+		}
+		int niceLength = config.niceLength < maxLength ? config.niceLength : maxLength;
+		int limit = position > DEFLATE_DICTIONARY_SIZE ? (int)(position - DEFLATE_DICTIONARY_SIZE) : 0;
+
+		int bestLength = previousLength;
+		const unsigned char *current = window + position;
+
+		while (candidate >= limit && chain -- > 0) {
+			const unsigned char *match = window + candidate;
+
+			//Check the byte that would extend the best match first
+			if (match[bestLength] == current[bestLength] && match[0] == current[0] && match[1] == current[1]) {
+				int length = 2;
+				while (length < maxLength && match[length] == current[length]) {
+					length ++;
+				}
+				if (length > bestLength) {
+					bestLength = length;
+					distance = (unsigned int)(position - candidate);
+					if (length >= niceLength) {
+						break;
+					}
+				}
+			}
+			candidate = previous[candidate];
+		}
+
+		if (bestLength == MIN_MATCH && distance > TOO_FAR) {
+			return 0;
+		}
+		return bestLength > previousLength ? bestLength : 0;
+	}
+
+private:
+	unsigned int hash(size_t position) const {
+		const unsigned char *p = window + position;
+		unsigned int v = (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16);
+		return (v * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	const unsigned char *window;
+	size_t windowSize;
+	const LevelConfig &config;
+	std::vector<int> head;
+	std::vector<int> previous;
+};
+
+//Collects symbols and writes them out a block at a time
+class BlockBuilder {
+public:
+	BlockBuilder(BitWriter &bits, const unsigned char *window, size_t start)
+		: bits(bits), window(window), blockStart(start), emittedUpTo(start) {
+		symbols.reserve(SYMBOLS_PER_BLOCK);
+	}
+
+	void literal(unsigned char value) {
+		LzSymbol s;
+		s.literalOrLength = value;
+		s.distance = 0;
+		symbols.push_back(s);
+		emittedUpTo ++;
+		flushIfFull();
+	}
+
+	void match(int length, unsigned int distance) {
+		LzSymbol s;
+		s.literalOrLength = (unsigned short)length;
+		s.distance = (unsigned short)distance;
+		symbols.push_back(s);
+		emittedUpTo += length;
+		flushIfFull();
+	}
+
+	//Writes whatever is left.  Returns false if there was nothing to write.
+	bool finish(bool finalBlock) {
+		if (symbols.empty()) {
+			return false;
+		}
+		writeBlock(bits, symbols, window + blockStart, emittedUpTo - blockStart, finalBlock);
+		symbols.clear();
+		blockStart = emittedUpTo;
+		return true;
+	}
+
+private:
+	void flushIfFull() {
+		if (symbols.size() >= SYMBOLS_PER_BLOCK) {
+			finish(false);
+		}
+	}
+
+	BitWriter &bits;
+	const unsigned char *window;
+	size_t blockStart;
+	size_t emittedUpTo;
+	std::vector<LzSymbol> symbols;
+};
+
+void compressGreedy(LzMatcher &matcher, BlockBuilder &blocks, const unsigned char *window,
+					size_t start, size_t end, const LevelConfig &config) {
+	size_t position = start;
+	while (position < end) {
+		int candidate = matcher.insert(position);
+		unsigned int distance = 0;
+		int length = 0;
+		if (candidate >= 0) {
+			length = matcher.longestMatch(position, candidate, MIN_MATCH - 1, distance);
+		}
+
+		if (length >= MIN_MATCH) {
+			blocks.match(length, distance);
+			if (length <= config.lazyLength) {
+				for (size_t p = position + 1; p < position + length; p ++) {
+					matcher.insert(p);
+				}
+			}
+			position += length;
+		} else {
+			blocks.literal(window[position]);
+			position ++;
+		}
+	}
+}
+
+//Lazy matching: a match is only taken if the next position doesn't start a longer one
+void compressLazy(LzMatcher &matcher, BlockBuilder &blocks, const unsigned char *window,
+				  size_t start, size_t end, const LevelConfig &config) {
+	size_t position = start;
+	int previousLength = MIN_MATCH - 1;
+	unsigned int previousDistance = 0;
+	bool matchAvailable = false;
+
+	while (position < end) {
+		int candidate = matcher.insert(position);
+		unsigned int distance = 0;
+		int length = 0;
+		if (candidate >= 0 && previousLength < config.lazyLength) {
+			length = matcher.longestMatch(position, candidate, previousLength, distance);
+		}
+		if (length < MIN_MATCH) {
+			length = MIN_MATCH - 1;
+		}
+
+		if (previousLength >= MIN_MATCH && length <= previousLength) {
+			//The match starting one byte back wins
+			blocks.match(previousLength, previousDistance);
+			size_t matchEnd = position - 1 + previousLength;
+			for (size_t p = position + 1; p < matchEnd; p ++) {
+				matcher.insert(p);
+			}
+			position = matchEnd;
+			matchAvailable = false;
+			previousLength = MIN_MATCH - 1;
+		} else if (matchAvailable) {
+			blocks.literal(window[position - 1]);
+			previousLength = length;
+			previousDistance = distance;
+			position ++;
+		} else {
+			matchAvailable = true;
+			previousLength = length;
+			previousDistance = distance;
+			position ++;
+		}
+	}
+
+	if (matchAvailable) {
+		if (previousLength >= MIN_MATCH) {
+			blocks.match(previousLength, previousDistance);
+		} else {
+			blocks.literal(window[position - 1]);
+		}
+	}
+}
+
+}
+
+////////////////
+//   FUNCTIONS
+////////////////
+
+void deflateCompressBlock(const unsigned char *window, size_t dictionarySize, size_t dataSize,
+						  int level, bool finalBlock, std::vector<unsigned char> &output) {
+	if (level < 0) {
+		level = 0;
+	} else if (level > 9) {
+		level = 9;
+	}
+	if (dictionarySize > DEFLATE_DICTIONARY_SIZE) {
+		window += dictionarySize - DEFLATE_DICTIONARY_SIZE;
+		dictionarySize = DEFLATE_DICTIONARY_SIZE;
+	}
+
+	BitWriter bits(output);
+	const unsigned char *data = window + dictionarySize;
+
+	if (level == 0) {
+		//Stored blocks are already byte aligned, so no sync flush is needed
+		if (dataSize > 0 || finalBlock) {
+			writeStoredBlocks(bits, data, dataSize, finalBlock);
+		}
+		return;
+	}
+
+	const LevelConfig &config = levelConfigs[level];
+	size_t windowSize = dictionarySize + dataSize;
+
+	LzMatcher matcher(window, windowSize, config);
+	for (size_t p = 0; p < dictionarySize; p ++) {
+		matcher.insert(p);
+	}
+
+	BlockBuilder blocks(bits, window, dictionarySize);
+	if (config.greedy) {
+		compressGreedy(matcher, blocks, window, dictionarySize, windowSize, config);
+	} else {
+		compressLazy(matcher, blocks, window, dictionarySize, windowSize, config);
+	}
+
+	if (!blocks.finish(finalBlock) && finalBlock) {
+		//Empty final block with fixed codes (end of block is seven zero bits)
+		bits.put(1, 1);
+		bits.put(1, 2);
+		bits.put(0, 7);
+	}
+
+	if (!finalBlock) {
+		//Sync flush: an empty stored block
+		bits.put(0, 1);
+		bits.put(0, 2);
+		bits.alignToByte();
+		unsigned char marker[4] = {0x00, 0x00, 0xFF, 0xFF};
+		bits.putBytes(marker, 4);
+	} else {
+		bits.alignToByte();
+	}
+}
@@ -0,0 +1,26 @@
+// Archiver and Splitter
+// deflate.h
+// Deflate (RFC 1951) compressor that works on independent blocks
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+//Largest dictionary a block can be primed with (the deflate window)
+#define DEFLATE_DICTIONARY_SIZE 32768
+
+//Compresses one block of a raw deflate stream and appends it to output.
+//
+//window points at dictionarySize bytes of data that came before this block
+//(up to DEFLATE_DICTIONARY_SIZE, may be 0), followed by the dataSize bytes
+//of the block itself.  Matches may reach back into the dictionary, so a block
+//primed with the tail of the previous block compresses almost as well as one
+//long stream would.
+//
+//level: 0 (store) to 9 (best).
+//finalBlock: marks the end of the stream.  Otherwise the block is closed with
+//a sync flush (empty stored block), which leaves the output byte aligned so
+//blocks compressed on different threads can simply be concatenated.
+void deflateCompressBlock(const unsigned char *window, size_t dictionarySize, size_t dataSize,
+						  int level, bool finalBlock, std::vector<unsigned char> &output);
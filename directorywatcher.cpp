@@ -0,0 +1,373 @@
+// Archiver and Splitter
+// directorywatcher.cpp
+
+#include "directorywatcher.h"
+
+#include "filefilter.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <ctime>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//Changes that pile up between two reads have to fit in here.  Directory
+//handles on network shares can't take more than 64 KiB.
+const size_t CHANGE_BUFFER_SIZE = 64 * 1024;
+
+#ifdef _WIN32
+const DWORD CHANGE_FILTER = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+#else
+const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR;
+#endif
+
+}
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+#ifdef _WIN32
+//Fails with a sharing violation while another process has the file open for writing
+bool fileIsClosed(const std::string &path, bool &gone) {
+	gone = false;
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		gone = true;
+		return false;
+	}
+
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		gone = GetLastError() != ERROR_SHARING_VIOLATION;
+		return false;
+	}
+	CloseHandle(handle);
+	return true;
+}
+
+std::string narrowName(const WCHAR *name, int length) {
+	int size = WideCharToMultiByte(CP_ACP, 0, name, length, NULL, 0, NULL, NULL);
+	if (size <= 0) {
+		return "";
+	}
+	std::string narrow(size, '\0');
+	WideCharToMultiByte(CP_ACP, 0, name, length, &narrow[0], size, NULL, NULL);
+	return narrow;
+}
+#else
+//Without a close notification, a file that hasn't been written to for a
+//while is taken to be finished
+bool fileIsClosed(const std::string &path, unsigned int settleSeconds, bool &gone) {
+	gone = false;
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+		gone = true;
+		return false;
+	}
+	return time(NULL) - status.st_mtime >= (time_t)settleSeconds;
+}
+#endif
+
+}
+
+////////////////
+//   WATCHER
+////////////////
+
+DirectoryWatcher::DirectoryWatcher()
+	: filter(NULL), settleSeconds(0), lostChanges(false) {
+#ifdef _WIN32
+	directoryHandle = INVALID_HANDLE_VALUE;
+	eventHandle = NULL;
+	readPending = false;
+#else
+	inotifyDescriptor = -1;
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+	stop();
+}
+
+void DirectoryWatcher::setFilter(FileFilter *filter) {
+	this->filter = filter;
+}
+
+bool DirectoryWatcher::start(const std::string &directory, unsigned int settleSeconds) {
+	stop();
+	rootDirectory = directory;
+	this->settleSeconds = settleSeconds;
+	lostChanges = false;
+
+#ifdef _WIN32
+	directoryHandle = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (directoryHandle == INVALID_HANDLE_VALUE) {
+		error = "Could not watch " + directory;
+		return false;
+	}
+	eventHandle = CreateEventA(NULL, TRUE, FALSE, NULL);
+	changeBuffer.resize(CHANGE_BUFFER_SIZE / sizeof(DWORD));
+	if (eventHandle == NULL || !queueRead()) {
+		error = "Could not watch " + directory;
+		stop();
+		return false;
+	}
+#else
+	inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyDescriptor < 0) {
+		error = "Could not start inotify: " + std::string(strerror(errno));
+		return false;
+	}
+	//The input directory itself may be a link
+	addWatches(directory, filter != NULL ? filter->rootState() : 0, true);
+	if (watchedDirectories.empty()) {
+		error = "Could not watch " + directory;
+		stop();
+		return false;
+	}
+#endif
+	return true;
+}
+
+void DirectoryWatcher::stop() {
+#ifdef _WIN32
+	if (directoryHandle != INVALID_HANDLE_VALUE) {
+		//The read has to be over before its buffer goes away
+		if (readPending) {
+			DWORD bytes = 0;
+			CancelIo(directoryHandle);
+			GetOverlappedResult(directoryHandle, &overlapped, &bytes, TRUE);
+			readPending = false;
+		}
+		CloseHandle(directoryHandle);
+		directoryHandle = INVALID_HANDLE_VALUE;
+	}
+	if (eventHandle != NULL) {
+		CloseHandle(eventHandle);
+		eventHandle = NULL;
+	}
+#else
+	if (inotifyDescriptor >= 0) {
+		close(inotifyDescriptor);
+		inotifyDescriptor = -1;
+	}
+	watchedDirectories.clear();
+#endif
+	candidates.clear();
+}
+
+std::vector<std::string> DirectoryWatcher::waitForFiles(unsigned int timeoutMilliseconds) {
+	std::vector<std::string> finishedFiles;
+
+#ifdef _WIN32
+	if (directoryHandle == INVALID_HANDLE_VALUE) {
+		return finishedFiles;
+	}
+
+	if (WaitForSingleObject(eventHandle, timeoutMilliseconds) == WAIT_OBJECT_0) {
+		DWORD bytes = 0;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		readPending = false;
+		if (!GetOverlappedResult(directoryHandle, &overlapped, &bytes, FALSE) || bytes == 0) {
+			//More changed than fit in the buffer
+			lostChanges = true;
+		} else {
+			const unsigned char *record = (const unsigned char *)&changeBuffer[0];
+			while (true) {
+				const FILE_NOTIFY_INFORMATION *change = (const FILE_NOTIFY_INFORMATION *)record;
+				if (change->Action == FILE_ACTION_ADDED || change->Action == FILE_ACTION_MODIFIED
+					|| change->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+					std::string name = narrowName(change->FileName, (int)(change->FileNameLength / sizeof(WCHAR)));
+					if (name != "") {
+						//Every change starts the quiet period again
+						candidates[rootDirectory + name] = now;
+					}
+				}
+				if (change->NextEntryOffset == 0) {
+					break;
+				}
+				record += change->NextEntryOffset;
+			}
+		}
+		if (!queueRead()) {
+			lostChanges = true;
+		}
+	}
+#else
+	if (inotifyDescriptor < 0) {
+		return finishedFiles;
+	}
+
+	struct pollfd descriptor;
+	descriptor.fd = inotifyDescriptor;
+	descriptor.events = POLLIN;
+	descriptor.revents = 0;
+	if (poll(&descriptor, 1, (int)timeoutMilliseconds) > 0) {
+		alignas(struct inotify_event) char buffer[CHANGE_BUFFER_SIZE];
+		while (true) {
+			ssize_t length = read(inotifyDescriptor, buffer, sizeof(buffer));
+			if (length <= 0) {
+				break;
+			}
+
+			for (ssize_t offset = 0; offset < length; ) {
+				const struct inotify_event *event = (const struct inotify_event *)(buffer + offset);
+				offset += sizeof(struct inotify_event) + event->len;
+
+				if (event->mask & IN_Q_OVERFLOW) {
+					lostChanges = true;
+					continue;
+				}
+				if (event->mask & IN_IGNORED) {
+					watchedDirectories.erase(event->wd);
+					continue;
+				}
+
+				std::map<int, WatchedDirectory>::iterator watched = watchedDirectories.find(event->wd);
+				if (watched == watchedDirectories.end() || event->len == 0) {
+					continue;
+				}
+				std::string path = watched->second.path + event->name;
+
+				if (event->mask & IN_ISDIR) {
+					int childState;
+					if ((event->mask & (IN_CREATE | IN_MOVED_TO))
+						&& watchedSubdirectory(watched->second.filterState, event->name, childState)) {
+						addWatches(path + "/", childState, false);
+					}
+				} else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+					candidates.erase(path);
+					finishedFiles.push_back(path);
+				}
+			}
+		}
+	}
+#endif
+
+	checkCandidates(finishedFiles);
+	return finishedFiles;
+}
+
+void DirectoryWatcher::addCandidate(const std::string &path) {
+	//A file that is already waiting keeps its time of last change
+	candidates.insert(std::make_pair(path, std::chrono::steady_clock::now()));
+}
+
+bool DirectoryWatcher::overflowed() {
+	bool lost = lostChanges;
+	lostChanges = false;
+	return lost;
+}
+
+const std::string &DirectoryWatcher::errorMessage() const {
+	return error;
+}
+
+void DirectoryWatcher::checkCandidates(std::vector<std::string> &finishedFiles) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::map<std::string, std::chrono::steady_clock::time_point>::iterator it = candidates.begin();
+	while (it != candidates.end()) {
+		if (now - it->second < std::chrono::seconds(settleSeconds)) {
+			++ it;
+			continue;
+		}
+
+		bool gone = false;
+#ifdef _WIN32
+		bool closed = fileIsClosed(it->first, gone);
+#else
+		bool closed = fileIsClosed(it->first, settleSeconds, gone);
+#endif
+		if (closed) {
+			finishedFiles.push_back(it->first);
+		}
+		if (closed || gone) {
+			candidates.erase(it ++);
+		} else {
+			++ it;
+		}
+	}
+}
+
+#ifdef _WIN32
+bool DirectoryWatcher::queueRead() {
+	ResetEvent(eventHandle);
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.hEvent = eventHandle;
+	readPending = ReadDirectoryChangesW(directoryHandle, &changeBuffer[0], (DWORD)(changeBuffer.size() * sizeof(DWORD)),
+		TRUE, CHANGE_FILTER, NULL, &overlapped, NULL) != 0;
+	return readPending;
+}
+#else
+void DirectoryWatcher::addWatches(const std::string &directory, int filterState, bool followLink) {
+	int watch = inotify_add_watch(inotifyDescriptor, directory.c_str(),
+		WATCH_EVENTS | (followLink ? 0 : IN_DONT_FOLLOW));
+	//A directory that is already watched (through a bind mount, say) isn't gone through again
+	if (watch < 0 || watchedDirectories.count(watch) > 0) {
+		return;
+	}
+	WatchedDirectory watched;
+	watched.path = directory;
+	watched.filterState = filterState;
+	watchedDirectories[watch] = watched;
+
+	DIR *listing = opendir(directory.c_str());
+	if (listing == NULL) {
+		return;
+	}
+	while (struct dirent *child = readdir(listing)) {
+		std::string name = child->d_name;
+		if (name == "." || name == "..") {
+			continue;
+		}
+		std::string path = directory + name;
+
+		//Links to directories aren't followed, so the walk can't loop
+		//(the same as the scan)
+		unsigned char type = child->d_type;
+		struct stat status;
+		if (type == DT_UNKNOWN && lstat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode)) {
+			type = DT_DIR;
+		}
+
+		int childState;
+		if (type == DT_DIR && watchedSubdirectory(filterState, name, childState)) {
+			addWatches(path + "/", childState, false);
+		}
+	}
+	closedir(listing);
+}
+
+bool DirectoryWatcher::watchedSubdirectory(int parentState, const std::string &name, int &childState) {
+	childState = parentState;
+	if (filter == NULL || filter->finished(parentState)) {
+		return true;
+	}
+
+	//The scan has counted the directory already
+	int state = filter->advance(parentState, name);
+	if (!filter->includesDirectory(state, false)) {
+		return false;
+	}
+	childState = filter->enterDirectory(state);
+	return true;
+}
+#endif
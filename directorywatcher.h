@@ -0,0 +1,99 @@
+// Archiver and Splitter
+// directorywatcher.h
+// Reports new files in a directory tree once they have been written and closed
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+class FileFilter;
+
+//Watches a directory and all of its subdirectories for finished files.
+//On Windows, ReadDirectoryChangesW reports files while they are being
+//written, so a file only counts as finished once it has gone settleSeconds
+//without a change and can be opened without sharing (nobody has it open for
+//writing any more).  On Linux, inotify reports closed files directly
+//(IN_CLOSE_WRITE and IN_MOVED_TO), and new subdirectories are watched as they
+//appear.  Links to directories aren't followed, and directories the filter
+//excludes aren't watched (the files reported still have to be filtered:
+//on Windows, the whole tree is watched at once).
+//Notifications can be lost, and files in a directory that is moved in as a
+//whole get none, so callers should still rescan the tree now and then.
+class DirectoryWatcher {
+public:
+	DirectoryWatcher();
+	~DirectoryWatcher();
+
+	//The filter must be compiled, and outlive the watcher (NULL = no filter).
+	//Set it before start.
+	void setFilter(FileFilter *filter);
+
+	//directory ends with a path separator, like the input directory
+	bool start(const std::string &directory, unsigned int settleSeconds);
+	void stop();
+
+	//Waits up to timeoutMilliseconds for changes and returns the full paths of
+	//the files that were finished since the last call.  A file that is
+	//rewritten later is reported again.
+	std::vector<std::string> waitForFiles(unsigned int timeoutMilliseconds);
+
+	//Files found some other way (by a rescan) are reported by waitForFiles
+	//once they are finished, the same as the files with notifications
+	void addCandidate(const std::string &path);
+
+	//True if notifications were lost since the last call, so the tree should
+	//be rescanned right away
+	bool overflowed();
+
+	const std::string &errorMessage() const;
+
+private:
+	DirectoryWatcher(const DirectoryWatcher &);
+	DirectoryWatcher &operator=(const DirectoryWatcher &);
+
+	//Moves the candidates that have settled into finishedFiles
+	void checkCandidates(std::vector<std::string> &finishedFiles);
+
+#ifdef _WIN32
+	bool queueRead();
+
+	HANDLE directoryHandle;
+	HANDLE eventHandle;
+	OVERLAPPED overlapped;
+	bool readPending;
+	//FILE_NOTIFY_INFORMATION records have to be DWORD-aligned
+	std::vector<DWORD> changeBuffer;
+#else
+	struct WatchedDirectory {
+		//With final separator
+		std::string path;
+		//The filter's state after the path
+		int filterState;
+	};
+
+	void addWatches(const std::string &directory, int filterState, bool followLink);
+	//False if the filter excludes the subdirectory name of the directory
+	//with parentState; otherwise childState is its state for addWatches
+	bool watchedSubdirectory(int parentState, const std::string &name, int &childState);
+
+	int inotifyDescriptor;
+	//Watch descriptor to directory
+	std::map<int, WatchedDirectory> watchedDirectories;
+#endif
+
+	FileFilter *filter;
+
+	std::string rootDirectory;
+	unsigned int settleSeconds;
+	//Files that changed but aren't known to be finished, with the time of their last change
+	std::map<std::string, std::chrono::steady_clock::time_point> candidates;
+	bool lostChanges;
+	std::string error;
+};
@@ -0,0 +1,448 @@
+// Archiver and Splitter
+// filefilter.cpp
+
+#include "filefilter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//Separator the patterns and the automaton use on every platform
+const char FILTER_SEPARATOR = '/';
+
+//The state with no pattern positions: nothing can match any more
+const FileFilter::State FINISHED_STATE = 0;
+
+}
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+//Windows file names don't care about case
+unsigned char foldCase(unsigned char character) {
+#ifdef _WIN32
+	return (unsigned char)tolower(character);
+#else
+	return character;
+#endif
+}
+
+//Splits a rule into words; double quotes keep spaces in a word
+std::vector<std::string> ruleWords(const std::string &rule) {
+	std::vector<std::string> words;
+	std::string word;
+	bool quoted = false;
+	bool inWord = false;
+	for (size_t i = 0; i < rule.size(); i ++) {
+		char c = rule[i];
+		if (c == '"') {
+			quoted = !quoted;
+			inWord = true;
+		} else if (!quoted && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+			if (inWord) {
+				words.push_back(word);
+				word.clear();
+				inWord = false;
+			}
+		} else {
+			word += c;
+			inWord = true;
+		}
+	}
+	if (inWord) {
+		words.push_back(word);
+	}
+	return words;
+}
+
+//"100", "64K", "2G"... Returns false if there's anything else
+bool parseSize(const std::string &text, long long &value) {
+	char *end = NULL;
+	value = strtoll(text.c_str(), &end, 10);
+	if (end == text.c_str() || value < 0) {
+		return false;
+	}
+	std::string unit = end;
+	if (unit == "K" || unit == "k") {
+		value *= 1024LL;
+	} else if (unit == "M" || unit == "m") {
+		value *= 1024LL * 1024;
+	} else if (unit == "G" || unit == "g") {
+		value *= 1024LL * 1024 * 1024;
+	} else if (!unit.empty()) {
+		return false;
+	}
+	return true;
+}
+
+//"90", "30m", "12h", "7d"...
+bool parseAge(const std::string &text, long long &seconds) {
+	char *end = NULL;
+	seconds = strtoll(text.c_str(), &end, 10);
+	if (end == text.c_str() || seconds < 0) {
+		return false;
+	}
+	std::string unit = end;
+	if (unit == "m") {
+		seconds *= 60;
+	} else if (unit == "h") {
+		seconds *= 60 * 60;
+	} else if (unit == "d") {
+		seconds *= 24 * 60 * 60;
+	} else if (!unit.empty() && unit != "s") {
+		return false;
+	}
+	return true;
+}
+
+}
+
+////////////////
+//   RULES
+////////////////
+
+FileFilter::FileFilter()
+	: root(FINISHED_STATE), now(0) {
+}
+
+bool FileFilter::addRule(const std::string &rule) {
+	std::vector<std::string> words = ruleWords(rule);
+	if (words.size() < 2 || (words[0] != "include" && words[0] != "exclude")) {
+		error = "Filter rules start with include or exclude and a pattern: " + rule;
+		return false;
+	}
+
+	FilterRule filterRule;
+	filterRule.text = rule;
+	filterRule.action = words[0] == "include" ? FILTER_INCLUDE : FILTER_EXCLUDE;
+	filterRule.pattern = words[1];
+	filterRule.minimumSize = -1;
+	filterRule.maximumSize = -1;
+	filterRule.minimumAgeSeconds = -1;
+	filterRule.maximumAgeSeconds = -1;
+	filterRule.filesMatched = 0;
+	filterRule.directoriesMatched = 0;
+
+	std::replace(filterRule.pattern.begin(), filterRule.pattern.end(), '\\', FILTER_SEPARATOR);
+	filterRule.directoriesOnly = filterRule.pattern.size() > 1
+		&& filterRule.pattern[filterRule.pattern.size() - 1] == FILTER_SEPARATOR;
+	if (filterRule.directoriesOnly) {
+		filterRule.pattern.erase(filterRule.pattern.size() - 1);
+	}
+	if (filterRule.pattern.empty() || filterRule.pattern == "/") {
+		error = "Filter rule has an empty pattern: " + rule;
+		return false;
+	}
+
+	//Size and age limits: size<N means smaller than N, age>N older than N
+	for (size_t i = 2; i < words.size(); i ++) {
+		const std::string &word = words[i];
+		bool ok = false;
+		if (word.size() > 5 && word.compare(0, 4, "size") == 0 && (word[4] == '<' || word[4] == '>')) {
+			long long value;
+			ok = parseSize(word.substr(5), value);
+			(word[4] == '<' ? filterRule.maximumSize : filterRule.minimumSize) = value;
+		} else if (word.size() > 4 && word.compare(0, 3, "age") == 0 && (word[3] == '<' || word[3] == '>')) {
+			long long value;
+			ok = parseAge(word.substr(4), value);
+			(word[3] == '<' ? filterRule.maximumAgeSeconds : filterRule.minimumAgeSeconds) = value;
+		}
+		if (!ok) {
+			error = "Filter rule has an unknown condition (" + word + "): " + rule;
+			return false;
+		}
+		if (filterRule.directoriesOnly) {
+			error = "Size and age conditions only apply to files, not to directory patterns: " + rule;
+			return false;
+		}
+	}
+
+	ruleList.push_back(filterRule);
+	return true;
+}
+
+bool FileFilter::loadRules(const std::string &path) {
+	std::ifstream file(path.c_str());
+	if (!file.is_open()) {
+		error = "Could not open the filter rules " + path;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t start = line.find_first_not_of(" \t\r\n");
+		if (start == std::string::npos || line[start] == '#') {
+			continue;
+		}
+		size_t end = line.find_last_not_of(" \t\r\n");
+		if (!addRule(line.substr(start, end - start + 1))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FileFilter::empty() const {
+	return ruleList.empty();
+}
+
+const std::vector<FilterRule> &FileFilter::rules() const {
+	return ruleList;
+}
+
+const std::string &FileFilter::errorMessage() const {
+	return error;
+}
+
+////////////////
+//   AUTOMATON
+////////////////
+
+void FileFilter::compile() {
+	now = (long long)time(NULL);
+
+	nfa.clear();
+	nfaStarts.clear();
+	dfa.clear();
+	dfaLookup.clear();
+
+	for (size_t i = 0; i < ruleList.size(); i ++) {
+		compilePattern((int)i, ruleList[i].pattern);
+	}
+
+	//State 0 is the finished state, whatever the rules are
+	dfaState(std::vector<int>());
+	root = dfaState(nfaStarts);
+}
+
+int FileFilter::newNfaState() {
+	NfaState state;
+	state.acceptRule = -1;
+	nfa.push_back(state);
+	return (int)nfa.size() - 1;
+}
+
+void FileFilter::compilePattern(int ruleIndex, const std::string &rulePattern) {
+	//A leading '/' only says the pattern starts at the input directory, which
+	//it does anyway if it has a '/' in it.  Without one, it can be anywhere.
+	std::string pattern = rulePattern;
+	if (pattern[0] == FILTER_SEPARATOR) {
+		pattern.erase(0, 1);
+	} else if (pattern.find(FILTER_SEPARATOR) == std::string::npos) {
+		pattern = "**/" + pattern;
+	}
+
+	int current = newNfaState();
+	nfaStarts.push_back(current);
+
+	for (size_t i = 0; i < pattern.size(); i ++) {
+		bool componentStart = i == 0 || pattern[i - 1] == FILTER_SEPARATOR;
+		NfaEdge edge;
+		edge.character = 0;
+
+		if (componentStart && pattern.compare(i, 3, "**/") == 0) {
+			//Any number of whole directories, including none
+			int inside = newNfaState();
+			int next = newNfaState();
+			nfa[current].emptyEdges.push_back(next);
+			edge.kind = EDGE_ANY;
+			edge.to = inside;
+			nfa[current].edges.push_back(edge);
+			nfa[inside].edges.push_back(edge);
+			edge.kind = EDGE_CHARACTER;
+			edge.character = FILTER_SEPARATOR;
+			edge.to = next;
+			nfa[inside].edges.push_back(edge);
+			current = next;
+			i += 2;
+		} else if (componentStart && pattern.compare(i, std::string::npos, "**") == 0) {
+			//Everything below
+			edge.kind = EDGE_ANY;
+			edge.to = current;
+			nfa[current].edges.push_back(edge);
+			i += 1;
+		} else if (pattern[i] == '*') {
+			//Stars in a row are one star
+			while (i + 1 < pattern.size() && pattern[i + 1] == '*') {
+				i ++;
+			}
+			edge.kind = EDGE_NOT_SEPARATOR;
+			edge.to = current;
+			nfa[current].edges.push_back(edge);
+		} else {
+			int next = newNfaState();
+			edge.kind = pattern[i] == '?' ? EDGE_NOT_SEPARATOR : EDGE_CHARACTER;
+			edge.character = foldCase((unsigned char)pattern[i]);
+			edge.to = next;
+			nfa[current].edges.push_back(edge);
+			current = next;
+		}
+	}
+
+	nfa[current].acceptRule = ruleIndex;
+}
+
+FileFilter::State FileFilter::dfaState(std::vector<int> nfaStates) {
+	//Follow the edges that don't read a character
+	for (size_t i = 0; i < nfaStates.size(); i ++) {
+		const std::vector<int> &emptyEdges = nfa[nfaStates[i]].emptyEdges;
+		for (size_t j = 0; j < emptyEdges.size(); j ++) {
+			if (std::find(nfaStates.begin(), nfaStates.end(), emptyEdges[j]) == nfaStates.end()) {
+				nfaStates.push_back(emptyEdges[j]);
+			}
+		}
+	}
+	std::sort(nfaStates.begin(), nfaStates.end());
+
+	std::map<std::vector<int>, State>::const_iterator found = dfaLookup.find(nfaStates);
+	if (found != dfaLookup.end()) {
+		return found->second;
+	}
+
+	DfaState state;
+	state.nfaStates = nfaStates;
+	state.transitions.assign(256, -1);
+	for (size_t i = 0; i < nfaStates.size(); i ++) {
+		if (nfa[nfaStates[i]].acceptRule >= 0) {
+			state.acceptRules.push_back(nfa[nfaStates[i]].acceptRule);
+		}
+	}
+	std::sort(state.acceptRules.begin(), state.acceptRules.end());
+
+	State id = (State)dfa.size();
+	dfa.push_back(state);
+	dfaLookup[nfaStates] = id;
+	return id;
+}
+
+FileFilter::State FileFilter::step(State state, unsigned char character) {
+	int known = dfa[state].transitions[character];
+	if (known >= 0) {
+		return known;
+	}
+
+	std::vector<int> next;
+	const std::vector<int> &from = dfa[state].nfaStates;
+	for (size_t i = 0; i < from.size(); i ++) {
+		const std::vector<NfaEdge> &edges = nfa[from[i]].edges;
+		for (size_t j = 0; j < edges.size(); j ++) {
+			bool matches = edges[j].kind == EDGE_ANY
+				|| (edges[j].kind == EDGE_NOT_SEPARATOR && character != FILTER_SEPARATOR)
+				|| (edges[j].kind == EDGE_CHARACTER && character == edges[j].character);
+			if (matches && std::find(next.begin(), next.end(), edges[j].to) == next.end()) {
+				next.push_back(edges[j].to);
+			}
+		}
+	}
+
+	//dfa may move while the new state is added
+	State nextState = dfaState(next);
+	dfa[state].transitions[character] = nextState;
+	return nextState;
+}
+
+FileFilter::State FileFilter::rootState() const {
+	return root;
+}
+
+FileFilter::State FileFilter::advance(State state, const std::string &name) {
+	for (size_t i = 0; i < name.size() && state != FINISHED_STATE; i ++) {
+		state = step(state, foldCase((unsigned char)name[i]));
+	}
+	return state;
+}
+
+FileFilter::State FileFilter::enterDirectory(State state) {
+	return state == FINISHED_STATE ? state : step(state, FILTER_SEPARATOR);
+}
+
+bool FileFilter::finished(State state) const {
+	return state == FINISHED_STATE;
+}
+
+////////////////
+//   DECISIONS
+////////////////
+
+bool FileFilter::includesDirectory(State state, bool counted) {
+	const std::vector<int> &matched = dfa[state].acceptRules;
+	for (size_t i = matched.size(); i > 0; i --) {
+		FilterRule &rule = ruleList[matched[i - 1]];
+		//Rules with a size or an age are about files
+		if (rule.minimumSize < 0 && rule.maximumSize < 0 && rule.minimumAgeSeconds < 0 && rule.maximumAgeSeconds < 0) {
+			if (counted) {
+				rule.directoriesMatched ++;
+			}
+			return rule.action == FILTER_INCLUDE;
+		}
+	}
+	return true;
+}
+
+bool FileFilter::needsFileInformation(State state) const {
+	const std::vector<int> &matched = dfa[state].acceptRules;
+	for (size_t i = matched.size(); i > 0; i --) {
+		const FilterRule &rule = ruleList[matched[i - 1]];
+		if (rule.directoriesOnly) {
+			continue;
+		}
+		if (rule.minimumSize < 0 && rule.maximumSize < 0 && rule.minimumAgeSeconds < 0 && rule.maximumAgeSeconds < 0) {
+			//This rule decides whatever the file is like
+			return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+bool FileFilter::includesFile(State state, const FileInformationPiece &file) {
+	const std::vector<int> &matched = dfa[state].acceptRules;
+	for (size_t i = matched.size(); i > 0; i --) {
+		FilterRule &rule = ruleList[matched[i - 1]];
+		if (!rule.directoriesOnly && predicatesHold(rule, file)) {
+			rule.filesMatched ++;
+			return rule.action == FILTER_INCLUDE;
+		}
+	}
+	return true;
+}
+
+bool FileFilter::predicatesHold(const FilterRule &rule, const FileInformationPiece &file) const {
+	long long age = now - file.modifiedTime;
+	return (rule.minimumSize < 0 || file.fileSize > rule.minimumSize)
+		&& (rule.maximumSize < 0 || file.fileSize < rule.maximumSize)
+		&& (rule.minimumAgeSeconds < 0 || age > rule.minimumAgeSeconds)
+		&& (rule.maximumAgeSeconds < 0 || age < rule.maximumAgeSeconds);
+}
+
+bool FileFilter::includesPath(const std::string &relativePath, const FileInformationPiece &file) {
+	std::string path = relativePath;
+	std::replace(path.begin(), path.end(), '\\', FILTER_SEPARATOR);
+
+	State state = root;
+	size_t start = 0;
+	size_t separator;
+	while ((separator = path.find(FILTER_SEPARATOR, start)) != std::string::npos) {
+		if (state != FINISHED_STATE) {
+			state = advance(state, path.substr(start, separator - start));
+			if (!includesDirectory(state, false)) {
+				return false;
+			}
+			state = enterDirectory(state);
+		}
+		start = separator + 1;
+	}
+	return includesFile(advance(state, path.substr(start)), file);
+}
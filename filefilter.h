@@ -0,0 +1,144 @@
+// Archiver and Splitter
+// filefilter.h
+// Include and exclude rules for the scan, compiled into one automaton
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "filescanner.h"
+
+enum FilterAction {
+	FILTER_INCLUDE,
+	FILTER_EXCLUDE
+};
+
+//One rule, as written:
+//	include|exclude <pattern> [size<N] [size>N] [age<N] [age>N]
+//Patterns are globs on the path relative to the input directory, with '/'
+//between directories: '*' and '?' don't cross a '/', and "**" does.  A
+//pattern without a '/' matches the name in any directory; one with a '/'
+//matches from the input directory.  Like .gitignore, a pattern matches
+//directories as well as files, and a trailing '/' makes it match only
+//directories.  Sizes take K, M or G (KiB, MiB, GiB); ages (time since the
+//last modification) take s, m, h or d.  Rules with a size or an age only
+//apply to files.  Patterns with spaces go in double quotes.
+struct FilterRule {
+	std::string text;
+	FilterAction action;
+	std::string pattern;
+	bool directoriesOnly;
+	//-1 = no limit
+	long long minimumSize;
+	long long maximumSize;
+	long long minimumAgeSeconds;
+	long long maximumAgeSeconds;
+	//Entries this rule decided on
+	unsigned long long filesMatched;
+	unsigned long long directoriesMatched;
+};
+
+//The patterns of all the rules are compiled into one automaton, which
+//reads a path one character at a time.  The scan keeps the automaton's
+//state for each directory, so every path component is read once, however
+//many rules there are.  The automaton is built as it is used: each state
+//is a set of positions in the patterns, and its transitions are worked out
+//the first time they are needed.
+//
+//For each entry, the last rule that matches decides; an entry that no rule
+//matches is included.  An excluded directory is left out with everything
+//in it, without being opened.
+class FileFilter {
+public:
+	typedef int State;
+
+	FileFilter();
+
+	//Returns false (see errorMessage) if the rule can't be read
+	bool addRule(const std::string &rule);
+	//One rule per line; blank lines and lines starting with '#' are skipped
+	bool loadRules(const std::string &path);
+
+	bool empty() const;
+
+	//Ages are measured from the time of this call; call it before the scan
+	//(after the rules are added)
+	void compile();
+
+	//State before the first path component
+	State rootState() const;
+	//Reads one path component (a file or directory name)
+	State advance(State state, const std::string &name);
+	//Reads the '/' after a directory's name, for the entries in it
+	State enterDirectory(State state);
+	//True if nothing under this state can match any rule
+	bool finished(State state) const;
+
+	//Decides on an entry, from the state after its name.  Directories that
+	//were decided on before (by the scan) are checked again uncounted, so
+	//each one is only counted once.
+	bool includesDirectory(State state, bool counted = true);
+	//True if the decision on a file needs its size or modification time
+	bool needsFileInformation(State state) const;
+	bool includesFile(State state, const FileInformationPiece &file);
+
+	//Decides on a path relative to the input directory (for files found
+	//outside a scan), including each of the directories above it.  Only the
+	//file is counted; the directories were counted by the scan.
+	bool includesPath(const std::string &relativePath, const FileInformationPiece &file);
+
+	//The rules, with how many entries each one decided on
+	const std::vector<FilterRule> &rules() const;
+
+	const std::string &errorMessage() const;
+
+private:
+	enum EdgeKind {
+		EDGE_CHARACTER,
+		//Any character but '/'
+		EDGE_NOT_SEPARATOR,
+		EDGE_ANY
+	};
+
+	struct NfaEdge {
+		EdgeKind kind;
+		unsigned char character;
+		int to;
+	};
+
+	struct NfaState {
+		std::vector<NfaEdge> edges;
+		//Taken without reading a character (for "**/" matching nothing)
+		std::vector<int> emptyEdges;
+		//Rule this state finishes, or -1
+		int acceptRule;
+	};
+
+	struct DfaState {
+		std::vector<int> nfaStates;
+		//-1 until worked out
+		std::vector<int> transitions;
+		//Rules matched in this state, in order
+		std::vector<int> acceptRules;
+	};
+
+	void compilePattern(int ruleIndex, const std::string &pattern);
+	int newNfaState();
+	State dfaState(std::vector<int> nfaStates);
+	State step(State state, unsigned char character);
+	bool predicatesHold(const FilterRule &rule, const FileInformationPiece &file) const;
+
+	std::vector<FilterRule> ruleList;
+
+	std::vector<NfaState> nfa;
+	std::vector<int> nfaStarts;
+
+	std::vector<DfaState> dfa;
+	std::map<std::vector<int>, State> dfaLookup;
+	State root;
+
+	long long now;
+	std::string error;
+};
@@ -0,0 +1,229 @@
+// Archiver and Splitter
+// filescanner.cpp
+
+#include "filescanner.h"
+
+#include <algorithm>
+
+#include "filefilter.h"
+#include "utilities.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//A PROGRESS_FILES_FOUND event is sent every this many files
+const size_t SCAN_PROGRESS_INTERVAL = 50;
+
+}
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+#ifdef _WIN32
+//FILETIME counts 100 ns ticks since 1601
+long long fileTimeToSeconds(const FILETIME &time) {
+	ULARGE_INTEGER ticks;
+	ticks.HighPart = time.dwHighDateTime;
+	ticks.LowPart = time.dwLowDateTime;
+	return (long long)(ticks.QuadPart / 10000000ULL) - 11644473600LL;
+}
+#endif
+
+}
+
+////////////////
+//   SCANNER
+////////////////
+
+FileScanner::FileScanner(ProgressReporter &progress, const CancellationToken &cancel)
+	: progress(progress), cancel(cancel), filter(NULL) {
+}
+
+void FileScanner::setFilter(FileFilter *filter) {
+	this->filter = filter;
+}
+
+bool FileScanner::scan(const std::string &directory, FileInformation &fileInfo) {
+	failed.clear();
+	return scanDirectory(directory, filter != NULL ? filter->rootState() : 0, fileInfo);
+}
+
+const std::vector<std::string> &FileScanner::failedFiles() const {
+	return failed;
+}
+
+bool FileScanner::scanDirectory(const std::string &directory, int filterState, FileInformation &fileInfo) {
+	if (cancel.cancelled()) {
+		return false;
+	}
+
+	//Once no rule can match below here, the filter is skipped
+	bool filtered = filter != NULL && !filter->finished(filterState);
+
+#ifdef _WIN32
+	//Used to find files
+	WIN32_FIND_DATA fileFindData;
+
+	//Find the first file
+	HANDLE hFind = ::FindFirstFile((directory + "*.*").c_str(), &fileFindData);
+
+	//Make sure it's not invalid
+	if (hFind == INVALID_HANDLE_VALUE) {
+		return true;
+	}
+
+	bool finished = true;
+	do {
+		std::string name = fileFindData.cFileName;
+		int state = filtered ? filter->advance(filterState, name) : filterState;
+
+		//If the found file is a directory, search in this, too
+		if (fileFindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			//Make sure the directory found is not the current directory
+			//or the parent directory
+			if (name == "." || name == ".." || (filtered && !filter->includesDirectory(state))) {
+				continue;
+			}
+			if (!scanDirectory(directory + name + "\\", filtered ? filter->enterDirectory(state) : state, fileInfo)) {
+				finished = false;
+				break;
+			}
+		} else {
+			//The size comes with the directory listing
+			FileInformationPiece file;
+			LARGE_INTEGER size;
+			size.HighPart = fileFindData.nFileSizeHigh;
+			size.LowPart = fileFindData.nFileSizeLow;
+			file.fileSize = size.QuadPart;
+			file.modifiedTime = fileTimeToSeconds(fileFindData.ftLastWriteTime);
+			if (!filtered || filter->includesFile(state, file)) {
+				addFile(directory + name, file.fileSize, file.modifiedTime, fileInfo);
+			}
+		}
+	} while (::FindNextFile(hFind, &fileFindData));
+
+	//Close the file find
+	::FindClose(hFind);
+	return finished;
+#else
+	DIR *handle = opendir(directory.c_str());
+	if (handle == NULL) {
+		return true;
+	}
+
+	//Names with their types, where the file system gives them
+	std::vector<std::pair<std::string, unsigned char> > names;
+	while (struct dirent *entry = readdir(handle)) {
+		std::string name = entry->d_name;
+		if (name != "." && name != "..") {
+			names.push_back(std::make_pair(name, (unsigned char)entry->d_type));
+		}
+	}
+	closedir(handle);
+	std::sort(names.begin(), names.end());
+
+	for (size_t i = 0; i < names.size(); i ++) {
+		std::string path = directory + names[i].first;
+		int state = filtered ? filter->advance(filterState, names[i].first) : filterState;
+		unsigned char type = names[i].second;
+
+		//Where the listing gives the type, entries the filter decides on by
+		//name alone are decided before the stat (and left out without one)
+		bool included = !filtered;
+		if (filtered && type == DT_DIR) {
+			if (!filter->includesDirectory(state)) {
+				continue;
+			}
+			included = true;
+		} else if (filtered && type == DT_REG && !filter->needsFileInformation(state)) {
+			if (!filter->includesFile(state, FileInformationPiece())) {
+				continue;
+			}
+			included = true;
+		}
+
+		struct stat status;
+		if (lstat(path.c_str(), &status) != 0) {
+			failed.push_back(path);
+			continue;
+		}
+
+		//Links to directories aren't followed, so the walk can't loop
+		if (S_ISDIR(status.st_mode)) {
+			if (!included && !filter->includesDirectory(state)) {
+				continue;
+			}
+			if (!scanDirectory(path + "/", filtered ? filter->enterDirectory(state) : state, fileInfo)) {
+				return false;
+			}
+			continue;
+		}
+
+		if (S_ISLNK(status.st_mode) && stat(path.c_str(), &status) != 0) {
+			failed.push_back(path);
+			continue;
+		}
+		if (S_ISREG(status.st_mode)) {
+			FileInformationPiece file;
+			file.fileSize = (long long)status.st_size;
+			file.modifiedTime = (long long)status.st_mtime;
+			if (!included && !filter->includesFile(state, file)) {
+				continue;
+			}
+			addFile(path, file.fileSize, file.modifiedTime, fileInfo);
+		}
+	}
+	return true;
+#endif
+}
+
+void FileScanner::addFile(const std::string &path, long long fileSize, long long modifiedTime,
+						  FileInformation &fileInfo) {
+	FileInformationPiece file;
+	file.fileName = path;
+	file.fileSize = fileSize;
+	file.modifiedTime = modifiedTime;
+	fileInfo.files.push_back(file);
+
+	if (fileInfo.files.size() % SCAN_PROGRESS_INTERVAL == 0) {
+		progress.setFileCounts(0, fileInfo.files.size());
+		progress.report(PROGRESS_FILES_FOUND, itos(fileInfo.files.size()) + " files found.");
+	}
+}
+
+bool fileInformationGet(const std::string &path, FileInformationPiece &file) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &fad)
+		|| (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	size.HighPart = fad.nFileSizeHigh;
+	size.LowPart = fad.nFileSizeLow;
+	file.fileSize = size.QuadPart;
+	file.modifiedTime = fileTimeToSeconds(fad.ftLastWriteTime);
+#else
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+		return false;
+	}
+	file.fileSize = (long long)status.st_size;
+	file.modifiedTime = (long long)status.st_mtime;
+#endif
+	file.fileName = path;
+	return true;
+}
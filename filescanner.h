@@ -0,0 +1,65 @@
+// Archiver and Splitter
+// filescanner.h
+// Finds all the files in a directory tree, with their sizes
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cancellation.h"
+#include "progress.h"
+
+class FileFilter;
+
+//Contains the data for one file
+struct FileInformationPiece {
+	std::string fileName;
+	//long long = __int64
+	long long fileSize;
+	//Last modification, in seconds since 1970 (UTC)
+	long long modifiedTime;
+};
+
+//Contains a list of FileInformationPieces
+struct FileInformation {
+	std::vector<FileInformationPiece> files;
+};
+
+//Walks a directory and all of its subdirectories.  Files are listed in the
+//order the directories give them (alphabetical on NTFS; sorted by name
+//elsewhere, where the order is arbitrary), each subdirectory where its name
+//falls among the files.  With a filter, excluded files are left out, and
+//excluded directories aren't opened at all.
+class FileScanner {
+public:
+	//progress gets a PROGRESS_FILES_FOUND event every so many files
+	FileScanner(ProgressReporter &progress, const CancellationToken &cancel);
+
+	//The filter must be compiled, and outlive the scanner (NULL = no filter)
+	void setFilter(FileFilter *filter);
+
+	//Adds the files under directory (which ends with a path separator) to
+	//fileInfo.  Returns false if the run was cancelled part of the way.
+	bool scan(const std::string &directory, FileInformation &fileInfo);
+
+	//Files that were found but whose size couldn't be read (left out)
+	const std::vector<std::string> &failedFiles() const;
+
+private:
+	FileScanner(const FileScanner &);
+	FileScanner &operator=(const FileScanner &);
+
+	//filterState is the filter's state after the directory's path
+	bool scanDirectory(const std::string &directory, int filterState, FileInformation &fileInfo);
+	void addFile(const std::string &path, long long fileSize, long long modifiedTime, FileInformation &fileInfo);
+
+	ProgressReporter &progress;
+	CancellationToken cancel;
+	FileFilter *filter;
+	std::vector<std::string> failed;
+};
+
+//Size and modification time of one file.  Returns false if it can't be read
+//(or isn't a file).
+bool fileInformationGet(const std::string &path, FileInformationPiece &file);
@@ -0,0 +1,452 @@
+// Archiver and Splitter
+// inflate.cpp
+
+#include "inflate.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+const int MAX_BITS = 15;
+const int FAST_BITS = 10;
+const int END_OF_BLOCK = 256;
+
+const size_t INPUT_BUFFER_SIZE = 65536;
+
+//The window is twice the largest distance, so half of it can be passed
+//to the sink while the other half is still reachable
+const size_t WINDOW_SIZE = 65536;
+const size_t WINDOW_MASK = WINDOW_SIZE - 1;
+const size_t FLUSH_SIZE = WINDOW_SIZE / 2;
+
+const int lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const int lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const int distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const int distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+const int codeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+////////////////
+//   HUFFMAN
+////////////////
+
+//Canonical Huffman decoding table.  Codes up to FAST_BITS long are found with
+//one lookup; longer ones are decoded a bit at a time.
+struct HuffmanTable {
+	uint16_t counts[MAX_BITS + 1];
+	uint16_t symbols[288];
+	//symbol << 4 | code length, or 0 for codes longer than FAST_BITS
+	uint16_t fast[1 << FAST_BITS];
+};
+
+//Returns false if the lengths describe an over-subscribed code.
+//Incomplete codes are allowed (a single distance code is common).
+bool huffmanBuildTable(HuffmanTable &table, const unsigned char *lengths, int symbolCount) {
+	memset(table.counts, 0, sizeof(table.counts));
+	for (int i = 0; i < symbolCount; i ++) {
+		table.counts[lengths[i]] ++;
+	}
+	table.counts[0] = 0;
+
+	int left = 1;
+	for (int length = 1; length <= MAX_BITS; length ++) {
+		left = (left << 1) - table.counts[length];
+		if (left < 0) {
+			return false;
+		}
+	}
+
+	//Symbols sorted by code length, then by value
+	uint16_t offsets[MAX_BITS + 2];
+	offsets[1] = 0;
+	for (int length = 1; length <= MAX_BITS; length ++) {
+		offsets[length + 1] = offsets[length] + table.counts[length];
+	}
+	for (int i = 0; i < symbolCount; i ++) {
+		if (lengths[i] != 0) {
+			table.symbols[offsets[lengths[i]] ++] = (uint16_t)i;
+		}
+	}
+
+	//Codes are assigned in the same order; the bits are reversed because
+	//deflate sends Huffman codes starting with the most significant bit
+	memset(table.fast, 0, sizeof(table.fast));
+	unsigned int code = 0;
+	int index = 0;
+	for (int length = 1; length <= FAST_BITS; length ++) {
+		for (int i = 0; i < table.counts[length]; i ++) {
+			unsigned int reversed = 0;
+			for (int bit = 0; bit < length; bit ++) {
+				reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+			}
+			for (unsigned int fill = reversed; fill < (1u << FAST_BITS); fill += 1u << length) {
+				table.fast[fill] = (uint16_t)((table.symbols[index] << 4) | length);
+			}
+			code ++;
+			index ++;
+		}
+		code <<= 1;
+	}
+	return true;
+}
+
+//Tables for the fixed Huffman codes, built once
+struct FixedTables {
+	HuffmanTable literals;
+	HuffmanTable distances;
+
+	FixedTables() {
+		unsigned char lengths[288];
+		memset(lengths, 8, 144);
+		memset(lengths + 144, 9, 112);
+		memset(lengths + 256, 7, 24);
+		memset(lengths + 280, 8, 8);
+		huffmanBuildTable(literals, lengths, 288);
+		memset(lengths, 5, 30);
+		huffmanBuildTable(distances, lengths, 30);
+	}
+};
+
+const FixedTables &fixedTables() {
+	static const FixedTables tables;
+	return tables;
+}
+
+////////////////
+//   DECODER
+////////////////
+
+class Inflater {
+public:
+	Inflater(const InflateSource &source, const InflateSink &sink)
+		: source(source), sink(sink), input(INPUT_BUFFER_SIZE), inputPosition(0), inputLength(0),
+		inputEnded(false), bitBuffer(0), bitCount(0), window(WINDOW_SIZE), position(0), flushed(0) {
+	}
+
+	bool run();
+
+private:
+	bool fillBits(int count);
+	bool readBits(int count, unsigned int &value);
+	bool decodeSymbol(const HuffmanTable &table, int &symbol);
+	bool storedBlock();
+	bool dynamicTables(HuffmanTable &literals, HuffmanTable &distances);
+	bool codesBlock(const HuffmanTable &literals, const HuffmanTable &distances);
+	bool output(unsigned char byte);
+	bool flush();
+
+	const InflateSource &source;
+	const InflateSink &sink;
+
+	std::vector<unsigned char> input;
+	size_t inputPosition;
+	size_t inputLength;
+	bool inputEnded;
+
+	uint64_t bitBuffer;
+	int bitCount;
+
+	std::vector<unsigned char> window;
+	//Total bytes written so far, and how many of them the sink has been given
+	unsigned long long position;
+	unsigned long long flushed;
+};
+
+//Tries to have at least count bits in the bit buffer.  Returns false if the input ran out first.
+bool Inflater::fillBits(int count) {
+	while (bitCount < count) {
+		if (inputPosition == inputLength) {
+			if (inputEnded) {
+				return false;
+			}
+			inputLength = source(&input[0], input.size());
+			inputPosition = 0;
+			if (inputLength == 0) {
+				inputEnded = true;
+				return false;
+			}
+		}
+		while (bitCount <= 56 && inputPosition < inputLength) {
+			bitBuffer |= (uint64_t)input[inputPosition ++] << bitCount;
+			bitCount += 8;
+		}
+	}
+	return true;
+}
+
+bool Inflater::readBits(int count, unsigned int &value) {
+	if (!fillBits(count)) {
+		return false;
+	}
+	value = (unsigned int)(bitBuffer & ((1u << count) - 1));
+	bitBuffer >>= count;
+	bitCount -= count;
+	return true;
+}
+
+bool Inflater::decodeSymbol(const HuffmanTable &table, int &symbol) {
+	//Near the end of the stream there may be fewer bits left than the longest code
+	fillBits(MAX_BITS);
+
+	uint16_t entry = table.fast[bitBuffer & ((1u << FAST_BITS) - 1)];
+	if (entry != 0 && (entry & 15) <= bitCount) {
+		bitBuffer >>= entry & 15;
+		bitCount -= entry & 15;
+		symbol = entry >> 4;
+		return true;
+	}
+
+	//Longer code: one bit at a time
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int length = 1; length <= MAX_BITS; length ++) {
+		unsigned int bit;
+		if (!readBits(1, bit)) {
+			return false;
+		}
+		code |= bit;
+		int count = table.counts[length];
+		if (code - count < first) {
+			symbol = table.symbols[index + (code - first)];
+			return true;
+		}
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return false;
+}
+
+bool Inflater::output(unsigned char byte) {
+	window[position & WINDOW_MASK] = byte;
+	position ++;
+	if (position - flushed == FLUSH_SIZE) {
+		return flush();
+	}
+	return true;
+}
+
+bool Inflater::flush() {
+	if (position > flushed) {
+		if (!sink(&window[flushed & WINDOW_MASK], (size_t)(position - flushed))) {
+			return false;
+		}
+		flushed = position;
+	}
+	return true;
+}
+
+bool Inflater::storedBlock() {
+	//Skip to the next byte boundary
+	bitBuffer >>= bitCount & 7;
+	bitCount -= bitCount & 7;
+
+	unsigned int length;
+	unsigned int complement;
+	if (!readBits(16, length) || !readBits(16, complement) || length != (~complement & 0xFFFF)) {
+		return false;
+	}
+
+	//Bytes already in the bit buffer first, then straight from the input
+	while (length > 0 && bitCount >= 8) {
+		if (!output((unsigned char)bitBuffer)) {
+			return false;
+		}
+		bitBuffer >>= 8;
+		bitCount -= 8;
+		length --;
+	}
+	while (length > 0) {
+		if (inputPosition == inputLength) {
+			if (!fillBits(8)) {
+				return false;
+			}
+			//fillBits() refilled the input; give those bits back
+			inputPosition -= bitCount / 8;
+			bitBuffer = 0;
+			bitCount = 0;
+		}
+		if (!output(input[inputPosition ++])) {
+			return false;
+		}
+		length --;
+	}
+	return true;
+}
+
+bool Inflater::dynamicTables(HuffmanTable &literals, HuffmanTable &distances) {
+	unsigned int literalCount;
+	unsigned int distanceCount;
+	unsigned int codeLengthCount;
+	if (!readBits(5, literalCount) || !readBits(5, distanceCount) || !readBits(4, codeLengthCount)) {
+		return false;
+	}
+	literalCount += 257;
+	distanceCount += 1;
+	codeLengthCount += 4;
+	if (literalCount > 286 || distanceCount > 30) {
+		return false;
+	}
+
+	unsigned char lengths[286 + 30];
+	memset(lengths, 0, sizeof(lengths));
+	for (unsigned int i = 0; i < codeLengthCount; i ++) {
+		unsigned int length;
+		if (!readBits(3, length)) {
+			return false;
+		}
+		lengths[codeLengthOrder[i]] = (unsigned char)length;
+	}
+
+	HuffmanTable codeLengths;
+	if (!huffmanBuildTable(codeLengths, lengths, 19)) {
+		return false;
+	}
+
+	//Literal/length and distance code lengths, run-length encoded as one sequence
+	unsigned int index = 0;
+	while (index < literalCount + distanceCount) {
+		int symbol;
+		if (!decodeSymbol(codeLengths, symbol)) {
+			return false;
+		}
+		if (symbol < 16) {
+			lengths[index ++] = (unsigned char)symbol;
+			continue;
+		}
+
+		unsigned char repeated = 0;
+		unsigned int repeat;
+		if (symbol == 16) {
+			if (index == 0 || !readBits(2, repeat)) {
+				return false;
+			}
+			repeated = lengths[index - 1];
+			repeat += 3;
+		} else if (symbol == 17) {
+			if (!readBits(3, repeat)) {
+				return false;
+			}
+			repeat += 3;
+		} else {
+			if (!readBits(7, repeat)) {
+				return false;
+			}
+			repeat += 11;
+		}
+		if (index + repeat > literalCount + distanceCount) {
+			return false;
+		}
+		while (repeat > 0) {
+			lengths[index ++] = repeated;
+			repeat --;
+		}
+	}
+
+	//There has to be a code for the end of the block
+	if (lengths[END_OF_BLOCK] == 0) {
+		return false;
+	}
+
+	return huffmanBuildTable(literals, lengths, literalCount)
+		&& huffmanBuildTable(distances, lengths + literalCount, distanceCount);
+}
+
+bool Inflater::codesBlock(const HuffmanTable &literals, const HuffmanTable &distances) {
+	while (true) {
+		int symbol;
+		if (!decodeSymbol(literals, symbol)) {
+			return false;
+		}
+
+		if (symbol < 256) {
+			if (!output((unsigned char)symbol)) {
+				return false;
+			}
+			continue;
+		}
+		if (symbol == END_OF_BLOCK) {
+			return true;
+		}
+
+		symbol -= 257;
+		if (symbol >= 29) {
+			return false;
+		}
+		unsigned int extra;
+		if (!readBits(lengthExtra[symbol], extra)) {
+			return false;
+		}
+		unsigned int length = lengthBase[symbol] + extra;
+
+		if (!decodeSymbol(distances, symbol) || symbol >= 30) {
+			return false;
+		}
+		if (!readBits(distExtra[symbol], extra)) {
+			return false;
+		}
+		unsigned int distance = distBase[symbol] + extra;
+		if (distance > position) {
+			return false;
+		}
+
+		while (length > 0) {
+			if (!output(window[(position - distance) & WINDOW_MASK])) {
+				return false;
+			}
+			length --;
+		}
+	}
+}
+
+bool Inflater::run() {
+	const FixedTables &fixed = fixedTables();
+
+	HuffmanTable literals;
+	HuffmanTable distances;
+
+	unsigned int finalBlock = 0;
+	while (!finalBlock) {
+		unsigned int type;
+		if (!readBits(1, finalBlock) || !readBits(2, type)) {
+			return false;
+		}
+
+		bool ok = false;
+		if (type == 0) {
+			ok = storedBlock();
+		} else if (type == 1) {
+			ok = codesBlock(fixed.literals, fixed.distances);
+		} else if (type == 2) {
+			ok = dynamicTables(literals, distances) && codesBlock(literals, distances);
+		}
+		if (!ok) {
+			return false;
+		}
+	}
+
+	return flush();
+}
+
+}
+
+////////////////
+//   INFLATE
+////////////////
+
+bool inflateStream(const InflateSource &source, const InflateSink &sink) {
+	Inflater inflater(source, sink);
+	return inflater.run();
+}
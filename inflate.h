@@ -0,0 +1,19 @@
+// Archiver and Splitter
+// inflate.h
+// Deflate (RFC 1951) decompressor that streams through a 64 KiB window
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+//Reads more compressed data into buffer and returns the number of bytes read
+//(0 when there is no more)
+typedef std::function<size_t(unsigned char *buffer, size_t size)> InflateSource;
+
+//Receives the next piece of decompressed data.  Returning false stops decompression.
+typedef std::function<bool(const unsigned char *data, size_t size)> InflateSink;
+
+//Decompresses one raw deflate stream (as stored in ZIP files) up to its final block.
+//Returns false if the data is corrupt or truncated, or the sink stopped it.
+bool inflateStream(const InflateSource &source, const InflateSink &sink);
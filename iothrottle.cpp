@@ -0,0 +1,400 @@
+// Archiver and Splitter
+// iothrottle.cpp
+
+#include "iothrottle.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//How often the control file is looked at
+const unsigned int CONTROL_CHECK_SECONDS = 2;
+
+//Size of the pieces throttledCopyFile reads and writes
+const size_t COPY_CHUNK_SIZE = 1024 * 1024;
+
+//Limits of the pause the backoff adds before each read or write
+const double BACKOFF_MINIMUM_SECONDS = 0.001;
+const double BACKOFF_MAXIMUM_SECONDS = 0.5;
+
+//Weight of the newest measurement in the smoothed latency
+const double LATENCY_SMOOTHING = 0.2;
+
+}
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+std::string trim(const std::string &text) {
+	size_t start = text.find_first_not_of(" \t\r\n");
+	if (start == std::string::npos) {
+		return "";
+	}
+	size_t end = text.find_last_not_of(" \t\r\n");
+	return text.substr(start, end - start + 1);
+}
+
+ThrottleSettings parseSettings(const std::string &contents) {
+	ThrottleSettings settings;
+	settings.readBytesPerSecond = 0;
+	settings.writeBytesPerSecond = 0;
+	settings.compressionThreads = 0;
+	settings.latencyTargetMilliseconds = 0;
+
+	std::istringstream lines(contents);
+	std::string line;
+	while (std::getline(lines, line)) {
+		size_t equals = line.find('=');
+		if (line.empty() || line[0] == '#' || equals == std::string::npos) {
+			continue;
+		}
+		std::string name = trim(line.substr(0, equals));
+		unsigned long long value = strtoull(trim(line.substr(equals + 1)).c_str(), NULL, 10);
+
+		if (name == "read_bytes_per_second") {
+			settings.readBytesPerSecond = value;
+		} else if (name == "write_bytes_per_second") {
+			settings.writeBytesPerSecond = value;
+		} else if (name == "compression_threads") {
+			settings.compressionThreads = (unsigned int)value;
+		} else if (name == "latency_target_ms") {
+			settings.latencyTargetMilliseconds = (unsigned int)value;
+		}
+	}
+	return settings;
+}
+
+bool sameSettings(const ThrottleSettings &a, const ThrottleSettings &b) {
+	return a.readBytesPerSecond == b.readBytesPerSecond && a.writeBytesPerSecond == b.writeBytesPerSecond
+		&& a.compressionThreads == b.compressionThreads && a.latencyTargetMilliseconds == b.latencyTargetMilliseconds;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+////////////////
+//   TOKENBUCKET
+////////////////
+
+TokenBucket::TokenBucket()
+	: rate(0), tokens(0), lastRefill(std::chrono::steady_clock::now()) {
+}
+
+void TokenBucket::setRate(unsigned long long bytesPerSecond) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (bytesPerSecond != rate) {
+		rate = bytesPerSecond;
+		tokens = 0;
+		lastRefill = std::chrono::steady_clock::now();
+	}
+}
+
+void TokenBucket::consume(unsigned long long bytes) {
+	double waitSeconds = take(bytes);
+	if (waitSeconds > 0) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(waitSeconds));
+	}
+}
+
+double TokenBucket::take(unsigned long long bytes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (rate == 0) {
+		return 0;
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	tokens += std::chrono::duration<double>(now - lastRefill).count() * (double)rate;
+	if (tokens > (double)rate) {
+		tokens = (double)rate;
+	}
+	lastRefill = now;
+
+	//The bytes are taken now, so whoever comes next waits behind them
+	tokens -= (double)bytes;
+	return tokens < 0 ? -tokens / (double)rate : 0;
+}
+
+////////////////
+//   IOTHROTTLE
+////////////////
+
+IoThrottle::IoThrottle()
+	: changed(false), averageLatency(0), backoffSeconds(0) {
+	current = parseSettings("");
+}
+
+void IoThrottle::setControlFile(const std::string &path) {
+	std::lock_guard<std::mutex> lock(mutex);
+	controlFilePath = path;
+}
+
+bool IoThrottle::reloadControlFile() {
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		lastControlCheck = std::chrono::steady_clock::now();
+		path = controlFilePath;
+	}
+	if (path.empty()) {
+		return false;
+	}
+
+	std::string contents;
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (file.is_open()) {
+		std::ostringstream buffer;
+		buffer << file.rdbuf();
+		contents = buffer.str();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (contents == controlFileContents) {
+			return false;
+		}
+		controlFileContents = contents;
+	}
+
+	ThrottleSettings settings = parseSettings(contents);
+	if (sameSettings(settings, this->settings())) {
+		return false;
+	}
+	apply(settings);
+	return true;
+}
+
+void IoThrottle::apply(const ThrottleSettings &settings) {
+	readBucket.setRate(settings.readBytesPerSecond);
+	writeBucket.setRate(settings.writeBytesPerSecond);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	current = settings;
+	changed = true;
+	if (settings.latencyTargetMilliseconds == 0) {
+		backoffSeconds = 0;
+	}
+}
+
+ThrottleSettings IoThrottle::settings() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return current;
+}
+
+bool IoThrottle::settingsChanged() {
+	checkControlFile();
+	std::lock_guard<std::mutex> lock(mutex);
+	bool wasChanged = changed;
+	changed = false;
+	return wasChanged;
+}
+
+bool IoThrottle::limitsIo() {
+	checkControlFile();
+	std::lock_guard<std::mutex> lock(mutex);
+	return current.readBytesPerSecond > 0 || current.writeBytesPerSecond > 0
+		|| current.latencyTargetMilliseconds > 0;
+}
+
+void IoThrottle::afterRead(unsigned long long bytes) {
+	checkControlFile();
+	readBucket.consume(bytes);
+	pause();
+}
+
+void IoThrottle::beforeWrite(unsigned long long bytes) {
+	checkControlFile();
+	writeBucket.consume(bytes);
+	pause();
+}
+
+double IoThrottle::chargeWrite(unsigned long long bytes) {
+	checkControlFile();
+	return writeBucket.take(bytes);
+}
+
+void IoThrottle::recordLatency(double seconds) {
+	std::lock_guard<std::mutex> lock(mutex);
+	averageLatency = averageLatency == 0 ? seconds
+		: averageLatency * (1 - LATENCY_SMOOTHING) + seconds * LATENCY_SMOOTHING;
+
+	if (current.latencyTargetMilliseconds == 0) {
+		return;
+	}
+
+	//Back off quickly while the device is slow, and come back slowly
+	if (averageLatency * 1000.0 > current.latencyTargetMilliseconds) {
+		backoffSeconds = backoffSeconds < BACKOFF_MINIMUM_SECONDS ? BACKOFF_MINIMUM_SECONDS : backoffSeconds * 2;
+		if (backoffSeconds > BACKOFF_MAXIMUM_SECONDS) {
+			backoffSeconds = BACKOFF_MAXIMUM_SECONDS;
+		}
+	} else {
+		backoffSeconds *= 0.75;
+		if (backoffSeconds < BACKOFF_MINIMUM_SECONDS) {
+			backoffSeconds = 0;
+		}
+	}
+}
+
+unsigned int IoThrottle::compressionThreads() {
+	checkControlFile();
+	std::lock_guard<std::mutex> lock(mutex);
+	return current.compressionThreads;
+}
+
+void IoThrottle::checkControlFile() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (controlFilePath.empty() || secondsSince(lastControlCheck) < CONTROL_CHECK_SECONDS) {
+			return;
+		}
+	}
+	reloadControlFile();
+}
+
+void IoThrottle::pause() {
+	double seconds;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		seconds = backoffSeconds;
+	}
+	if (seconds > 0) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	}
+}
+
+////////////////
+//   COPYING
+////////////////
+
+bool throttledCopyFile(const std::string &sourcePath, const std::string &destinationPath, IoThrottle &throttle) {
+	std::vector<unsigned char> buffer(COPY_CHUNK_SIZE);
+	bool ok = true;
+
+#ifdef _WIN32
+	HANDLE source = CreateFileA(sourcePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (source == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	HANDLE destination = CreateFileA(destinationPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (destination == INVALID_HANDLE_VALUE) {
+		CloseHandle(source);
+		return false;
+	}
+
+	while (true) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		DWORD bytesRead = 0;
+		if (!ReadFile(source, &buffer[0], (DWORD)buffer.size(), &bytesRead, NULL)) {
+			ok = false;
+			break;
+		}
+		throttle.recordLatency(secondsSince(start));
+		if (bytesRead == 0) {
+			break;
+		}
+		throttle.afterRead(bytesRead);
+
+		throttle.beforeWrite(bytesRead);
+		start = std::chrono::steady_clock::now();
+		DWORD written = 0;
+		if (!WriteFile(destination, &buffer[0], bytesRead, &written, NULL) || written != bytesRead) {
+			ok = false;
+			break;
+		}
+		throttle.recordLatency(secondsSince(start));
+	}
+
+	FILETIME creationTime, accessTime, writeTime;
+	if (ok && GetFileTime(source, &creationTime, &accessTime, &writeTime)) {
+		SetFileTime(destination, &creationTime, &accessTime, &writeTime);
+	}
+	CloseHandle(source);
+	ok = CloseHandle(destination) != 0 && ok;
+#else
+	int source = open(sourcePath.c_str(), O_RDONLY);
+	if (source < 0) {
+		return false;
+	}
+	int destination = open(destinationPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (destination < 0) {
+		close(source);
+		return false;
+	}
+
+	while (true) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		ssize_t bytesRead = read(source, &buffer[0], buffer.size());
+		if (bytesRead < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytesRead < 0) {
+			ok = false;
+			break;
+		}
+		throttle.recordLatency(secondsSince(start));
+		if (bytesRead == 0) {
+			break;
+		}
+		throttle.afterRead((unsigned long long)bytesRead);
+
+		throttle.beforeWrite((unsigned long long)bytesRead);
+		start = std::chrono::steady_clock::now();
+		for (ssize_t offset = 0; offset < bytesRead; ) {
+			ssize_t written = write(destination, &buffer[offset], (size_t)(bytesRead - offset));
+			if (written < 0 && errno == EINTR) {
+				continue;
+			}
+			if (written <= 0) {
+				ok = false;
+				break;
+			}
+			offset += written;
+		}
+		if (!ok) {
+			break;
+		}
+		throttle.recordLatency(secondsSince(start));
+	}
+
+	struct stat status;
+	if (ok && fstat(source, &status) == 0) {
+		struct timespec times[2];
+		times[0] = status.st_atim;
+		times[1] = status.st_mtim;
+		futimens(destination, times);
+	}
+	close(source);
+	ok = close(destination) == 0 && ok;
+#endif
+
+	if (!ok) {
+		remove(destinationPath.c_str());
+	}
+	return ok;
+}
@@ -0,0 +1,113 @@
+// Archiver and Splitter
+// iothrottle.h
+// Limits how much disk bandwidth and CPU the program takes from everything else
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+//Limits, all adjustable while the program runs (0 = no limit)
+struct ThrottleSettings {
+	unsigned long long readBytesPerSecond;
+	unsigned long long writeBytesPerSecond;
+	//Threads compressing at once: blocks in flight in the built-in
+	//compressor, and 7-Zip's -mmt
+	unsigned int compressionThreads;
+	//Adaptive backoff: while reads and writes take longer than this on
+	//average, a growing pause is added before each one
+	unsigned int latencyTargetMilliseconds;
+};
+
+//Hands out bytes at a fixed rate.  Up to a second's worth can be saved up
+//for a burst; a request bigger than what is saved up leaves the bucket in
+//debt, and later requests wait until it is paid off.
+class TokenBucket {
+public:
+	TokenBucket();
+
+	//0 = no limit
+	void setRate(unsigned long long bytesPerSecond);
+
+	//Waits until the bytes may be used
+	void consume(unsigned long long bytes);
+	//Takes the bytes without waiting.  Returns how many seconds it will be
+	//until the bucket is out of debt (0 if it isn't in debt).
+	double take(unsigned long long bytes);
+
+private:
+	TokenBucket(const TokenBucket &);
+	TokenBucket &operator=(const TokenBucket &);
+
+	std::mutex mutex;
+	unsigned long long rate;
+	double tokens;
+	std::chrono::steady_clock::time_point lastRefill;
+};
+
+//Read and write limits plus adaptive backoff, with the settings taken from a
+//control file of "name = value" lines:
+//	read_bytes_per_second, write_bytes_per_second, compression_threads, latency_target_ms
+//The file is checked for changes every couple of seconds; deleting it takes
+//the limits away.
+class IoThrottle {
+public:
+	IoThrottle();
+
+	void setControlFile(const std::string &path);
+	//Rereads the control file if it has changed.  Returns true if the settings did.
+	bool reloadControlFile();
+
+	void apply(const ThrottleSettings &settings);
+	ThrottleSettings settings();
+
+	//True (once) if the settings changed since the last call
+	bool settingsChanged();
+
+	//True if any read or write limit (or the backoff) is on
+	bool limitsIo();
+
+	//Wait as long as the limits require.  Reads are charged once they have
+	//returned, with the bytes they actually read (a short last read costs
+	//only what it read, and the read that finds the end costs nothing);
+	//writes are charged before they start.
+	void afterRead(unsigned long long bytes);
+	void beforeWrite(unsigned long long bytes);
+
+	//Counts bytes another process (7-Zip) has already written against the
+	//write limit, without waiting.  Returns how many seconds that process
+	//should be held back to stay within the limit.
+	double chargeWrite(unsigned long long bytes);
+
+	//Reports how long one read or write took, for the adaptive backoff
+	void recordLatency(double seconds);
+
+	//0 = no cap
+	unsigned int compressionThreads();
+
+private:
+	IoThrottle(const IoThrottle &);
+	IoThrottle &operator=(const IoThrottle &);
+
+	void checkControlFile();
+	void pause();
+
+	TokenBucket readBucket;
+	TokenBucket writeBucket;
+
+	std::mutex mutex;
+	ThrottleSettings current;
+	bool changed;
+	//Smoothed time per read or write, and the pause the backoff adds, in seconds
+	double averageLatency;
+	double backoffSeconds;
+
+	std::string controlFilePath;
+	std::string controlFileContents;
+	std::chrono::steady_clock::time_point lastControlCheck;
+};
+
+//Copies a file in pieces, within the throttle's limits.  The copy keeps the
+//original's modification time, like CopyFile.
+bool throttledCopyFile(const std::string &sourcePath, const std::string &destinationPath, IoThrottle &throttle);
@@ -0,0 +1,437 @@
+// Archiver and Splitter
+// locatorindex.cpp
+
+#include "locatorindex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "utilities.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////
+//   FORMAT
+////////////////
+
+/*
+	All numbers are little-endian.
+
+	Header (64 bytes):
+		"ASLOCIDX", version, record size,
+		record count, records offset, archive count, archives offset,
+		strings offset, strings size
+
+	Records (48 bytes each, sorted by name hash):
+		name hash, entry offset, compressed size, uncompressed size,
+		name offset (in the strings), archive ID, CRC
+
+	Archives (16 bytes each, sorted by ID):
+		archive ID, (unused), name offset
+
+	Strings: names, each followed by a null
+*/
+
+namespace {
+
+const char LOCATOR_MAGIC[8] = {'A', 'S', 'L', 'O', 'C', 'I', 'D', 'X'};
+const uint32_t LOCATOR_VERSION = 1;
+const size_t LOCATOR_HEADER_SIZE = 64;
+const size_t LOCATOR_RECORD_SIZE = 48;
+const size_t LOCATOR_ARCHIVE_SIZE = 16;
+
+////////////////
+//   HELPERS
+////////////////
+
+void put32(std::vector<unsigned char> &buffer, uint32_t value) {
+	for (int i = 0; i < 4; i ++) {
+		buffer.push_back((unsigned char)(value >> (8 * i)));
+	}
+}
+
+void put64(std::vector<unsigned char> &buffer, unsigned long long value) {
+	put32(buffer, (uint32_t)value);
+	put32(buffer, (uint32_t)(value >> 32));
+}
+
+uint32_t get32(const unsigned char *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+unsigned long long get64(const unsigned char *p) {
+	return (unsigned long long)get32(p) | ((unsigned long long)get32(p + 4) << 32);
+}
+
+//FNV-1a of the name in lower case, so an index works the same wherever it
+//is read; the names themselves tell apart the ones that only differ in case
+unsigned long long nameHash(const std::string &normalizedName) {
+	unsigned long long hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < normalizedName.length(); i ++) {
+		unsigned char c = (unsigned char)normalizedName[i];
+		if (c >= 'A' && c <= 'Z') {
+			c = c - 'A' + 'a';
+		}
+		hash ^= c;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+struct SortedRecord {
+	unsigned long long hash;
+	size_t entryIndex;
+};
+
+bool compareSortedRecord(const SortedRecord &a, const SortedRecord &b) {
+	return a.hash < b.hash;
+}
+
+}
+
+std::string locatorNormalizeName(const std::string &name) {
+	std::string normalized;
+	normalized.reserve(name.length());
+	for (size_t i = 0; i < name.length(); i ++) {
+		char c = name[i];
+		if (c == '\\') {
+			c = '/';
+		}
+#ifdef _WIN32
+		if (c >= 'A' && c <= 'Z') {
+			c = c - 'A' + 'a';
+		}
+#endif
+		//No leading slashes
+		if (c == '/' && normalized.empty()) {
+			continue;
+		}
+		normalized += c;
+	}
+	return normalized;
+}
+
+////////////////
+//   WRITER
+////////////////
+
+void LocatorIndexWriter::addArchive(int archiveId, const std::string &archiveName) {
+	archives.push_back(std::make_pair(archiveId, archiveName));
+}
+
+void LocatorIndexWriter::addFile(int archiveId, const std::string &entryName, unsigned long long size) {
+	LocatorEntry entry;
+	entry.entryName = entryName;
+	entry.archiveId = archiveId;
+	entry.entryOffset = LOCATOR_UNKNOWN_OFFSET;
+	entry.compressedSize = 0;
+	entry.uncompressedSize = size;
+	entry.crc = 0;
+
+	entryLookup[itos(archiveId) + "/" + locatorNormalizeName(entryName)] = entries.size();
+	entries.push_back(entry);
+}
+
+void LocatorIndexWriter::setLocation(int archiveId, const std::string &entryName, unsigned long long entryOffset,
+									 unsigned long long compressedSize, unsigned long long uncompressedSize,
+									 uint32_t crc) {
+	std::unordered_map<std::string, size_t>::iterator found =
+		entryLookup.find(itos(archiveId) + "/" + locatorNormalizeName(entryName));
+	if (found == entryLookup.end()) {
+		return;
+	}
+
+	LocatorEntry &entry = entries[found->second];
+	entry.entryOffset = entryOffset;
+	entry.compressedSize = compressedSize;
+	entry.uncompressedSize = uncompressedSize;
+	entry.crc = crc;
+}
+
+bool LocatorIndexWriter::write(const std::string &indexPath) {
+	std::vector<SortedRecord> sorted(entries.size());
+	for (size_t i = 0; i < entries.size(); i ++) {
+		sorted[i].hash = nameHash(locatorNormalizeName(entries[i].entryName));
+		sorted[i].entryIndex = i;
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), compareSortedRecord);
+
+	std::vector<std::pair<int, std::string> > sortedArchives = archives;
+	std::sort(sortedArchives.begin(), sortedArchives.end());
+
+	unsigned long long recordsOffset = LOCATOR_HEADER_SIZE;
+	unsigned long long archivesOffset = recordsOffset + entries.size() * LOCATOR_RECORD_SIZE;
+	unsigned long long stringsOffset = archivesOffset + sortedArchives.size() * LOCATOR_ARCHIVE_SIZE;
+
+	std::vector<unsigned char> records;
+	std::vector<unsigned char> archiveTable;
+	std::string strings;
+	records.reserve(entries.size() * LOCATOR_RECORD_SIZE);
+
+	for (size_t i = 0; i < sorted.size(); i ++) {
+		const LocatorEntry &entry = entries[sorted[i].entryIndex];
+		put64(records, sorted[i].hash);
+		put64(records, entry.entryOffset);
+		put64(records, entry.compressedSize);
+		put64(records, entry.uncompressedSize);
+		put64(records, strings.length());
+		put32(records, (uint32_t)entry.archiveId);
+		put32(records, entry.crc);
+		strings += entry.entryName;
+		strings += '\0';
+	}
+
+	for (size_t i = 0; i < sortedArchives.size(); i ++) {
+		put32(archiveTable, (uint32_t)sortedArchives[i].first);
+		put32(archiveTable, 0);
+		put64(archiveTable, strings.length());
+		strings += sortedArchives[i].second;
+		strings += '\0';
+	}
+
+	std::vector<unsigned char> header(LOCATOR_MAGIC, LOCATOR_MAGIC + sizeof(LOCATOR_MAGIC));
+	put32(header, LOCATOR_VERSION);
+	put32(header, (uint32_t)LOCATOR_RECORD_SIZE);
+	put64(header, entries.size());
+	put64(header, recordsOffset);
+	put64(header, sortedArchives.size());
+	put64(header, archivesOffset);
+	put64(header, stringsOffset);
+	put64(header, strings.length());
+
+	//Readers (locate on a set that is still being made) keep the old index
+	//until the new one is complete and renamed over it
+	std::string temporaryPath = indexPath + ".tmp";
+	std::ofstream file(temporaryPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+	file.write((const char *)&header[0], header.size());
+	if (!records.empty()) {
+		file.write((const char *)&records[0], records.size());
+	}
+	if (!archiveTable.empty()) {
+		file.write((const char *)&archiveTable[0], archiveTable.size());
+	}
+	file.write(strings.data(), strings.length());
+	file.close();
+
+#ifdef _WIN32
+	bool replaced = !file.fail() && MoveFileExA(temporaryPath.c_str(), indexPath.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	bool replaced = !file.fail() && rename(temporaryPath.c_str(), indexPath.c_str()) == 0;
+#endif
+	if (!replaced) {
+		remove(temporaryPath.c_str());
+	}
+	return replaced;
+}
+
+size_t LocatorIndexWriter::fileCount() const {
+	return entries.size();
+}
+
+////////////////
+//   READER
+////////////////
+
+LocatorIndex::LocatorIndex()
+	: data(NULL), size(0),
+#ifdef _WIN32
+	fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL),
+#else
+	fileDescriptor(-1),
+#endif
+	recordCount(0), recordsOffset(0), archiveCount(0), archivesOffset(0), stringsOffset(0), stringsSize(0) {
+}
+
+LocatorIndex::~LocatorIndex() {
+	close();
+}
+
+bool LocatorIndex::open(const std::string &indexPath) {
+	close();
+
+#ifdef _WIN32
+	//Sharing delete lets the writer rename a new index over this one
+	fileHandle = CreateFileA(indexPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	LARGE_INTEGER fileSize;
+	if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize)) {
+		error = "Could not open " + indexPath;
+		close();
+		return false;
+	}
+	size = (unsigned long long)fileSize.QuadPart;
+	if (size >= LOCATOR_HEADER_SIZE) {
+		mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mappingHandle != NULL) {
+			data = (const unsigned char *)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+#else
+	fileDescriptor = ::open(indexPath.c_str(), O_RDONLY);
+	struct stat st;
+	if (fileDescriptor < 0 || fstat(fileDescriptor, &st) != 0) {
+		error = "Could not open " + indexPath;
+		close();
+		return false;
+	}
+	size = (unsigned long long)st.st_size;
+	if (size >= LOCATOR_HEADER_SIZE) {
+		void *mapped = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+		if (mapped != MAP_FAILED) {
+			data = (const unsigned char *)mapped;
+		}
+	}
+#endif
+
+	if (data == NULL || memcmp(data, LOCATOR_MAGIC, sizeof(LOCATOR_MAGIC)) != 0
+		|| get32(data + 8) != LOCATOR_VERSION || get32(data + 12) != LOCATOR_RECORD_SIZE) {
+		error = indexPath + " is not a locator index";
+		close();
+		return false;
+	}
+
+	recordCount = get64(data + 16);
+	recordsOffset = get64(data + 24);
+	archiveCount = get64(data + 32);
+	archivesOffset = get64(data + 40);
+	stringsOffset = get64(data + 48);
+	stringsSize = get64(data + 56);
+
+	if (recordsOffset + recordCount * LOCATOR_RECORD_SIZE > size
+		|| archivesOffset + archiveCount * LOCATOR_ARCHIVE_SIZE > size
+		|| stringsOffset + stringsSize > size) {
+		error = indexPath + " is damaged";
+		close();
+		return false;
+	}
+	return true;
+}
+
+void LocatorIndex::close() {
+#ifdef _WIN32
+	if (data != NULL) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle != NULL) {
+		CloseHandle(mappingHandle);
+		mappingHandle = NULL;
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (data != NULL) {
+		munmap((void *)data, (size_t)size);
+	}
+	if (fileDescriptor >= 0) {
+		::close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+#endif
+	data = NULL;
+	size = 0;
+	recordCount = 0;
+	archiveCount = 0;
+}
+
+std::string LocatorIndex::stringAt(unsigned long long offset) const {
+	if (offset >= stringsSize) {
+		return "";
+	}
+	const char *start = (const char *)data + stringsOffset + offset;
+	const char *end = (const char *)memchr(start, 0, (size_t)(stringsSize - offset));
+	return end == NULL ? std::string(start, (size_t)(stringsSize - offset)) : std::string(start, end);
+}
+
+bool LocatorIndex::archiveName(int archiveId, std::string &name) const {
+	unsigned long long low = 0;
+	unsigned long long high = archiveCount;
+	while (low < high) {
+		unsigned long long middle = low + (high - low) / 2;
+		const unsigned char *archive = data + archivesOffset + middle * LOCATOR_ARCHIVE_SIZE;
+		int middleId = (int)get32(archive);
+		if (middleId == archiveId) {
+			name = stringAt(get64(archive + 8));
+			return true;
+		}
+		if (middleId < archiveId) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return false;
+}
+
+bool LocatorIndex::find(const std::string &entryName, LocatorEntry &entry) const {
+	if (data == NULL) {
+		return false;
+	}
+
+	std::string normalized = locatorNormalizeName(entryName);
+	unsigned long long hash = nameHash(normalized);
+
+	//First record with this hash
+	unsigned long long low = 0;
+	unsigned long long high = recordCount;
+	while (low < high) {
+		unsigned long long middle = low + (high - low) / 2;
+		if (get64(data + recordsOffset + middle * LOCATOR_RECORD_SIZE) < hash) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	//Different names can share a hash, so check the names too
+	for (; low < recordCount; low ++) {
+		const unsigned char *record = data + recordsOffset + low * LOCATOR_RECORD_SIZE;
+		if (get64(record) != hash) {
+			break;
+		}
+
+		if (locatorNormalizeName(stringAt(get64(record + 32))) == normalized) {
+			readRecord(record, entry);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LocatorIndex::entry(unsigned long long index, LocatorEntry &entry) const {
+	if (data == NULL || index >= recordCount) {
+		return false;
+	}
+	readRecord(data + recordsOffset + index * LOCATOR_RECORD_SIZE, entry);
+	return true;
+}
+
+void LocatorIndex::readRecord(const unsigned char *record, LocatorEntry &entry) const {
+	entry.entryName = stringAt(get64(record + 32));
+	entry.entryOffset = get64(record + 8);
+	entry.compressedSize = get64(record + 16);
+	entry.uncompressedSize = get64(record + 24);
+	entry.archiveId = (int)get32(record + 40);
+	entry.crc = get32(record + 44);
+	entry.archiveName = "";
+	archiveName(entry.archiveId, entry.archiveName);
+}
+
+unsigned long long LocatorIndex::fileCount() const {
+	return recordCount;
+}
+
+const std::string &LocatorIndex::errorMessage() const {
+	return error;
+}
@@ -0,0 +1,108 @@
+// Archiver and Splitter
+// locatorindex.h
+// Sidecar index that finds the archive (and the offset in it) holding a file
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+//Offset of files whose position in their archive isn't known (7z archives,
+//or archives that weren't made).  Only the archive is known for those.
+#define LOCATOR_UNKNOWN_OFFSET 0xFFFFFFFFFFFFFFFFull
+
+//What the index knows about one file
+struct LocatorEntry {
+	//Name inside the archive, as it was added
+	std::string entryName;
+	int archiveId;
+	//Archive path, relative to the directory the index is in
+	std::string archiveName;
+	//Offset of the entry's local header in a ZIP archive (or LOCATOR_UNKNOWN_OFFSET)
+	unsigned long long entryOffset;
+	unsigned long long compressedSize;
+	unsigned long long uncompressedSize;
+	uint32_t crc;
+};
+
+//Names are compared with either kind of slash, case-insensitively only on
+//Windows (elsewhere a.txt and A.txt can both be in a set)
+std::string locatorNormalizeName(const std::string &name);
+
+//Collects the files during a run and writes the index at the end.
+//The index is a table of fixed-size records sorted by the hash of the file
+//name, so it can be memory-mapped and searched without reading it first.
+class LocatorIndexWriter {
+public:
+	void addArchive(int archiveId, const std::string &archiveName);
+
+	//Adds a file to an archive, before its position in it is known
+	void addFile(int archiveId, const std::string &entryName, unsigned long long size);
+
+	//Fills in where a file ended up.  Files the index doesn't have are ignored.
+	void setLocation(int archiveId, const std::string &entryName, unsigned long long entryOffset,
+					 unsigned long long compressedSize, unsigned long long uncompressedSize, uint32_t crc);
+
+	//Written next to indexPath and renamed over it, so a reader never sees
+	//half of it
+	bool write(const std::string &indexPath);
+
+	size_t fileCount() const;
+
+private:
+	std::vector<LocatorEntry> entries;
+	//Archive ID and normalized name -> index in entries
+	std::unordered_map<std::string, size_t> entryLookup;
+	std::vector<std::pair<int, std::string> > archives;
+};
+
+//A written index, memory-mapped for lookups
+class LocatorIndex {
+public:
+	LocatorIndex();
+	~LocatorIndex();
+
+	bool open(const std::string &indexPath);
+	void close();
+
+	//Binary search on the name hash; returns false if the file isn't in the index
+	bool find(const std::string &entryName, LocatorEntry &entry) const;
+
+	//Gets the files one by one (in hash order), for going through all of them
+	bool entry(unsigned long long index, LocatorEntry &entry) const;
+
+	unsigned long long fileCount() const;
+	const std::string &errorMessage() const;
+
+private:
+	LocatorIndex(const LocatorIndex &);
+	LocatorIndex &operator=(const LocatorIndex &);
+
+	void readRecord(const unsigned char *record, LocatorEntry &entry) const;
+	std::string stringAt(unsigned long long offset) const;
+	bool archiveName(int archiveId, std::string &name) const;
+
+	const unsigned char *data;
+	unsigned long long size;
+#ifdef _WIN32
+	HANDLE fileHandle;
+	HANDLE mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+	unsigned long long recordCount;
+	unsigned long long recordsOffset;
+	unsigned long long archiveCount;
+	unsigned long long archivesOffset;
+	unsigned long long stringsOffset;
+	unsigned long long stringsSize;
+
+	std::string error;
+};
@@ -13,7 +13,6 @@
 
 #include <iostream>
 
-//Finding files in directories
 #include <Windows.h>
 #include <stdio.h>
 #include <tchar.h>
@@ -32,62 +31,43 @@
 //Working directory
 #include <direct.h>
 
-//Sorting
-#include <algorithm>
-
 //Making directories
 #include <ShlObj.h>
 
-//Finding the directory of a file
-#include <Shlwapi.h>
-#pragma comment(lib,"shlwapi.lib")
+//The splitter itself
+#include "splitter.h"
+#include "utilities.h"
 
-////////////////
-//   STRUCTS
-////////////////
+//Running 7-Zip
+#include "process.h"
 
-//Contains the data for one file
-struct FileInformationPiece {
-	std::string fileName;
-	//long long = __int64
-	long long fileSize;
-};
+//Finding and extracting single files
+#include "locatorindex.h"
+#include "zipreader.h"
 
-//Contains a list of FileInformationPieces
-struct FileInformation {
-	/*std::vector<std::string> fileNames;
-	std::vector<long long> fileSizes;*/
-	std::vector<FileInformationPiece> files;
-};
+//Restoring a set of archives
+#include "archiverestore.h"
+#include "threadpool.h"
 
 ////////////////
-//   CONSTANTS
+//   GLOBALS
 ////////////////
 
-#define ARCHIVE_FILE_TYPE_7Z 0
-#define ARCHIVE_FILE_TYPE_ZIP 1
+//Ctrl+C stops the run (the summary and the locator index are still written)
+CancellationToken consoleCancel;
 
 ////////////////
 //   FUNCTIONS
 ////////////////
-void FileFindAllFilesInAllSubdirectories(std::string directory,
-										 FileInformation &fileInfo);
-bool FileExists(std::string filename);
 int workingDirectorySet(std::string dir);
 std::string workingDirectoryGet();
 std::string getFileOpenDialog(char* nullSeperatedFilter, char* initialDirectory);
-bool compareFileInformationPiece(const FileInformationPiece &a,
-								 const FileInformationPiece &b);
-void stringReplaceAll(std::string &s, const std::string &search, const std::string &replace);
-std::string itos(int i);
-std::string getFormattedSizeTitle(long long size);
-std::string getTempDirectory();
-int filenameGetProperty(std::string filename, std::string &propertyBuffer, unsigned int propertyValue);
-void clearTempDirectory(std::string tempDirectory);
-std::string dtos(double i);
-double floorDoubleAt(double db, double roundTo);
-void padWithZeroes(std::string &num, unsigned int minimumNumberLength);
-std::string stringRemoveIncluding(std::string fullString, std::string beginningString);
+void printProgress(const ProgressEvent &event);
+BOOL WINAPI consoleControlHandler(DWORD controlType);
+int commandLocate(int argc, char *argv[], std::string locatorIndexFilename);
+int commandExtractOne(int argc, char *argv[], std::string locatorIndexFilename, std::string sevenZipFile);
+int commandRestore(int argc, char *argv[], std::string locatorIndexFilename, std::string sevenZipFile,
+				   unsigned int archivesAtOnce);
 
 ////////////////
 //   MAIN
@@ -105,69 +85,79 @@ std::string stringRemoveIncluding(std::string fullString, std::string beginningS
 	file type - "zip" or "7z" is acceptable, case-sensitive.
 	password - The password to use.
 	maximum file size - The maximum file size of an archive in bytes.
-	compress files - "compression" to compress, "nocompression" not to compress the files
+	compress files - "compression" to compress, "nocompression" not to compress the files, "compression_parallel"
+		to compress ZIP files with the built-in multi-threaded compressor.  "deadline=<seconds>" or
+		"throughput=<bytes per second>" picks the compression level of each archive from how fast the archives
+		before it were made, so the whole run finishes in time with as much compression as that leaves room for
+		(ZIP files are made by the built-in compressor then).
 	arrange by size - If this is enabled, the program will try to arrange the files so that they fit snugly in
 		an arrangement that keeps the final file size closest to the maximum file size.  The original file order
-		is not preserved.  "arrange_default" and "arrange_fitsize" are accepted.
+		is not preserved.  "arrange_default" and "arrange_fitsize" are accepted.  "arrange_stable" keeps the file
+		order, but ends each archive where a hash of the files' names and sizes says to (between a quarter of the
+		maximum size and the maximum), so adding or removing a file only changes the archives next to it.  The
+		archives whose files haven't changed since the last run are kept instead of being made again.
 	start at - The archive number to start at.  All archives before this number are skipped.  This is useful if
 		you do not have enough space to archive all the files at once.
 	summary only - Only the summary file will be created (no archives produced) if this is "summary_only".
+	verify - "verify" to check each archive against its files once it is finished (in the background, while
+		the next archives are made).  Problems are listed at the end of the summary file.
+	watch - "watch" to keep running after the files that are there have been archived, and archive new files as
+		they are finished.  They are collected into an open archive that is made once it reaches the maximum file
+		size, or once it has been open for a while.  Stop it with Ctrl+C (the archives that are finished still go in
+		the summary and the locator index).
+	filter rules - A file of include and exclude rules, one per line: "include" or "exclude", a pattern (with '/'
+		between directories; '*' and '?' stay within a name, "**" spans directories; a pattern without a '/' matches
+		the name anywhere, and a trailing '/' only matches directories), then optionally size<N, size>N (K, M or G)
+		and age<N, age>N (time since modified, in s, m, h or d).  The last matching rule decides.  Excluded
+		directories aren't scanned at all.  How many entries each rule decided on goes in the summary.
+		e.g. "exclude .git/", "exclude build/cache/", "exclude *.tmp", "exclude *.log age>30d".
+
+	Throttling: if the output directory has a file named throttle.txt, its "name = value" lines limit the disk
+	and CPU the program uses (read_bytes_per_second, write_bytes_per_second, compression_threads and
+	latency_target_ms, where 0 is no limit).  The file is checked every couple of seconds while the program runs.
+	7-Zip is kept to the write limit by suspending it whenever the archive it is writing gets ahead of the limit.
+
+	Commands that use the locator index written next to the archives:
+
+	locate <output directory> <file> - Shows which archive holds a file (path relative to the input directory),
+		and where in the archive it is.
+	extract-one <output directory> <file> <destination directory> [password] - Extracts just that file.
+		From ZIP archives, only the file's own data is read.
+	restore <output directory> <destination directory> [password] [archives at once] - Extracts every archive
+		into the original directory layout, several archives at a time.
 */
 
-int main(int argc, char *argv[]) {
-
-	std::string sevenZipFile = "7za.exe";
-	std::string summaryFilename = "summary.txt";
-	std::string tempDirectoryName = "archiver_splitter";
-
-	//If this option is enabled, files will be compressed (slower)
-	//Otherwise, files will only be stored in the archive (faster)
-	bool compressFiles = false;
 
-	//If this option is enabled, the order of the files will remain the
-	//same, so files will not be grouped together based on their file size
-	//If this option is disabled, the order will try to fit the files
-	//together nicely
-	bool preserveFileOrder = true;
-
-	//In the naming convention below, --> +ID_HERE+ <-- will be replaced with the ID
-	//of the archive file.
-	std::string namingConvention = "+ID_HERE+.7z";
-
-	//The minimum number of digits for the ID to use
-	//--Padding Amount--    --ID--    --Result--
-	//        4               16         0016
-	//        3               2          002
-	//        1               16         16
-	int idStringPaddingAmount = 4;
-
-	//If this option is enabled, the program will make a summary file detailing
-	//the files in each archive
-	bool makeSummaryFile = true;
-
-	//If the option is enabled, the program will only make the summary file
-	bool onlyMakeSummaryFile = false;
-
-	//If this option is 0, the summary will include only the names of the files.
-	//If it is 1, the summary will also include approximated file sizes.
-	int summaryDetailLevel = 1;
+int main(int argc, char *argv[]) {
 
-	//Make sure that this has no spaces
-	std::string password = "";
+	//Settings of the run; see SplitterOptions for what each one does
+	SplitterOptions options;
 
-	//Maximum archive file size = 1 GiB
-	long long maxFileSize = 1024 * 1024 * 1024;
+	//Number of archives restored at once onto the destination drive.  More
+	//keeps a fast drive busy; fewer avoids seeking back and forth on a hard drive.
+	unsigned int restoreArchivesAtOnce = 4;
 
 	//The directory that the application is in
 	std::string applicationDirectory = workingDirectoryGet();
 
-	if (!FileExists(sevenZipFile)) {
-		std::cout << sevenZipFile << " could not be found.  Please locate"
+	//Commands that use the locator index of an existing set of archives
+	if (argc >= 2 && std::string(argv[1]) == "locate") {
+		return commandLocate(argc, argv, options.locatorIndexFilename);
+	}
+	if (argc >= 2 && std::string(argv[1]) == "extract-one") {
+		return commandExtractOne(argc, argv, options.locatorIndexFilename, options.sevenZipFile);
+	}
+	if (argc >= 2 && std::string(argv[1]) == "restore") {
+		return commandRestore(argc, argv, options.locatorIndexFilename, options.sevenZipFile, restoreArchivesAtOnce);
+	}
+
+	if (!FileExists(options.sevenZipFile)) {
+		std::cout << options.sevenZipFile << " could not be found.  Please locate"
 			<< " the 7-Zip command-line executable." << std::endl;
 		std::cin.get();
-		sevenZipFile = getFileOpenDialog("Applications (*.exe)\0*.exe",NULL);
-		if (!FileExists(sevenZipFile)) {
-			std::cout << sevenZipFile << " could not be found."
+		options.sevenZipFile = getFileOpenDialog("Applications (*.exe)\0*.exe",NULL);
+		if (!FileExists(options.sevenZipFile)) {
+			std::cout << options.sevenZipFile << " could not be found."
 				<< std::endl;
 			std::cin.get();
 			return 0;
@@ -175,41 +165,41 @@ int main(int argc, char *argv[]) {
 	}
 
 	workingDirectorySet(applicationDirectory);
-
-	std::string sevenZipFileFormatted = "\"" + sevenZipFile + "\"";
-
-	//FileInformation object used to find files
-	FileInformation fileInfo;
-
-	//Find all the files in the given directory
-	std::string directory = "";
-
-	std::string output_directory = "";
-
-	//Get the output file type
-	int output_file_type = ARCHIVE_FILE_TYPE_7Z;
-
-	//Archive number to start at (skipping the ones before it)
-	int archiveToStartAt = 0;
+	options.workingDirectory = applicationDirectory;
 
 	//Make sure the required number of arguments exists
 	if (!IS_DEBUG_APPLICATION) {
 		if (argc < 3) {
 			std::cout << "Usage: " << argv[0] << " <input dir> <output_dir> [namingConvention]"
 				<< " [file type] [password] [maxFileSize] [compressFiles] [arrangeFilesBySize] [start-at] [summaryOnly]"
-				<< std::endl;
+				<< " [verify] [watch] [filterRules]" << std::endl;
 			std::cout << "Leave any argument blank (\"\") to use its default." << std::endl;
 			std::cout << " - namingConvention: e.g. \"MyArchives_+ID_HERE+.7z\"" << std::endl;
 			std::cout << " - file type: \"7z\" or \"zip\"" << std::endl;
 			std::cout << " - password: plaintext password or \"\" for no password." << std::endl;
 			std::cout << " - maxFileSize: the maximum total file size in bytes of the files used in each archive" << std::endl;
-			std::cout << " - compressFiles: \"compression\" or \"nocompression\"" << std::endl;
-			std::cout << " - arrangeFilesBySize: \"arrange_default\" (in order) or \"arrange_fitsize\" for the fewest number"
-				<< " of archives created." << std::endl;
+			std::cout << " - compressFiles: \"compression\", \"nocompression\" or \"compression_parallel\""
+				<< " (built-in multi-threaded compressor, zip only)" << std::endl;
+			std::cout << "   or \"deadline=<seconds>\" / \"throughput=<bytes per second>\" to pick the level of each archive"
+				<< " so the run finishes in time." << std::endl;
+			std::cout << " - arrangeFilesBySize: \"arrange_default\" (in order), \"arrange_fitsize\" for the fewest number"
+				<< " of archives created," << std::endl;
+			std::cout << "   or \"arrange_stable\" (in order, keeping the archives whose files haven't changed since the last run)."
+				<< std::endl;
 			std::cout << " - start-at: the archive number to start at (skipping the creation of previous ones), e.g. \"4\""
 				<< " (or \"1\" to do a complete run through)." << std::endl;
 			std::cout << " - summaryOnly: only the summary file will be created (no archives produced) if this is \"summary_only\"."
 				<< std::endl;
+			std::cout << " - verify: \"verify\" to check every archive after it is made (in parallel with the next ones)."
+				<< std::endl;
+			std::cout << " - watch: \"watch\" to keep running and archive new files as they arrive (stop with Ctrl+C)."
+				<< std::endl;
+			std::cout << " - filterRules: a file of \"include|exclude <pattern> [size<N] [size>N] [age<N] [age>N]\" lines,"
+				<< " e.g. \"exclude .git/\" (the last matching rule decides)." << std::endl;
+			std::cout << "Or: " << argv[0] << " locate <output_dir> <file>" << std::endl;
+			std::cout << "Or: " << argv[0] << " extract-one <output_dir> <file> <destination_dir> [password]" << std::endl;
+			std::cout << "Or: " << argv[0] << " restore <output_dir> <destination_dir> [password] [archives_at_once]"
+				<< std::endl;
 			return 0;
 		}
 	}
@@ -225,32 +215,32 @@ int main(int argc, char *argv[]) {
 			//Input directory
 		case 1:
 			{
-				directory = argv[i];
+				options.inputDirectory = argv[i];
 				break;
 			}
 			//Output directory
 		case 2:
 			{
-				output_directory = argv[i];
+				options.outputDirectory = argv[i];
 				break;
 			}
 		case 3:
 			{
-				namingConvention = argv[i];
+				options.namingConvention = argv[i];
 				break;
 			}
 		case 4:
 			{
 				if (std::string(argv[i]) == "7z") {
-					output_file_type = ARCHIVE_FILE_TYPE_7Z;
+					options.archiveType = ARCHIVE_FILE_TYPE_7Z;
 				} else if (std::string(argv[i]) == "zip") {
-					output_file_type = ARCHIVE_FILE_TYPE_ZIP;
+					options.archiveType = ARCHIVE_FILE_TYPE_ZIP;
 				}
 				break;
 			}
 		case 5:
 			{
-				password = argv[i];
+				options.password = argv[i];
 				break;
 			}
 		case 6:
@@ -265,24 +255,48 @@ int main(int argc, char *argv[]) {
 					return 0;
 				}
 
-				maxFileSize = val;
+				options.maxFileSize = val;
 				break;
 			}
 		case 7:
 			{
 				if (std::string(argv[i]) == "compression") {
-					compressFiles = true;
+					options.compressFiles = true;
 				} else if (std::string(argv[i]) == "nocompression") {
-					compressFiles = false;
+					options.compressFiles = false;
+				} else if (std::string(argv[i]) == "compression_parallel") {
+					options.compressFiles = true;
+					options.useBuiltinCompressor = true;
+				} else if (std::string(argv[i]).find("deadline=") == 0 || std::string(argv[i]).find("throughput=") == 0) {
+					std::string argument = argv[i];
+					std::stringstream sstr(argument.substr(argument.find('=') + 1));
+					double val;
+					sstr >> val;
+					if (sstr.fail() || val <= 0) {
+						std::cout << "ERROR: Error parsing the compression target.  " << argv[i]
+							<< " does not end in a valid number." << std::endl;
+						std::cin.get();
+						return 0;
+					}
+
+					options.compressFiles = true;
+					if (argument.find("deadline=") == 0) {
+						options.compressionDeadlineSeconds = val;
+					} else {
+						options.compressionTargetBytesPerSecond = val;
+					}
 				}
 				break;
 			}
 		case 8:
 			{
 				if (std::string(argv[i]) == "arrange_default") {
-					preserveFileOrder = true;
+					options.packingMode = PACK_IN_ORDER;
 				} else if (std::string(argv[i]) == "arrange_fitsize") {
-					preserveFileOrder = false;
+					options.packingMode = PACK_FIT_SIZE;
+				} else if (std::string(argv[i]) == "arrange_stable") {
+					options.packingMode = PACK_STABLE;
+					options.skipUnchangedArchives = true;
 				}
 				break;
 			}
@@ -299,305 +313,56 @@ int main(int argc, char *argv[]) {
 					return 0;
 				}
 
-				archiveToStartAt = val;
+				options.archiveToStartAt = val;
 				break;
 			}
 		case 10:
 			{
 				//If the program only should make the summary file
 				if (std::string(argv[i]) == "summary_only") {
-					onlyMakeSummaryFile = true;
+					options.onlyMakeSummaryFile = true;
 				}
+				break;
 			}
-		}
-	}
-
-	//Make sure the output directory already exists, and if not, create it
-	SHCreateDirectoryEx(NULL,output_directory.c_str(),NULL);
-
-	//Format the naming convention
-	namingConvention = "\"" + output_directory + namingConvention + "\"";
-
-	std::string directory_directoryRepresentation = directory;
-	if (filenameGetProperty(directory, directory_directoryRepresentation, 1) != ERROR_SUCCESS) {
-		std::cout << "Error parsing directory... Carrying on..." << std::endl;
-	}
-	
-	FileFindAllFilesInAllSubdirectories(directory, fileInfo);
-
-	/////////////////////
-	//Make summary file
-	/////////////////////
-	std::ofstream summaryFile;
-
-	if (makeSummaryFile) {
-		//Create summary file
-		summaryFile.open(output_directory + summaryFilename, std::ios::out);
-	}
-	
-	//////////////////////////////////////////////////////
-	//Make groups of files and use 7-Zip to archive them
-	//////////////////////////////////////////////////////
-
-	//Sort vector (greatest to least) ~ Do not sort this if the user does not want that
-	if (!preserveFileOrder) {
-		std::sort(fileInfo.files.begin(), fileInfo.files.end(), compareFileInformationPiece);
-	}
-
-	int currentArchiveId = 1;
-
-	//Find a temporary directory
-	std::string tempDirectory = getTempDirectory() + tempDirectoryName;
-
-	//Delete it if it already exists
-	clearTempDirectory(tempDirectory);
-
-	int totalFiles = fileInfo.files.size();
-
-	std::cout << "Total files found: " << totalFiles << std::endl;
-
-	while (fileInfo.files.size() > 0) {
-		//Vector that holds all the files to add to this archive
-		std::vector<FileInformationPiece> currentArchiveFiles;
-
-		long long currentArchiveFileSize = 0;
-
-		//Loop through all file sizes and find the ones that fit into
-		//the max file size
-		unsigned int filesInArchive = 0;
-		for (unsigned int i = 0; i < fileInfo.files.size(); i ++) {
-			//If the file fits or it's the largest file,
-			//add it to the archive
-			if (fileInfo.files[i].fileSize
-				+ currentArchiveFileSize < maxFileSize ||
-				(i == 0 && filesInArchive == 0)) {
-
-				//Add to current list
-				currentArchiveFiles.push_back(fileInfo.files[i]);
-				//Add to the current archive file size
-				currentArchiveFileSize += fileInfo.files[i].fileSize;
-
-				//Tell the user that the file is greater than
-				//the maximum archive size
-				if (i == 0 && fileInfo.files[i].fileSize >
-					maxFileSize) {
-					std::cout << fileInfo.files[i].fileName << "("
-						<< getFormattedSizeTitle(fileInfo.files[i].fileSize)
-						<< ") was"
-						<< " added to its own archive, although it is greater than"
-						<< " the maximum archive size." << std::endl;
-				}
-				//Delete it and change the current position on the
-				//loop only if this is ordered by file size.
-				//If it is in the regular file order, it will be deleted later
-				//to save processing power.
-				if (!preserveFileOrder) {
-					fileInfo.files.erase(fileInfo.files.begin() + i);
-				}
-
-				//Update the window title
-				if (filesInArchive % 5 == 0) {
-					SetConsoleTitle((dtos(
-						floorDoubleAt((double)(totalFiles - fileInfo.files.size())/(double)(totalFiles),00.001) * 100.0)
-						+ "% completed.").c_str());
-				}
-
-				filesInArchive ++;
-
-				//Tell the user the progress in the console
-				if (filesInArchive % 20 == 0) {
-					std::cout << itos(filesInArchive)+ " files in archive list of archive #" + itos(currentArchiveId) + ".  Current"
-						+ " archive size: " + getFormattedSizeTitle(currentArchiveFileSize) << std::endl;
-				}
-
-				//To get through all files (because one was deleted),
-				//check the same index again if preserveFileOrder = false
-				if (fileInfo.files.size() > 0) {
-					if (!preserveFileOrder) {
-						i--;
-					}
-				}
-				//Or leave the loop if it is finished
-				else {
-					break;
+		case 11:
+			{
+				if (std::string(argv[i]) == "verify") {
+					options.verifyArchives = true;
 				}
-
-			} else if (preserveFileOrder) {
-				//Break here; we do not want to mess up the file order
 				break;
 			}
-		}
-
-		//Delete all the entries in this archive from the mega list if the files are ordered by name
-		if (preserveFileOrder && filesInArchive > 0) {
-			fileInfo.files.erase(fileInfo.files.begin(), fileInfo.files.begin() + filesInArchive);
-		}
-
-		if (currentArchiveFiles.size() > 0 && currentArchiveId >= archiveToStartAt) {
-			//Output total archive size
-			std::cout << itos(filesInArchive)+ " files in archive list of archive #" + itos(currentArchiveId) + ".  Total"
-						+ " archive size: " + getFormattedSizeTitle(currentArchiveFileSize) << std::endl;
-
-			//Set naming convention to get the archive filename
-			std::string namingConventionCurrent = namingConvention;
-			std::string idString = itos(currentArchiveId);
-			padWithZeroes(idString, idStringPaddingAmount);
-			stringReplaceAll(namingConventionCurrent, "+ID_HERE+", idString);
-
-			////////////////////////
-			//Make archive file list
-			////////////////////////
-
-			if (makeSummaryFile) {
-				//Add the current archive filename and the number of files in it
-				summaryFile << namingConventionCurrent << "\n" << currentArchiveFiles.size() << std::endl;
-			}
-
-			//Clear the temp directory
-			//Delete it if it already exists
-			clearTempDirectory(tempDirectory);
-
-			//Copy the file to the temp directory
-			for (unsigned int i = 0; i < currentArchiveFiles.size(); i ++) {
-
-				//Find the directory of the file and remove leading three characters (C:\)
-				std::string fullPath = currentArchiveFiles[i].fileName;
-
-				//Directory (with leading backslash)
-				std::string pathDir = "";
-
-				//Removed 12/2/2014 so that the folders do not include directories before the archiving directory
-				if (filenameGetProperty(fullPath, pathDir, 1) != 0) {
-					std::cout << "Error getting directory from " << fullPath << std::endl;
-				}
-                
-				//Added 12/2/2014
-				pathDir = stringRemoveIncluding(pathDir, directory_directoryRepresentation);
-
-				//Path to the new directory to create
-				std::string newPathDir = tempDirectory + "\\" + pathDir;
-
-				//Create the directory and ignore any "already existing" errors
-				int result = ERROR_SUCCESS;
-				
-				//Make the directory
-				if (!onlyMakeSummaryFile) {
-					SHCreateDirectoryEx(NULL, newPathDir.c_str(), NULL);
-				}
-
-				//Get the name of the file (without the path)
-				std::string pathFilename = "";
-				std::string pathFileExt = "";
-
-				//Get the full filename (filename + extension)
-				int err[2];
-				err[0] = filenameGetProperty(fullPath, pathFilename, 2);
-				err[1] = filenameGetProperty(fullPath, pathFileExt, 3);
-				for (unsigned int j = 0; j < 2; j++) {
-					if (err[j] != 0) {
-						std::cout << "Error getting filename/extension from " << fullPath << std::endl;
-					}
-				}
-
-				std::string pathFullFilename = pathFilename + pathFileExt;
-
-				//Something went wrong
-				if (result != ERROR_SUCCESS && result != ERROR_ALREADY_EXISTS
-					&& result != ERROR_FILE_EXISTS) {
-					//Tell the user that something went wrong
-					std::cout << "ERROR: Directory creation failed: " << newPathDir << std::endl;
-				}
-				//Success
-				else {
-					//Copy file to the directory
-					if (!onlyMakeSummaryFile) {
-						CopyFile(fullPath.c_str(),(newPathDir + pathFullFilename).c_str(), false);
-					}
-
-					//Output to summary file
-					if (makeSummaryFile) {
-						if (summaryDetailLevel >= 0) {
-							//Output relative filename
-							summaryFile << pathDir << pathFullFilename;
-						}
-						if (summaryDetailLevel >= 1) {
-							//Output file size
-							summaryFile << " (" << getFormattedSizeTitle(currentArchiveFiles[i].fileSize) << ")";
-						}
-						summaryFile << std::endl;
-					}
+		case 12:
+			{
+				if (std::string(argv[i]) == "watch") {
+					options.watchMode = true;
 				}
+				break;
 			}
-
-
-			//Close file
-			//fclose(fileList);
-
-			///////////////////////
-			//Send command to 7-Zip
-			///////////////////////
-
-			
-			//Tell user some information
-			std::cout << "Finished preparation for " << namingConventionCurrent << " Size: "
-				<< getFormattedSizeTitle(currentArchiveFileSize) << std::endl;
-
-			//Set the working directory to the application's directory
-			std::system(("cd " + workingDirectoryGet()).c_str());
-
-			//Build the command to send
-			std::string command = sevenZipFile + " a";
-
-			if (output_file_type == ARCHIVE_FILE_TYPE_7Z) {
-				command += " -t7z ";
-			} else if (output_file_type == ARCHIVE_FILE_TYPE_ZIP) {
-				command += " -tzip ";
-			}
-			
-			if (!onlyMakeSummaryFile) {
-				//command += "\"" + namingConventionCurrent + "\"";
-				command += namingConventionCurrent;
-
-				//Add the recursive option to store directories
-				command += " -r";
-
-				//Set the compression to zero if the user does not want compression
-				if (!compressFiles) {
-					command += " -mx=0";
-				}
-
-				//Add a password, if the user wants one
-				if (password != "") {
-					command += " -p" + password;
-					if (output_file_type == ARCHIVE_FILE_TYPE_7Z) {
-						command += " -mhe";
-					}
-				}
-
-				command += " " + tempDirectory + "\\*";
-
-				//Send the command to the system
-				std::system((command).c_str());
+		case 13:
+			{
+				options.filterRulesFile = argv[i];
+				break;
 			}
+		}
+	}
 
-			std::cout << "Finished creating archive #" << currentArchiveId << std::endl;
+	SetConsoleCtrlHandler(consoleControlHandler, TRUE);
 
-			//Pause if the escape key is pressed and the console window is on top
-			if (GetAsyncKeyState(VK_ESCAPE) && (GetConsoleWindow() == GetForegroundWindow())) {
-				std::cout << "Pausing... Press Enter to continue." << std::endl;
-				std::cin.get();
-			}
-		}
-		//Increment the current archive ID
-		currentArchiveId ++;
+	SplitterResult result = splitterRun(options, printProgress, consoleCancel);
+	if (!result.ok) {
+		std::cout << "ERROR: " << result.errorMessage << std::endl;
+		std::cin.get();
+		return 0;
+	}
 
+	if (result.cancelled) {
+		std::cout << "Stopped after " << result.archivesMade << " archives." << std::endl;
+		return 0;
 	}
 
-	//Close summary file
-	if (makeSummaryFile) {
-		summaryFile.close();
+	if (result.archivesReused > 0) {
+		std::cout << "Kept " << result.archivesReused << " archives whose files hadn't changed." << std::endl;
 	}
-	
 	std::cout << "All done archiving!" << std::endl;
 
 	std::cin.get();
@@ -607,157 +372,235 @@ int main(int argc, char *argv[]) {
 //   BEGIN FUNCTIONS IN CODE
 ////////////////
 
-//Removes everything up to and including the specified string
-std::string stringRemoveIncluding(std::string fullString, std::string beginningString) {
-	unsigned int position = fullString.find(beginningString);
-	if (position == std::string::npos) {
-		return fullString;
+//Prints the progress of a run, and keeps the window title up to date
+void printProgress(const ProgressEvent &event) {
+	switch (event.type) {
+	case PROGRESS_STATUS:
+		SetConsoleTitle(event.message.c_str());
+		return;
+	case PROGRESS_WARNING:
+		std::cout << "WARNING: " << event.message << std::endl;
+		break;
+	case PROGRESS_ERROR:
+		std::cout << "ERROR: " << event.message << std::endl;
+		break;
+	default:
+		std::cout << event.message << std::endl;
+		break;
 	}
 
-	return fullString.erase(0, position + beginningString.length());
+	//Pause if the escape key is pressed and the console window is on top
+	if (event.type == PROGRESS_ARCHIVE_STARTED && GetAsyncKeyState(VK_ESCAPE)
+		&& (GetConsoleWindow() == GetForegroundWindow())) {
+		std::cout << "Pausing... Press Enter to continue." << std::endl;
+		std::cin.get();
+	}
 }
 
-//Pads a string with zeroes until the length
-//reaches the minimum number length
-//Example: num = "45", minimumNumberLength = 4, RESULT = "0045"
-void padWithZeroes(std::string &num, unsigned int minimumNumberLength) {
-	while (num.length() < minimumNumberLength) {
-		num = "0" + num;
+//Ctrl+C and Ctrl+Break cancel the run instead of ending the program
+BOOL WINAPI consoleControlHandler(DWORD controlType) {
+	if (controlType == CTRL_C_EVENT || controlType == CTRL_BREAK_EVENT) {
+		consoleCancel.cancel();
+		return TRUE;
 	}
+	return FALSE;
 }
 
-void clearTempDirectory(std::string tempDirectory) {
-	//Delete it if it already exists
-	if (PathIsDirectory(tempDirectory.c_str())) {
-		SHFILEOPSTRUCT fileOperation;
-		fileOperation.hwnd = NULL;
-		fileOperation.wFunc = FO_DELETE;
+//locate <output directory> <file>
+int commandLocate(int argc, char *argv[], std::string locatorIndexFilename) {
+	if (argc < 4) {
+		std::cout << "Usage: " << argv[0] << " locate <output_dir> <file>" << std::endl;
+		return 1;
+	}
 
-		//Must be double null-terminated
-		char* tempDirectoryCstr = (char*)tempDirectory.c_str();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-		//Add the double nulls
-		int len = strlen(tempDirectoryCstr);
-		char* tempDirectoryCstr_doubleNull = new char[len+2];
-		strcpy_s (tempDirectoryCstr_doubleNull, len+2, tempDirectoryCstr);
-		tempDirectoryCstr_doubleNull[len] = 0;
-		tempDirectoryCstr_doubleNull[len+1] = 0;
+	LocatorIndex locatorIndex;
+	if (!locatorIndex.open(std::string(argv[2]) + locatorIndexFilename)) {
+		std::cout << "ERROR: " << locatorIndex.errorMessage() << std::endl;
+		return 1;
+	}
 
-		fileOperation.pFrom = tempDirectoryCstr_doubleNull;
-		fileOperation.pTo = NULL;
-		fileOperation.fFlags = FOF_NO_UI;
-		fileOperation.hNameMappings = NULL;
+	LocatorEntry entry;
+	if (!locatorIndex.find(argv[3], entry)) {
+		std::cout << argv[3] << " is not in any of the " << locatorIndex.fileCount() << " indexed files." << std::endl;
+		return 1;
+	}
 
-		fileOperation.fAnyOperationsAborted = FALSE;
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-		//Not used
-		fileOperation.lpszProgressTitle = "";
+	std::cout << entry.entryName << std::endl;
+	std::cout << " Archive #" << entry.archiveId << ": " << entry.archiveName << std::endl;
+	if (entry.entryOffset == LOCATOR_UNKNOWN_OFFSET) {
+		std::cout << " Offset: unknown (" << getFormattedSizeTitle(entry.uncompressedSize) << ")" << std::endl;
+	} else {
+		std::cout << " Offset: " << entry.entryOffset << " (" << getFormattedSizeTitle(entry.compressedSize)
+			<< " stored, " << getFormattedSizeTitle(entry.uncompressedSize) << " original)" << std::endl;
+	}
+	std::cout << " Found in " << dtos(floorDoubleAt(milliseconds, 0.01)) << " ms" << std::endl;
+	return 0;
+}
 
-		int err = SHFileOperation(&fileOperation);
-		if (err != ERROR_SUCCESS) {
-			std::cout << "ERROR on directory delete: " << err << std::endl;
-		}
+//extract-one <output directory> <file> <destination directory> [password]
+int commandExtractOne(int argc, char *argv[], std::string locatorIndexFilename, std::string sevenZipFile) {
+	if (argc < 5) {
+		std::cout << "Usage: " << argv[0] << " extract-one <output_dir> <file> <destination_dir> [password]" << std::endl;
+		return 1;
+	}
 
-		/*bool test = DeleteDirectory((char*)tempDirectory.c_str(), false);
-		std::cout << test << std::endl;*/
+	std::string outputDirectory = argv[2];
+	std::string destinationDirectory = argv[4];
+	std::string password = argc >= 6 ? argv[5] : "";
+
+	LocatorIndex locatorIndex;
+	if (!locatorIndex.open(outputDirectory + locatorIndexFilename)) {
+		std::cout << "ERROR: " << locatorIndex.errorMessage() << std::endl;
+		return 1;
 	}
-	
-	CreateDirectory(tempDirectory.c_str(),NULL);
-}
 
-/*
-	propertyValue:
-	0 - drive
-	1 - directory
-	2 - filename
-	3 - extension
+	LocatorEntry entry;
+	if (!locatorIndex.find(argv[3], entry)) {
+		std::cout << argv[3] << " is not in any of the " << locatorIndex.fileCount() << " indexed files." << std::endl;
+		return 1;
+	}
 
-	Returns 0 on success
-*/
-int filenameGetProperty(std::string filename, std::string &propertyBuffer, unsigned int propertyValue) {
-
-	char drive[_MAX_DRIVE];
-	char dir[_MAX_DIR];
-	char fname[_MAX_FNAME];
-	char ext[_MAX_EXT];
-	errno_t err;
-
-	char* filename_cstr = (char*) filename.c_str();
-
-	//Split filename
-	err = _splitpath_s(filename_cstr, drive, dir, fname, ext);
-	
-	//Success
-	if (err == 0) {
-		switch (propertyValue) {
-		case 0:
-			{
-				propertyBuffer = drive;
-			}
-			break;
-		case 1:
-			{
-				propertyBuffer = dir;
-			}
-			break;
-		case 2:
-			{
-				propertyBuffer = fname;
-			}
-			break;
-		case 3:
-			{
-				propertyBuffer = ext;
-			}
-			break;
-		default:
-			{
-				propertyBuffer = fname;
-			}
-			break;
+	std::string archivePath = outputDirectory + entry.archiveName;
+	SHCreateDirectoryEx(NULL, destinationDirectory.c_str(), NULL);
+
+	//Without an offset (7z archives), let 7-Zip find the file
+	if (entry.entryOffset == LOCATOR_UNKNOWN_OFFSET) {
+		std::vector<std::string> arguments;
+		arguments.push_back(sevenZipFile);
+		arguments.push_back("e");
+		arguments.push_back(archivePath);
+		arguments.push_back("-o" + destinationDirectory);
+		if (password != "") {
+			arguments.push_back("-p" + password);
 		}
-	} else {
-		return -1;
+		arguments.push_back("-y");
+		arguments.push_back(entry.entryName);
+
+		ChildProcess process;
+		if (!process.start(arguments, workingDirectoryGet())) {
+			std::cout << "ERROR: Could not start " << sevenZipFile << std::endl;
+			return 1;
+		}
+		process.wait(0);
+		const ProcessResult &result = process.result();
+		if (result.exitCode != 0) {
+			std::cout << "ERROR: 7-Zip could not extract " << entry.entryName << " from " << archivePath
+				<< ":" << std::endl << result.output << std::endl;
+			return 1;
+		}
+		std::cout << "Extracted " << entry.entryName << " from " << entry.archiveName << std::endl;
+		return 0;
 	}
-	return 0;
 
+	//ZIP archives: seek straight to the entry
+	std::string entryFilename = entry.entryName.substr(entry.entryName.find_last_of("/\\") + 1);
+	std::string destinationPath = destinationDirectory + entryFilename;
+
+	ZipEntryInfo info;
+	info.entryName = entry.entryName;
+	info.crc = entry.crc;
+	info.compressedSize = entry.compressedSize;
+	info.uncompressedSize = entry.uncompressedSize;
+	info.localHeaderOffset = entry.entryOffset;
+	info.method = 0;
+	info.encrypted = false;
+
+	ZipReader reader;
+	std::ofstream destination(destinationPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	bool ok = reader.open(archivePath) && destination.is_open()
+		&& reader.extractEntry(info, password, [&destination](const unsigned char *data, size_t size) {
+			destination.write((const char *)data, size);
+			return !destination.fail();
+		});
+	destination.close();
+
+	if (!ok) {
+		std::cout << "ERROR: Could not extract " << entry.entryName << " from " << archivePath << ": "
+			<< (destination.fail() ? "could not write " + destinationPath : reader.errorMessage()) << std::endl;
+		remove(destinationPath.c_str());
+		return 1;
+	}
+
+	std::cout << "Extracted " << entry.entryName << " from " << entry.archiveName << " to " << destinationPath << std::endl;
+	return 0;
 }
 
-//Finds a temporary directory to use
-std::string getTempDirectory() {
-	DWORD dirBufferSize = MAX_PATH + 1;
-	char* dirBuffer = new char[dirBufferSize];
+//restore <output directory> <destination directory> [password] [archives at once]
+int commandRestore(int argc, char *argv[], std::string locatorIndexFilename, std::string sevenZipFile,
+				   unsigned int archivesAtOnce) {
+	if (argc < 4) {
+		std::cout << "Usage: " << argv[0] << " restore <output_dir> <destination_dir> [password] [archives_at_once]"
+			<< std::endl;
+		return 1;
+	}
+
+	std::string outputDirectory = argv[2];
+	std::string destinationDirectory = argv[3];
+	std::string password = argc >= 5 ? argv[4] : "";
+	if (argc >= 6 && atoi(argv[5]) > 0) {
+		archivesAtOnce = atoi(argv[5]);
+	}
+
+	LocatorIndex locatorIndex;
+	if (!locatorIndex.open(outputDirectory + locatorIndexFilename)) {
+		std::cout << "ERROR: " << locatorIndex.errorMessage() << std::endl;
+		return 1;
+	}
 
-	GetTempPath(dirBufferSize, dirBuffer);
+	std::vector<RestoreArchivePlan> plans = restorePlanArchives(locatorIndex, outputDirectory);
+	std::cout << "Restoring " << locatorIndex.fileCount() << " files from " << plans.size() << " archives ("
+		<< archivesAtOnce << " at once)" << std::endl;
 
-	std::string dirString = dirBuffer;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	SHCreateDirectoryEx(NULL, destinationDirectory.c_str(), NULL);
 
-	delete[] dirBuffer;
+	//All the archives are queued at once; the pool size limits how many are worked on
+	ThreadPool restorePool(archivesAtOnce);
+	ArchiveRestorer restorer(restorePool, destinationDirectory, sevenZipFile, password);
+	for (unsigned int i = 0; i < plans.size(); i ++) {
+		restorer.submit(plans[i]);
+	}
 
-	return dirString;
-}
+	unsigned int archivesDone = 0;
+	unsigned int failedFiles = 0;
+	unsigned long long filesRestored = 0;
+	unsigned long long bytesRestored = 0;
+	while (archivesDone < plans.size()) {
+		std::vector<RestoreResult> results = restorer.collect(false);
+		for (unsigned int i = 0; i < results.size(); i ++) {
+			filesRestored += results[i].filesRestored;
+			bytesRestored += results[i].bytesRestored;
+			if (results[i].problems.empty()) {
+				std::cout << "Restored archive #" << results[i].archiveId << " (" << results[i].filesRestored
+					<< " files)" << std::endl;
+			} else {
+				std::cout << "ERROR: Problems restoring " << results[i].archiveName << ":" << std::endl;
+				for (unsigned int j = 0; j < results[i].problems.size(); j ++) {
+					std::cout << " " << results[i].problems[j] << std::endl;
+				}
+				failedFiles += results[i].problems.size();
+			}
+		}
+		archivesDone += results.size();
 
-//Replaces all 'search string' occurances in 's string' and replaces them with 'replace string'
-void stringReplaceAll(std::string &s, const std::string &search, const std::string &replace) {
-	for(size_t pos = 0; ; pos += replace.length()) {
-		// Locate the substring to replace
-		pos = s.find(search, pos);
-		if (pos == std::string::npos) {
-			break;
+		if (results.empty()) {
+			SetConsoleTitle(("Restoring: " + itos(archivesDone) + " of " + itos(plans.size()) + " archives").c_str());
+			Sleep(100);
 		}
-		// Replace by erasing and inserting
-		s.erase(pos, search.length());
-		s.insert(pos, replace);
 	}
-}
 
-//Use for sorting
-//Taken from
-//http://stackoverflow.com/questions/4892680/sorting-a-vector-of-structs
-bool compareFileInformationPiece(const FileInformationPiece &a,
-								 const FileInformationPiece &b) {
-	//sort from greatest to least
-	return a.fileSize > b.fileSize;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Restored " << filesRestored << " files (" << getFormattedSizeTitle(bytesRestored) << ") in "
+		<< dtos(floorDoubleAt(seconds, 0.1)) << " seconds";
+	if (failedFiles > 0) {
+		std::cout << ", with " << failedFiles << " problems";
+	}
+	std::cout << std::endl;
+	return failedFiles > 0 ? 1 : 0;
 }
 
 //Shows a file open dialog
@@ -803,142 +646,3 @@ int workingDirectorySet(std::string dir) {
 	return _chdir(dir.c_str());
 }
 
-//Checks if a file exists
-bool FileExists(std::string filename) {
-	std::ifstream ifile(filename);
-	return ifile;
-}
-
-//Returns -1 on error, 0 for normal
-int FileSize(std::string name, long long &file_size) {
-	WIN32_FILE_ATTRIBUTE_DATA fad;
-	if (!GetFileAttributesEx(name.c_str(), GetFileExInfoStandard, &fad)) {
-		return -1; // error condition, could call GetLastError to find out more
-	}
-	LARGE_INTEGER size;
-	size.HighPart = fad.nFileSizeHigh;
-	size.LowPart = fad.nFileSizeLow;
-	file_size = size.QuadPart;
-	return 0;
-}
-
-//Converts an integer to an std::string
-std::string itos(int i) {
-	std::ostringstream convert;
-	convert << i;
-	return convert.str();
-}
-
-//Converts a double to an std::string
-std::string dtos(double i) {
-	std::ostringstream convert;
-	convert << i;
-	return convert.str();
-}
-
-//Floors a double at a certain place
-//roundTo is the place to floor to
-//Example: number: 45.67 roundTo: 0.1 Output: 45.6
-double floorDoubleAt(double db, double roundTo) {
-	return (double)floor(db / roundTo) * roundTo;
-}
-
-//Returns a formatted file size
-//Updated 7/8/2014 to include a fixed decimal size (1 decimal place)
-std::string getFormattedSizeTitle(long long size) {
-
-	if (size < 1024) {
-		return itos(size) + " bytes";
-	} if (size < pow(1024,2)) {
-		std::ostringstream strs;
-		strs << std::fixed;
-		strs.precision(1);
-		strs << floorDoubleAt((double)size / 1024.0,0.1);
-		return strs.str() + " KiB";
-	} if (size < pow(1024,3)) {
-		std::ostringstream strs;
-		strs << std::fixed;
-		strs.precision(1);
-		strs << floorDoubleAt((double)size / (double)(pow(1024,2)),0.1);
-		return strs.str() + " MiB";
-	} else {
-		std::ostringstream strs;
-		strs << std::fixed;
-		strs.precision(1);
-		strs << floorDoubleAt((double)size / (double)(pow(1024,3)),0.1);
-		return strs.str() + " GiB";
-	}
-}
-
-void FileFindAllFilesInAllSubdirectories(std::string directory,
-										 FileInformation &fileInfo) {
-	//Used to find files
-	WIN32_FIND_DATA fileFindData;
-	//Handle to find files with
-	HANDLE hFind;
-	//Search path buffer (string to char*)
-	//Why not use more than MAX_PATH?
-	//[MAX_PATH];
-	char searchPath[1024];
-
-	//Put the string in searchPath
-	sprintf_s(searchPath, "%s*.*", directory.c_str());
-
-	//Find the first file
-	hFind = ::FindFirstFile(searchPath, &fileFindData);
-
-	//Make sure it's not invalid
-	if (hFind != INVALID_HANDLE_VALUE) {
-		do {
-			//Read all files in the folder (and their respective sizes)
-
-			//If the found file is a directory, search in this, too
-			if (fileFindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-				//Make sure the directory found is not the current directory
-				//or the parent directory
-				if (std::string(fileFindData.cFileName) !=
-					std::string(".") && std::string(fileFindData.cFileName) !=
-					std::string("..")) {
-					
-					//Find the files in this directory (recursively)
-					//if it's not the same directory
-					FileFindAllFilesInAllSubdirectories(directory
-						+ fileFindData.cFileName + "\\", fileInfo);
-				}
-			} else {
-				
-				//Holds the file size
-				long long fileSize = 0;
-
-				//Add the file size to the list
-				//by finding the size of the file in bytes
-				if (FileSize(directory + fileFindData.cFileName,fileSize) == 0) {
-					
-					//Create a FileInformationPiece to add to the master list
-					FileInformationPiece file;
-
-					//Add the file to the FileInformationPiece
-					file.fileName = directory + fileFindData.cFileName;
-					
-					//Add the file size to the FileInformationPiece
-					file.fileSize = fileSize;
-
-					//Add the FileInformationPiece to the list
-					fileInfo.files.push_back(file);
-
-					if (fileInfo.files.size() % 50 == 0) {
-						std::cout << fileInfo.files.size() << " files found." << std::endl;
-					}
-
-				} else {
-					std::cout << "Getting file size of " << fileFindData.cFileName
-						<< " failed." << std::endl;
-				}
-			}
-		} while (::FindNextFile(hFind, &fileFindData));
-
-		//Close the file find
-		::FindClose(hFind);
-	}
-
-}
\ No newline at end of file
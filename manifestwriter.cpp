@@ -0,0 +1,191 @@
+// Archiver and Splitter
+// manifestwriter.cpp
+
+#include "manifestwriter.h"
+
+#include "utilities.h"
+#include "zipreader.h"
+
+////////////////
+//   SUMMARY
+////////////////
+
+ManifestWriter::ManifestWriter()
+	: summaryDetailLevel(1) {
+}
+
+bool ManifestWriter::openSummary(const std::string &summaryPath, int detailLevel) {
+	summaryDetailLevel = detailLevel;
+	summaryFile.open(summaryPath.c_str(), std::ios::out);
+	if (!summaryFile.is_open()) {
+		error = "Could not create " + summaryPath;
+		return false;
+	}
+	return true;
+}
+
+void ManifestWriter::setLocatorIndex(const std::string &indexPath) {
+	locatorIndexPath = indexPath;
+}
+
+void ManifestWriter::addArchive(const std::string &archiveName, const std::vector<std::string> &fileNames,
+								const std::vector<long long> &fileSizes) {
+	if (!summaryFile.is_open()) {
+		return;
+	}
+
+	//Add the current archive filename and the number of files in it
+	summaryFile << archiveName << "\n" << fileNames.size() << std::endl;
+
+	for (size_t i = 0; i < fileNames.size(); i ++) {
+		if (summaryDetailLevel >= 0) {
+			//Output relative filename
+			summaryFile << fileNames[i];
+		}
+		if (summaryDetailLevel >= 1) {
+			//Output file size
+			summaryFile << " (" << getFormattedSizeTitle(fileSizes[i]) << ")";
+		}
+		summaryFile << std::endl;
+	}
+}
+
+void ManifestWriter::addVerification(const std::vector<VerificationResult> &results) {
+	if (!summaryFile.is_open()) {
+		return;
+	}
+
+	summaryFile << "\nVerification" << std::endl;
+	for (size_t i = 0; i < results.size(); i ++) {
+		const VerificationResult &result = results[i];
+		summaryFile << result.archiveName << (result.ok ? " OK (" : " FAILED (")
+			<< result.filesChecked << " files checked)" << std::endl;
+		for (size_t j = 0; j < result.problems.size(); j ++) {
+			summaryFile << " " << result.problems[j] << std::endl;
+		}
+	}
+}
+
+void ManifestWriter::addCompressionLevels(const std::string &target,
+										  const std::vector<CompressionMeasurement> &measurements) {
+	if (!summaryFile.is_open()) {
+		return;
+	}
+
+	summaryFile << "\nCompression levels (" << target << ")" << std::endl;
+	for (size_t i = 0; i < measurements.size(); i ++) {
+		const CompressionMeasurement &measurement = measurements[i];
+		summaryFile << measurement.archiveName << " level " << measurement.choice.level << " ("
+			<< measurement.choice.reason << "; needed "
+			<< getFormattedSizeTitle((long long)measurement.choice.requiredBytesPerSecond) << "/s";
+		if (measurement.choice.estimatedBytesPerSecond > 0) {
+			summaryFile << ", expected "
+				<< getFormattedSizeTitle((long long)measurement.choice.estimatedBytesPerSecond) << "/s"
+				<< (measurement.choice.measured ? "" : " (scaled from another level)");
+		}
+		summaryFile << "): " << getFormattedSizeTitle(measurement.inputBytes) << " to "
+			<< getFormattedSizeTitle(measurement.outputBytes) << " in "
+			<< dtos(floorDoubleAt(measurement.seconds, 0.1)) << " seconds" << std::endl;
+	}
+}
+
+void ManifestWriter::addFilterRules(const std::vector<FilterRule> &rules) {
+	if (!summaryFile.is_open()) {
+		return;
+	}
+
+	summaryFile << "\nFilter rules" << std::endl;
+	for (size_t i = 0; i < rules.size(); i ++) {
+		summaryFile << rules[i].text << ": " << rules[i].filesMatched << " files, "
+			<< rules[i].directoriesMatched << " directories" << std::endl;
+	}
+}
+
+void ManifestWriter::flush() {
+	if (summaryFile.is_open()) {
+		summaryFile.flush();
+	}
+}
+
+void ManifestWriter::close() {
+	if (summaryFile.is_open()) {
+		summaryFile.close();
+	}
+}
+
+const std::string &ManifestWriter::errorMessage() const {
+	return error;
+}
+
+////////////////
+//   LOCATOR
+////////////////
+
+void ManifestWriter::addLocatorArchive(int archiveId, const std::string &archiveName,
+									   const std::vector<std::string> &fileNames,
+									   const std::vector<long long> &fileSizes) {
+	if (locatorIndexPath.empty()) {
+		return;
+	}
+
+	locatorIndex.addArchive(archiveId, archiveName);
+	for (size_t i = 0; i < fileNames.size(); i ++) {
+		locatorIndex.addFile(archiveId, fileNames[i], fileSizes[i]);
+	}
+}
+
+void ManifestWriter::setLocations(int archiveId, const std::vector<ZipEntryResult> &entries) {
+	if (locatorIndexPath.empty()) {
+		return;
+	}
+
+	for (size_t i = 0; i < entries.size(); i ++) {
+		if (entries[i].ok) {
+			locatorIndex.setLocation(archiveId, entries[i].entryName, entries[i].localHeaderOffset,
+				entries[i].compressedSize, entries[i].uncompressedSize, entries[i].crc);
+		}
+	}
+}
+
+void ManifestWriter::locateZipArchive(int archiveId, const std::string &archivePath) {
+	if (!locatorIndexPath.empty()) {
+		zipArchivesToLocate.push_back(std::make_pair(archiveId, archivePath));
+	}
+}
+
+bool ManifestWriter::writeLocatorIndex(std::vector<std::string> &warnings) {
+	if (locatorIndexPath.empty()) {
+		return true;
+	}
+
+	//Fill in the ZIP archives from their central directories (for archives
+	//made by 7-Zip, or made before this run)
+	for (size_t i = 0; i < zipArchivesToLocate.size(); i ++) {
+		ZipReader reader;
+		std::vector<ZipEntryInfo> entries;
+		if (!reader.open(zipArchivesToLocate[i].second)) {
+			//Not made yet
+			continue;
+		}
+		if (!reader.readCentralDirectory(entries)) {
+			warnings.push_back(zipArchivesToLocate[i].second + ": " + reader.errorMessage());
+			continue;
+		}
+
+		for (size_t j = 0; j < entries.size(); j ++) {
+			locatorIndex.setLocation(zipArchivesToLocate[i].first, entries[j].entryName, entries[j].localHeaderOffset,
+				entries[j].compressedSize, entries[j].uncompressedSize, entries[j].crc);
+		}
+	}
+	zipArchivesToLocate.clear();
+
+	if (!locatorIndex.write(locatorIndexPath)) {
+		error = "Could not write " + locatorIndexPath;
+		return false;
+	}
+	return true;
+}
+
+size_t ManifestWriter::locatorFileCount() const {
+	return locatorIndex.fileCount();
+}
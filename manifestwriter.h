@@ -0,0 +1,75 @@
+// Archiver and Splitter
+// manifestwriter.h
+// Writes the summary file and the locator index for a set of archives
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "archiveverifier.h"
+#include "compressionplanner.h"
+#include "filefilter.h"
+#include "locatorindex.h"
+#include "zipwriter.h"
+
+//The summary lists each archive (its name, how many files it has, and the
+//files with their sizes), then the verification results, the compression
+//levels picked and the filter rules, if there are any.  The locator index records the archive of
+//every file and, for ZIP archives, where the file is in it.
+class ManifestWriter {
+public:
+	ManifestWriter();
+
+	//Either can be left unopened to not write it
+	bool openSummary(const std::string &summaryPath, int detailLevel);
+	void setLocatorIndex(const std::string &indexPath);
+
+	//Lists an archive and its files (paths relative to the input directory)
+	//in the summary
+	void addArchive(const std::string &archiveName, const std::vector<std::string> &fileNames,
+					const std::vector<long long> &fileSizes);
+
+	//Adds an archive's files to the locator index, before their positions are known
+	void addLocatorArchive(int archiveId, const std::string &archiveName,
+						   const std::vector<std::string> &fileNames, const std::vector<long long> &fileSizes);
+	//Positions of the files the built-in compressor wrote
+	void setLocations(int archiveId, const std::vector<ZipEntryResult> &entries);
+	//A ZIP archive written by something else, looked up in its central
+	//directory the next time the index is written
+	void locateZipArchive(int archiveId, const std::string &archivePath);
+
+	void addVerification(const std::vector<VerificationResult> &results);
+	//target describes what the levels were picked for ("deadline 600 seconds")
+	void addCompressionLevels(const std::string &target, const std::vector<CompressionMeasurement> &measurements);
+	//Each rule with how many files and directories it decided on
+	void addFilterRules(const std::vector<FilterRule> &rules);
+
+	void flush();
+
+	//Writes the locator index (again), first filling in the ZIP archives that
+	//haven't been looked up yet.  Each archive is only read once, so this can
+	//be done after every batch.  ZIP archives that couldn't be read are added
+	//to warnings.
+	bool writeLocatorIndex(std::vector<std::string> &warnings);
+	size_t locatorFileCount() const;
+
+	void close();
+
+	const std::string &errorMessage() const;
+
+private:
+	ManifestWriter(const ManifestWriter &);
+	ManifestWriter &operator=(const ManifestWriter &);
+
+	std::ofstream summaryFile;
+	int summaryDetailLevel;
+
+	std::string locatorIndexPath;
+	LocatorIndexWriter locatorIndex;
+	std::vector<std::pair<int, std::string> > zipArchivesToLocate;
+
+	std::string error;
+};
@@ -0,0 +1,535 @@
+// Archiver and Splitter
+// process.cpp
+
+#include "process.h"
+
+#include <thread>
+
+#ifdef _WIN32
+#include <TlHelp32.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+//posix_spawn can only start the child in another directory through an
+//extension (glibc 2.29 and later, macOS); elsewhere it is done by hand
+#if (defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))) || defined(__APPLE__)
+#define SPAWN_HAS_CHDIR
+#endif
+#endif
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//Only the end of a child's output is kept; that's where the errors are
+const size_t MAX_CAPTURED_OUTPUT = 64 * 1024;
+
+//How often wait() checks on the child
+const unsigned int POLL_INTERVAL_MILLISECONDS = 50;
+
+}
+
+////////////////
+//   FUNCTIONS
+////////////////
+
+std::string processBuildCommandLine(const std::vector<std::string> &arguments) {
+	std::string commandLine;
+
+	for (size_t i = 0; i < arguments.size(); i ++) {
+		const std::string &argument = arguments[i];
+		if (i > 0) {
+			commandLine += ' ';
+		}
+
+		if (!argument.empty() && argument.find_first_of(" \t\n\v\"") == std::string::npos) {
+			commandLine += argument;
+			continue;
+		}
+
+		//Backslashes are only special in front of a quote, where they have to be doubled
+		commandLine += '"';
+		size_t backslashes = 0;
+		for (size_t j = 0; j < argument.length(); j ++) {
+			if (argument[j] == '\\') {
+				backslashes ++;
+			} else if (argument[j] == '"') {
+				commandLine.append(backslashes * 2 + 1, '\\');
+				commandLine += '"';
+				backslashes = 0;
+			} else {
+				commandLine.append(backslashes, '\\');
+				commandLine += argument[j];
+				backslashes = 0;
+			}
+		}
+		commandLine.append(backslashes * 2, '\\');
+		commandLine += '"';
+	}
+
+	return commandLine;
+}
+
+#ifdef _WIN32
+namespace {
+
+//Windows can only suspend threads, so a process is suspended thread by thread
+void setThreadsSuspended(DWORD processId, bool suspend) {
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (snapshot == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	THREADENTRY32 entry;
+	entry.dwSize = sizeof(entry);
+	for (BOOL found = Thread32First(snapshot, &entry); found; found = Thread32Next(snapshot, &entry)) {
+		if (entry.th32OwnerProcessID != processId) {
+			continue;
+		}
+		HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME, FALSE, entry.th32ThreadID);
+		if (thread != NULL) {
+			if (suspend) {
+				SuspendThread(thread);
+			} else {
+				ResumeThread(thread);
+			}
+			CloseHandle(thread);
+		}
+	}
+	CloseHandle(snapshot);
+}
+
+}
+#else
+namespace {
+
+//A pipe whose ends aren't inherited by other children (the child's own
+//stdout and stderr are copies, which are)
+bool pipeCloseOnExec(int pipeEnds[2]) {
+#ifdef __linux__
+	return pipe2(pipeEnds, O_CLOEXEC) == 0;
+#else
+	//No pipe2: another thread can spawn a child between the two calls
+	if (pipe(pipeEnds) != 0) {
+		return false;
+	}
+	fcntl(pipeEnds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pipeEnds[1], F_SETFD, FD_CLOEXEC);
+	return true;
+#endif
+}
+
+//Starts the program in argv with its stdout and stderr going to outputFd.
+//Returns 0 or an error number.
+int spawnWithOutput(char **argv, const std::string &workingDirectory, int outputFd, pid_t &pid) {
+#ifndef SPAWN_HAS_CHDIR
+	if (!workingDirectory.empty()) {
+		pid = fork();
+		if (pid < 0) {
+			return errno;
+		}
+		if (pid == 0) {
+			//Only async-signal-safe calls from here on
+			if (dup2(outputFd, STDOUT_FILENO) < 0 || dup2(outputFd, STDERR_FILENO) < 0
+				|| chdir(workingDirectory.c_str()) != 0) {
+				_exit(127);
+			}
+			execvp(argv[0], argv);
+			_exit(127);
+		}
+		return 0;
+	}
+#endif
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	int err = posix_spawn_file_actions_adddup2(&actions, outputFd, STDOUT_FILENO);
+	if (err == 0) {
+		err = posix_spawn_file_actions_adddup2(&actions, outputFd, STDERR_FILENO);
+	}
+#ifdef SPAWN_HAS_CHDIR
+	if (err == 0 && !workingDirectory.empty()) {
+		err = posix_spawn_file_actions_addchdir_np(&actions, workingDirectory.c_str());
+	}
+#endif
+	if (err == 0) {
+		err = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+	}
+	posix_spawn_file_actions_destroy(&actions);
+	return err;
+}
+
+}
+#endif
+
+////////////////
+//   CHILDPROCESS
+////////////////
+
+ChildProcess::ChildProcess()
+	: isRunning(false), lastProgress(-1), pendingNumber(-1), isSuspended(false), suspendedSeconds(0) {
+#ifdef _WIN32
+	processHandle = NULL;
+	processId = 0;
+	outputPipe = NULL;
+#else
+	pid = -1;
+	outputPipe = -1;
+#endif
+	processResult.started = false;
+	processResult.timedOut = false;
+	processResult.exitCode = -1;
+	processResult.seconds = 0;
+}
+
+ChildProcess::~ChildProcess() {
+	kill();
+#ifdef _WIN32
+	if (outputPipe != NULL) {
+		CloseHandle(outputPipe);
+	}
+	if (processHandle != NULL) {
+		CloseHandle(processHandle);
+	}
+#else
+	if (outputPipe != -1) {
+		close(outputPipe);
+	}
+#endif
+}
+
+#ifdef _WIN32
+
+bool ChildProcess::start(const std::vector<std::string> &arguments, const std::string &workingDirectory) {
+	if (arguments.empty() || isRunning) {
+		return false;
+	}
+
+	//The write end is inherited by the child as its stdout and stderr
+	SECURITY_ATTRIBUTES security;
+	security.nLength = sizeof(security);
+	security.lpSecurityDescriptor = NULL;
+	security.bInheritHandle = TRUE;
+
+	HANDLE readEnd = NULL;
+	HANDLE writeEnd = NULL;
+	if (!CreatePipe(&readEnd, &writeEnd, &security, 0)) {
+		return false;
+	}
+	SetHandleInformation(readEnd, HANDLE_FLAG_INHERIT, 0);
+
+	//The write end is the only handle the child inherits.  Other threads
+	//start 7-Zip too (verification, restore), and without the list, a child
+	//started while this pipe is open would inherit its write end and keep it
+	//from breaking when this child exits.  The child gets no stdin.
+	SIZE_T attributeListSize = 0;
+	InitializeProcThreadAttributeList(NULL, 1, 0, &attributeListSize);
+	std::vector<char> attributeListBuffer(attributeListSize);
+	LPPROC_THREAD_ATTRIBUTE_LIST attributeList = (LPPROC_THREAD_ATTRIBUTE_LIST)&attributeListBuffer[0];
+	if (!InitializeProcThreadAttributeList(attributeList, 1, 0, &attributeListSize)) {
+		CloseHandle(readEnd);
+		CloseHandle(writeEnd);
+		return false;
+	}
+	if (!UpdateProcThreadAttribute(attributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, &writeEnd,
+		sizeof(writeEnd), NULL, NULL)) {
+		DeleteProcThreadAttributeList(attributeList);
+		CloseHandle(readEnd);
+		CloseHandle(writeEnd);
+		return false;
+	}
+
+	STARTUPINFOEX startupInfo;
+	ZeroMemory(&startupInfo, sizeof(startupInfo));
+	startupInfo.StartupInfo.cb = sizeof(startupInfo);
+	startupInfo.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+	startupInfo.StartupInfo.hStdInput = NULL;
+	startupInfo.StartupInfo.hStdOutput = writeEnd;
+	startupInfo.StartupInfo.hStdError = writeEnd;
+	startupInfo.lpAttributeList = attributeList;
+
+	PROCESS_INFORMATION processInfo;
+	ZeroMemory(&processInfo, sizeof(processInfo));
+
+	//CreateProcess may modify the command line buffer
+	std::string commandLine = processBuildCommandLine(arguments);
+	std::vector<char> commandLineBuffer(commandLine.begin(), commandLine.end());
+	commandLineBuffer.push_back('\0');
+
+	startTime = std::chrono::steady_clock::now();
+	BOOL created = CreateProcess(NULL, &commandLineBuffer[0], NULL, NULL, TRUE,
+		CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT, NULL,
+		workingDirectory.empty() ? NULL : workingDirectory.c_str(), &startupInfo.StartupInfo, &processInfo);
+	DeleteProcThreadAttributeList(attributeList);
+
+	//Only the child holds the write end now, so the pipe breaks when it exits
+	CloseHandle(writeEnd);
+
+	if (!created) {
+		CloseHandle(readEnd);
+		return false;
+	}
+
+	CloseHandle(processInfo.hThread);
+	processHandle = processInfo.hProcess;
+	processId = processInfo.dwProcessId;
+	outputPipe = readEnd;
+	isRunning = true;
+	processResult.started = true;
+	return true;
+}
+
+void ChildProcess::readOutput() {
+	if (outputPipe == NULL) {
+		return;
+	}
+
+	char buffer[4096];
+	DWORD available = 0;
+	while (PeekNamedPipe(outputPipe, NULL, 0, NULL, &available, NULL) && available > 0) {
+		DWORD bytesRead = 0;
+		DWORD toRead = available < sizeof(buffer) ? available : sizeof(buffer);
+		if (!ReadFile(outputPipe, buffer, toRead, &bytesRead, NULL) || bytesRead == 0) {
+			break;
+		}
+		appendOutput(buffer, bytesRead);
+	}
+}
+
+bool ChildProcess::poll() {
+	if (!isRunning) {
+		return false;
+	}
+
+	readOutput();
+
+	if (WaitForSingleObject(processHandle, 0) == WAIT_OBJECT_0) {
+		readOutput();
+		DWORD exitCode = 0;
+		GetExitCodeProcess(processHandle, &exitCode);
+		finish((int)exitCode);
+		return false;
+	}
+	return true;
+}
+
+void ChildProcess::kill() {
+	if (!isRunning) {
+		return;
+	}
+	TerminateProcess(processHandle, 1);
+	WaitForSingleObject(processHandle, INFINITE);
+	readOutput();
+	finish(-1);
+}
+
+void ChildProcess::suspend() {
+	if (isRunning && !isSuspended) {
+		setThreadsSuspended(processId, true);
+		isSuspended = true;
+		suspendedSince = std::chrono::steady_clock::now();
+	}
+}
+
+void ChildProcess::resume() {
+	if (isRunning && isSuspended) {
+		setThreadsSuspended(processId, false);
+		isSuspended = false;
+		suspendedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - suspendedSince).count();
+	}
+}
+
+#else
+
+bool ChildProcess::start(const std::vector<std::string> &arguments, const std::string &workingDirectory) {
+	if (arguments.empty() || isRunning) {
+		return false;
+	}
+
+	//Children started at the same time (on other threads) must not get the
+	//write end, or the pipe wouldn't break until they exit too
+	int pipeEnds[2];
+	if (!pipeCloseOnExec(pipeEnds)) {
+		return false;
+	}
+
+	std::vector<char *> argv;
+	for (size_t i = 0; i < arguments.size(); i ++) {
+		argv.push_back(const_cast<char *>(arguments[i].c_str()));
+	}
+	argv.push_back(NULL);
+
+	startTime = std::chrono::steady_clock::now();
+	int err = spawnWithOutput(&argv[0], workingDirectory, pipeEnds[1], pid);
+	close(pipeEnds[1]);
+
+	if (err != 0) {
+		close(pipeEnds[0]);
+		pid = -1;
+		return false;
+	}
+
+	fcntl(pipeEnds[0], F_SETFL, fcntl(pipeEnds[0], F_GETFL) | O_NONBLOCK);
+	outputPipe = pipeEnds[0];
+	isRunning = true;
+	processResult.started = true;
+	return true;
+}
+
+void ChildProcess::readOutput() {
+	if (outputPipe == -1) {
+		return;
+	}
+
+	char buffer[4096];
+	while (true) {
+		ssize_t bytesRead = read(outputPipe, buffer, sizeof(buffer));
+		if (bytesRead > 0) {
+			appendOutput(buffer, (size_t)bytesRead);
+		} else if (bytesRead < 0 && errno == EINTR) {
+			continue;
+		} else {
+			break;
+		}
+	}
+}
+
+bool ChildProcess::poll() {
+	if (!isRunning) {
+		return false;
+	}
+
+	readOutput();
+
+	int status = 0;
+	if (waitpid(pid, &status, WNOHANG) == pid) {
+		readOutput();
+		finish(WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+		return false;
+	}
+	return true;
+}
+
+void ChildProcess::kill() {
+	if (!isRunning) {
+		return;
+	}
+	::kill(pid, SIGKILL);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	readOutput();
+	finish(-1);
+}
+
+void ChildProcess::suspend() {
+	if (isRunning && !isSuspended && ::kill(pid, SIGSTOP) == 0) {
+		isSuspended = true;
+		suspendedSince = std::chrono::steady_clock::now();
+	}
+}
+
+void ChildProcess::resume() {
+	if (isRunning && isSuspended) {
+		::kill(pid, SIGCONT);
+		isSuspended = false;
+		suspendedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - suspendedSince).count();
+	}
+}
+
+#endif
+
+void ChildProcess::wait(unsigned int timeoutSeconds) {
+	while (poll()) {
+		if (killIfOverTime(timeoutSeconds)) {
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MILLISECONDS));
+	}
+}
+
+bool ChildProcess::killIfOverTime(unsigned int timeoutSeconds) {
+	double suspendedFor = suspendedSeconds + (isSuspended
+		? std::chrono::duration<double>(std::chrono::steady_clock::now() - suspendedSince).count() : 0);
+	if (!isRunning || timeoutSeconds == 0 || elapsedSeconds() - suspendedFor <= timeoutSeconds) {
+		return false;
+	}
+	kill();
+	processResult.timedOut = true;
+	return true;
+}
+
+void ChildProcess::finish(int exitCode) {
+	processResult.seconds = elapsedSeconds();
+	processResult.exitCode = exitCode;
+	isRunning = false;
+	isSuspended = false;
+}
+
+//Keeps the output and picks progress percentages out of it.
+//7-Zip redraws its progress line with backspaces, so those erase
+//characters here the same way they do on a console.
+void ChildProcess::appendOutput(const char *data, size_t length) {
+	std::string &output = processResult.output;
+
+	for (size_t i = 0; i < length; i ++) {
+		char c = data[i];
+
+		if (c >= '0' && c <= '9') {
+			pendingNumber = (pendingNumber < 0 ? 0 : pendingNumber * 10) + (c - '0');
+			if (pendingNumber > 1000) {
+				pendingNumber = 1000;
+			}
+		} else {
+			if (c == '%' && pendingNumber >= 0 && pendingNumber <= 100) {
+				lastProgress = pendingNumber;
+			}
+			pendingNumber = -1;
+		}
+
+		if (c == '\b') {
+			if (!output.empty() && output[output.length() - 1] != '\n') {
+				output.erase(output.length() - 1);
+			}
+		} else if (c != '\r') {
+			output += c;
+		}
+	}
+
+	if (output.length() > MAX_CAPTURED_OUTPUT * 2) {
+		output.erase(0, output.length() - MAX_CAPTURED_OUTPUT);
+	}
+}
+
+bool ChildProcess::suspended() const {
+	return isSuspended;
+}
+
+bool ChildProcess::running() const {
+	return isRunning;
+}
+
+double ChildProcess::elapsedSeconds() const {
+	if (!processResult.started) {
+		return 0;
+	}
+	if (!isRunning) {
+		return processResult.seconds;
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+int ChildProcess::progress() const {
+	return lastProgress;
+}
+
+const ProcessResult &ChildProcess::result() const {
+	return processResult;
+}
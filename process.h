@@ -0,0 +1,100 @@
+// Archiver and Splitter
+// process.h
+// Runs child processes (7-Zip) directly, without going through a shell
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+//How a child process ended
+struct ProcessResult {
+	//False if the program couldn't be started at all
+	bool started;
+	//True if the child was killed for running past its time limit
+	bool timedOut;
+	int exitCode;
+	//Wall-clock time from start to exit
+	double seconds;
+	//Everything the child wrote to stdout and stderr (the tail of it if it was long)
+	std::string output;
+};
+
+class ChildProcess {
+public:
+	ChildProcess();
+	//Kills the child if it is still running
+	~ChildProcess();
+
+	//Starts arguments[0] with the given arguments (no shell is involved, so
+	//nothing needs escaping).  stdout and stderr are captured through a pipe.
+	//An empty workingDirectory keeps the current one.
+	bool start(const std::vector<std::string> &arguments, const std::string &workingDirectory);
+
+	//Collects any new output without blocking.  Returns true while the child is running.
+	bool poll();
+
+	//Waits for the child to exit.  If it is still running after timeoutSeconds
+	//(0 = no limit), it is killed and result().timedOut is set.
+	void wait(unsigned int timeoutSeconds);
+
+	//Kills the child if it hasn't exited yet
+	void kill();
+
+	//Kills the child (setting result().timedOut) if it has been running for
+	//longer than timeoutSeconds (0 = no limit), not counting the time it was
+	//suspended.  Returns true if it did.
+	bool killIfOverTime(unsigned int timeoutSeconds);
+
+	//Stops the child from running until resume() (used to hold 7-Zip to the
+	//throttle's limits).  It can still be killed while suspended.
+	void suspend();
+	void resume();
+	bool suspended() const;
+
+	bool running() const;
+	//Seconds since the child was started
+	double elapsedSeconds() const;
+	//Last percentage the child printed (7-Zip's -bsp1 progress), or -1
+	int progress() const;
+	const ProcessResult &result() const;
+
+private:
+	ChildProcess(const ChildProcess &);
+	ChildProcess &operator=(const ChildProcess &);
+
+	void readOutput();
+	void appendOutput(const char *data, size_t length);
+	void finish(int exitCode);
+
+#ifdef _WIN32
+	HANDLE processHandle;
+	DWORD processId;
+	HANDLE outputPipe;
+#else
+	pid_t pid;
+	int outputPipe;
+#endif
+
+	bool isRunning;
+	int lastProgress;
+	//Digits seen just before the end of the last chunk of output
+	int pendingNumber;
+	std::chrono::steady_clock::time_point startTime;
+	bool isSuspended;
+	std::chrono::steady_clock::time_point suspendedSince;
+	//Time spent suspended before suspendedSince
+	double suspendedSeconds;
+	ProcessResult processResult;
+};
+
+//Builds a Windows command line that CreateProcess's child will split back
+//into exactly these arguments (the quoting rules of CommandLineToArgvW)
+std::string processBuildCommandLine(const std::vector<std::string> &arguments);
@@ -0,0 +1,27 @@
+// Archiver and Splitter
+// progress.cpp
+
+#include "progress.h"
+
+ProgressReporter::ProgressReporter(const ProgressCallback &callback)
+	: callback(callback), filesDone(0), filesTotal(0) {
+}
+
+void ProgressReporter::setFileCounts(unsigned long long filesDone, unsigned long long filesTotal) {
+	this->filesDone = filesDone;
+	this->filesTotal = filesTotal;
+}
+
+void ProgressReporter::report(ProgressEventType type, const std::string &message, int archiveId) {
+	if (!callback) {
+		return;
+	}
+
+	ProgressEvent event;
+	event.type = type;
+	event.message = message;
+	event.archiveId = archiveId;
+	event.filesDone = filesDone;
+	event.filesTotal = filesTotal;
+	callback(event);
+}
@@ -0,0 +1,54 @@
+// Archiver and Splitter
+// progress.h
+// Progress reports from a run, for whoever embeds the splitter
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+enum ProgressEventType {
+	//A line worth showing the user
+	PROGRESS_MESSAGE,
+	PROGRESS_WARNING,
+	PROGRESS_ERROR,
+	//Short status (for a title bar); each one replaces the one before
+	PROGRESS_STATUS,
+	//The scan has found filesTotal files so far
+	PROGRESS_FILES_FOUND,
+	//An archive was handed to the compressor (or listed, with summary only)
+	PROGRESS_ARCHIVE_STARTED,
+	//An archive was written
+	PROGRESS_ARCHIVE_FINISHED
+};
+
+struct ProgressEvent {
+	ProgressEventType type;
+	std::string message;
+	//Archive the event is about (0 if it isn't about one)
+	int archiveId;
+	//Files put in archives so far, out of the files found
+	unsigned long long filesDone;
+	unsigned long long filesTotal;
+};
+
+//Called on the thread that started the run, never from the worker threads,
+//so it can write to the console without locking
+typedef std::function<void(const ProgressEvent &event)> ProgressCallback;
+
+//Keeps the file counts that go with every event.  An empty callback is fine.
+class ProgressReporter {
+public:
+	explicit ProgressReporter(const ProgressCallback &callback);
+
+	void setFileCounts(unsigned long long filesDone, unsigned long long filesTotal);
+	void report(ProgressEventType type, const std::string &message, int archiveId = 0);
+
+private:
+	ProgressReporter(const ProgressReporter &);
+	ProgressReporter &operator=(const ProgressReporter &);
+
+	ProgressCallback callback;
+	unsigned long long filesDone;
+	unsigned long long filesTotal;
+};
@@ -0,0 +1,302 @@
+// Archiver and Splitter
+// sha1.cpp
+
+#include "sha1.h"
+
+#include <cstring>
+
+#include "cpufeatures.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+////////////////
+//   COMPRESSION
+////////////////
+
+namespace {
+
+uint32_t rotateLeft(uint32_t value, int bits) {
+	return (value << bits) | (value >> (32 - bits));
+}
+
+void sha1CompressPortable(uint32_t state[5], const unsigned char *data, size_t blocks) {
+	while (blocks > 0) {
+		uint32_t w[80];
+		for (int i = 0; i < 16; i ++) {
+			w[i] = ((uint32_t)data[4 * i] << 24) | ((uint32_t)data[4 * i + 1] << 16)
+				| ((uint32_t)data[4 * i + 2] << 8) | (uint32_t)data[4 * i + 3];
+		}
+		for (int i = 16; i < 80; i ++) {
+			w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+		uint32_t e = state[4];
+
+		for (int i = 0; i < 80; i ++) {
+			uint32_t f;
+			uint32_t k;
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+
+			uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rotateLeft(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+
+		data += SHA1_BLOCK_SIZE;
+		blocks --;
+	}
+}
+
+#ifdef CPU_X86
+
+//Four rounds per SHA1RNDS4.  Message vector g (g >= 4) is built from the four
+//before it; each group's E comes from the state before the previous group.
+#define SHA1_NI_GROUP(g, f) \
+	if ((g) < 4) { \
+		msg[(g) % 4] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * ((g) % 4))), byteSwap); \
+	} else { \
+		msg[(g) % 4] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(msg[(g) % 4], msg[((g) + 1) % 4]), \
+			msg[((g) + 2) % 4]), msg[((g) + 3) % 4]); \
+	} \
+	e = (g) == 0 ? _mm_add_epi32(e0, msg[0]) : _mm_sha1nexte_epu32(previous, msg[(g) % 4]); \
+	previous = abcd; \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, f);
+
+CPU_TARGET("sha,sse4.1")
+void sha1CompressShaNi(uint32_t state[5], const unsigned char *data, size_t blocks) {
+	const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+	__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	while (blocks > 0) {
+		__m128i abcdSave = abcd;
+		__m128i e0Save = e0;
+		__m128i msg[4];
+		__m128i e;
+		__m128i previous = abcd;
+
+		SHA1_NI_GROUP(0, 0) SHA1_NI_GROUP(1, 0) SHA1_NI_GROUP(2, 0) SHA1_NI_GROUP(3, 0) SHA1_NI_GROUP(4, 0)
+		SHA1_NI_GROUP(5, 1) SHA1_NI_GROUP(6, 1) SHA1_NI_GROUP(7, 1) SHA1_NI_GROUP(8, 1) SHA1_NI_GROUP(9, 1)
+		SHA1_NI_GROUP(10, 2) SHA1_NI_GROUP(11, 2) SHA1_NI_GROUP(12, 2) SHA1_NI_GROUP(13, 2) SHA1_NI_GROUP(14, 2)
+		SHA1_NI_GROUP(15, 3) SHA1_NI_GROUP(16, 3) SHA1_NI_GROUP(17, 3) SHA1_NI_GROUP(18, 3) SHA1_NI_GROUP(19, 3)
+
+		e0 = _mm_sha1nexte_epu32(previous, e0Save);
+		abcd = _mm_add_epi32(abcd, abcdSave);
+
+		data += SHA1_BLOCK_SIZE;
+		blocks --;
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#undef SHA1_NI_GROUP
+
+#endif
+
+void sha1Compress(uint32_t state[5], const unsigned char *data, size_t blocks) {
+#ifdef CPU_X86
+	static const bool useShaNi = cpuHasShaNi();
+	if (useShaNi) {
+		sha1CompressShaNi(state, data, blocks);
+		return;
+	}
+#endif
+	sha1CompressPortable(state, data, blocks);
+}
+
+}
+
+////////////////
+//   SHA1
+////////////////
+
+Sha1::Sha1() {
+	reset();
+}
+
+void Sha1::reset() {
+	state[0] = 0x67452301;
+	state[1] = 0xEFCDAB89;
+	state[2] = 0x98BADCFE;
+	state[3] = 0x10325476;
+	state[4] = 0xC3D2E1F0;
+	bufferUsed = 0;
+	totalLength = 0;
+}
+
+void Sha1::update(const void *data, size_t length) {
+	const unsigned char *p = (const unsigned char *)data;
+	totalLength += length;
+
+	if (bufferUsed > 0) {
+		size_t take = SHA1_BLOCK_SIZE - bufferUsed < length ? SHA1_BLOCK_SIZE - bufferUsed : length;
+		memcpy(buffer + bufferUsed, p, take);
+		bufferUsed += take;
+		p += take;
+		length -= take;
+		if (bufferUsed < SHA1_BLOCK_SIZE) {
+			return;
+		}
+		sha1Compress(state, buffer, 1);
+		bufferUsed = 0;
+	}
+
+	//Whole blocks straight from the input
+	size_t blocks = length / SHA1_BLOCK_SIZE;
+	if (blocks > 0) {
+		sha1Compress(state, p, blocks);
+		p += blocks * SHA1_BLOCK_SIZE;
+		length -= blocks * SHA1_BLOCK_SIZE;
+	}
+
+	if (length > 0) {
+		memcpy(buffer, p, length);
+		bufferUsed = length;
+	}
+}
+
+void Sha1::final(unsigned char digest[SHA1_DIGEST_SIZE]) {
+	unsigned long long bitLength = totalLength * 8;
+
+	//0x80, zeros up to 56 bytes into a block, then the length in bits
+	unsigned char padding[SHA1_BLOCK_SIZE + 8];
+	size_t paddingLength = (bufferUsed < 56 ? 56 : 120) - bufferUsed;
+	memset(padding, 0, sizeof(padding));
+	padding[0] = 0x80;
+	for (int i = 0; i < 8; i ++) {
+		padding[paddingLength + i] = (unsigned char)(bitLength >> (56 - 8 * i));
+	}
+	update(padding, paddingLength + 8);
+
+	for (int i = 0; i < 5; i ++) {
+		digest[4 * i] = (unsigned char)(state[i] >> 24);
+		digest[4 * i + 1] = (unsigned char)(state[i] >> 16);
+		digest[4 * i + 2] = (unsigned char)(state[i] >> 8);
+		digest[4 * i + 3] = (unsigned char)state[i];
+	}
+}
+
+////////////////
+//   HMACSHA1
+////////////////
+
+HmacSha1::HmacSha1() {
+	setKey(NULL, 0);
+}
+
+void HmacSha1::setKey(const void *key, size_t length) {
+	unsigned char block[SHA1_BLOCK_SIZE];
+	memset(block, 0, sizeof(block));
+
+	//Keys longer than a block are hashed first
+	if (length > SHA1_BLOCK_SIZE) {
+		Sha1 keyHash;
+		keyHash.update(key, length);
+		keyHash.final(block);
+	} else if (length > 0) {
+		memcpy(block, key, length);
+	}
+
+	unsigned char pad[SHA1_BLOCK_SIZE];
+	for (int i = 0; i < SHA1_BLOCK_SIZE; i ++) {
+		pad[i] = block[i] ^ 0x36;
+	}
+	innerKeyed.reset();
+	innerKeyed.update(pad, SHA1_BLOCK_SIZE);
+
+	for (int i = 0; i < SHA1_BLOCK_SIZE; i ++) {
+		pad[i] = block[i] ^ 0x5C;
+	}
+	outerKeyed.reset();
+	outerKeyed.update(pad, SHA1_BLOCK_SIZE);
+
+	reset();
+}
+
+void HmacSha1::reset() {
+	inner = innerKeyed;
+}
+
+void HmacSha1::update(const void *data, size_t length) {
+	inner.update(data, length);
+}
+
+//Also starts a new message with the same key
+void HmacSha1::final(unsigned char mac[SHA1_DIGEST_SIZE]) {
+	unsigned char innerDigest[SHA1_DIGEST_SIZE];
+	inner.final(innerDigest);
+
+	Sha1 outer = outerKeyed;
+	outer.update(innerDigest, SHA1_DIGEST_SIZE);
+	outer.final(mac);
+
+	reset();
+}
+
+////////////////
+//   PBKDF2
+////////////////
+
+void pbkdf2HmacSha1(const void *password, size_t passwordLength, const unsigned char *salt, size_t saltLength,
+					unsigned int iterations, unsigned char *output, size_t outputLength) {
+	HmacSha1 hmac;
+	hmac.setKey(password, passwordLength);
+
+	for (uint32_t blockIndex = 1; outputLength > 0; blockIndex ++) {
+		unsigned char index[4];
+		index[0] = (unsigned char)(blockIndex >> 24);
+		index[1] = (unsigned char)(blockIndex >> 16);
+		index[2] = (unsigned char)(blockIndex >> 8);
+		index[3] = (unsigned char)blockIndex;
+
+		unsigned char u[SHA1_DIGEST_SIZE];
+		unsigned char t[SHA1_DIGEST_SIZE];
+		hmac.update(salt, saltLength);
+		hmac.update(index, 4);
+		hmac.final(u);
+		memcpy(t, u, SHA1_DIGEST_SIZE);
+
+		for (unsigned int i = 1; i < iterations; i ++) {
+			hmac.update(u, SHA1_DIGEST_SIZE);
+			hmac.final(u);
+			for (int j = 0; j < SHA1_DIGEST_SIZE; j ++) {
+				t[j] ^= u[j];
+			}
+		}
+
+		size_t take = outputLength < SHA1_DIGEST_SIZE ? outputLength : SHA1_DIGEST_SIZE;
+		memcpy(output, t, take);
+		output += take;
+		outputLength -= take;
+	}
+}
@@ -0,0 +1,51 @@
+// Archiver and Splitter
+// sha1.h
+// SHA-1, HMAC-SHA1 and PBKDF2-HMAC-SHA1 (as used by WinZip AES),
+// using the SHA extensions when the processor has them
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
+
+class Sha1 {
+public:
+	Sha1();
+
+	void reset();
+	void update(const void *data, size_t length);
+	//Writes the digest; the object must be reset before it is used again
+	void final(unsigned char digest[SHA1_DIGEST_SIZE]);
+
+private:
+	uint32_t state[5];
+	unsigned char buffer[SHA1_BLOCK_SIZE];
+	size_t bufferUsed;
+	unsigned long long totalLength;
+};
+
+class HmacSha1 {
+public:
+	HmacSha1();
+
+	//Sets the key and starts a new message
+	void setKey(const void *key, size_t length);
+	//Starts a new message with the same key
+	void reset();
+	void update(const void *data, size_t length);
+	void final(unsigned char mac[SHA1_DIGEST_SIZE]);
+
+private:
+	//Hash states with the padded key already absorbed, so each
+	//message doesn't have to hash the key again
+	Sha1 innerKeyed;
+	Sha1 outerKeyed;
+	Sha1 inner;
+};
+
+//Derives outputLength bytes of key material from a password
+void pbkdf2HmacSha1(const void *password, size_t passwordLength, const unsigned char *salt, size_t saltLength,
+					unsigned int iterations, unsigned char *output, size_t outputLength);
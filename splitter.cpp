@@ -0,0 +1,621 @@
+// Archiver and Splitter
+// splitter.cpp
+
+#include "splitter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <vector>
+
+#include "archivebuilder.h"
+#include "archivepacker.h"
+#include "archivesetindex.h"
+#include "directorywatcher.h"
+#include "filefilter.h"
+#include "filescanner.h"
+#include "iothrottle.h"
+#include "manifestwriter.h"
+#include "utilities.h"
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+//Staging directory inside the system's temp directory, by default
+const char *TEMP_DIRECTORY_NAME = "archiver_splitter";
+
+//Watch mode: how long each wait for new files lasts, so cancelling is noticed
+const unsigned int WATCH_WAIT_MILLISECONDS = 1000;
+
+}
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+//Path of a file relative to the input directory, as it is stored in the archives
+std::string relativeFilePath(const std::string &fullPath, const std::string &directory) {
+	if (fullPath.compare(0, directory.length(), directory) == 0) {
+		return fullPath.substr(directory.length());
+	}
+	return fullPath;
+}
+
+long long totalFileSize(const std::vector<FileInformationPiece> &files) {
+	long long size = 0;
+	for (size_t i = 0; i < files.size(); i ++) {
+		size += files[i].fileSize;
+	}
+	return size;
+}
+
+//One run, from the scan to the summary
+class SplitterRun {
+public:
+	SplitterRun(const SplitterOptions &options, const ProgressCallback &callback, const CancellationToken &cancel);
+	~SplitterRun();
+
+	SplitterResult run();
+
+private:
+	bool prepare();
+	bool startWatching();
+	//Watch mode: waits for the open archive to fill up (or get old enough),
+	//adding new files to it as they are finished.  Returns false once cancelled.
+	bool waitForOpenArchive();
+	void rescan();
+	void makeArchive(std::vector<FileInformationPiece> &archiveFiles);
+	void finish();
+	void writeLocatorIndex();
+	void writeFileSets(bool final);
+	void reportFilterRules();
+
+	//An archive being made, whose file set goes in the index once it is done
+	struct NewFileSet {
+		int archiveId;
+		std::string hash;
+		std::string archiveName;
+	};
+
+	SplitterOptions options;
+	ProgressReporter progress;
+	CancellationToken cancel;
+	SplitterResult result;
+
+	IoThrottle throttle;
+	FileFilter filter;
+	ManifestWriter manifest;
+	ArchiveBuilder *builder;
+	ArchivePacker *packer;
+
+	//Skipping unchanged archives: the previous run's file sets, and what
+	//goes into the hashes besides the files
+	ArchiveSetIndex *setIndex;
+	std::string archiveSettings;
+	std::vector<NewFileSet> newFileSets;
+
+	FileInformation fileInfo;
+	unsigned long long totalFiles;
+	int currentArchiveId;
+
+	//Watch mode: new files are reported as they are finished.  Files that are
+	//already known (found by the scan, or archived) aren't added twice.
+	DirectoryWatcher *watcher;
+	std::set<std::string> knownFiles;
+	std::chrono::steady_clock::time_point lastRescan;
+	//When the files waiting to be archived started collecting
+	std::chrono::steady_clock::time_point openGroupStarted;
+};
+
+SplitterRun::SplitterRun(const SplitterOptions &options, const ProgressCallback &callback,
+						 const CancellationToken &cancel)
+	: options(options), progress(callback), cancel(cancel), builder(NULL), packer(NULL), setIndex(NULL), totalFiles(0),
+	  currentArchiveId(1), watcher(NULL) {
+	result.ok = false;
+	result.cancelled = false;
+	result.filesFound = 0;
+	result.archivesMade = 0;
+	result.archivesReused = 0;
+	result.archivesFailedVerification = 0;
+}
+
+SplitterRun::~SplitterRun() {
+	delete builder;
+	delete packer;
+	delete setIndex;
+	delete watcher;
+}
+
+SplitterResult SplitterRun::run() {
+	if (!prepare()) {
+		return result;
+	}
+	result.ok = true;
+
+	FileScanner scanner(progress, cancel);
+	if (!filter.empty()) {
+		scanner.setFilter(&filter);
+	}
+	scanner.scan(options.inputDirectory, fileInfo);
+	for (size_t i = 0; i < scanner.failedFiles().size(); i ++) {
+		progress.report(PROGRESS_WARNING, "Getting file size of " + scanner.failedFiles()[i] + " failed.");
+	}
+	reportFilterRules();
+
+	if (options.watchMode && !startWatching()) {
+		result.ok = false;
+		return result;
+	}
+
+	//Sort vector (greatest to least) ~ Do not sort this if the user does not want that
+	packer->sortFiles(fileInfo.files);
+
+	totalFiles = fileInfo.files.size();
+	result.filesFound = totalFiles;
+	progress.setFileCounts(0, totalFiles);
+	progress.report(PROGRESS_MESSAGE, "Total files found: " + itos(totalFiles));
+
+	openGroupStarted = std::chrono::steady_clock::now();
+	while (!cancel.cancelled()) {
+		if (watcher != NULL && !waitForOpenArchive()) {
+			break;
+		}
+		if (fileInfo.files.empty()) {
+			break;
+		}
+
+		std::vector<FileInformationPiece> archiveFiles = packer->nextArchive(fileInfo.files);
+
+		//Watch mode: the files that didn't fit start the next open archive
+		openGroupStarted = std::chrono::steady_clock::now();
+
+		//Tell the user that the file is greater than the maximum archive size
+		if (archiveFiles.size() == 1 && archiveFiles[0].fileSize > options.maxFileSize) {
+			progress.report(PROGRESS_WARNING, archiveFiles[0].fileName + "("
+				+ getFormattedSizeTitle(archiveFiles[0].fileSize) + ") was added to its own archive, although"
+				+ " it is greater than the maximum archive size.");
+		}
+
+		makeArchive(archiveFiles);
+
+		//Increment the current archive ID
+		currentArchiveId ++;
+	}
+
+	finish();
+	return result;
+}
+
+//Works out the settings that depend on each other, and opens the output files
+bool SplitterRun::prepare() {
+	if (options.inputDirectory.empty() || options.outputDirectory.empty()) {
+		result.errorMessage = "The input and output directories are required";
+		return false;
+	}
+	options.inputDirectory = directoryWithSeparator(options.inputDirectory);
+	options.outputDirectory = directoryWithSeparator(options.outputDirectory);
+
+	for (size_t i = 0; i < options.filterRules.size(); i ++) {
+		if (!filter.addRule(options.filterRules[i])) {
+			result.errorMessage = filter.errorMessage();
+			return false;
+		}
+	}
+	if (!options.filterRulesFile.empty() && !filter.loadRules(options.filterRulesFile)) {
+		result.errorMessage = filter.errorMessage();
+		return false;
+	}
+	filter.compile();
+
+	//The built-in compressor only writes ZIP files
+	if (options.useBuiltinCompressor && options.archiveType != ARCHIVE_FILE_TYPE_ZIP) {
+		progress.report(PROGRESS_MESSAGE, "The built-in compressor only makes zip files.  7-Zip will be used"
+			" to compress the 7z files instead.");
+		options.useBuiltinCompressor = false;
+	}
+
+	//The levels picked for ZIP files are the built-in compressor's
+	bool autoCompressionLevel = options.compressionDeadlineSeconds > 0 || options.compressionTargetBytesPerSecond > 0;
+	if (autoCompressionLevel) {
+		options.compressFiles = true;
+		if (options.archiveType == ARCHIVE_FILE_TYPE_ZIP) {
+			options.useBuiltinCompressor = true;
+		}
+	}
+
+	//7-Zip encrypts ZIP files with the old ZipCrypto cipher, which is weak.
+	//Password-protected ZIP files are made by the built-in compressor
+	//instead, which encrypts them with WinZip AES-256 (using AES-NI and
+	//the SHA extensions when the processor has them).
+	if (options.password != "" && options.archiveType == ARCHIVE_FILE_TYPE_ZIP && !options.useBuiltinCompressor) {
+		options.useBuiltinCompressor = true;
+		options.builtinCompressionLevel = options.compressFiles ? 6 : 0;
+	}
+
+	if (options.stagingDirectory.empty()) {
+		options.stagingDirectory = getTempDirectory() + TEMP_DIRECTORY_NAME;
+	}
+
+	//Make sure the output directory already exists, and if not, create it
+	if (!directoryCreate(options.outputDirectory)) {
+		result.errorMessage = "Could not create " + options.outputDirectory;
+		return false;
+	}
+
+	if (options.makeSummaryFile && !manifest.openSummary(options.outputDirectory + options.summaryFilename,
+		options.summaryDetailLevel)) {
+		result.errorMessage = manifest.errorMessage();
+		return false;
+	}
+	if (options.makeLocatorIndex) {
+		manifest.setLocatorIndex(options.outputDirectory + options.locatorIndexFilename);
+	}
+
+	packer = new ArchivePacker(options.packingMode, options.maxFileSize, options.inputDirectory);
+
+	//Anything that changes how the files are stored means the archives have to be made again
+	if (options.skipUnchangedArchives && !options.onlyMakeSummaryFile) {
+		setIndex = new ArchiveSetIndex();
+		if (!setIndex->load(options.outputDirectory, options.fileSetsFilename)) {
+			result.errorMessage = setIndex->errorMessage();
+			return false;
+		}
+		//The hashes only say whether there is a password; the index checks
+		//whether it is the same one
+		archiveSettings = "type " + itos(options.archiveType) + " compress " + itos(options.compressFiles)
+			+ " builtin " + itos(options.useBuiltinCompressor) + " level " + itos(options.builtinCompressionLevel)
+			+ " automatic " + itos(autoCompressionLevel) + " encrypted " + itos(!options.password.empty());
+		if (!setIndex->setPassword(options.password)) {
+			progress.report(PROGRESS_MESSAGE, "The password has changed since the last run, so every archive is"
+				" made again.");
+		}
+	}
+
+	//Limits on reading, writing and compression threads, from the control
+	//file in the output directory (which can be changed while this runs)
+	throttle.setControlFile(options.outputDirectory + options.throttleControlFilename);
+	throttle.reloadControlFile();
+
+	//Nothing is compressed or checked with summary only
+	ArchiveBuilderSettings builderSettings;
+	builderSettings.sevenZip = options.archiveType == ARCHIVE_FILE_TYPE_7Z;
+	builderSettings.compressFiles = options.compressFiles;
+	builderSettings.useBuiltinCompressor = options.useBuiltinCompressor && !options.onlyMakeSummaryFile;
+	builderSettings.builtinCompressionLevel = options.builtinCompressionLevel;
+	builderSettings.password = options.password;
+	builderSettings.sevenZipFile = options.sevenZipFile;
+	builderSettings.workingDirectory = options.workingDirectory;
+	builderSettings.stagingDirectory = options.stagingDirectory;
+	builderSettings.maxArchiverProcesses = options.maxArchiverProcesses;
+	builderSettings.archiverTimeoutSeconds = options.archiverTimeoutSeconds;
+	builderSettings.verifyArchives = options.verifyArchives && !options.onlyMakeSummaryFile;
+	builderSettings.compressionDeadlineSeconds = options.onlyMakeSummaryFile ? 0 : options.compressionDeadlineSeconds;
+	builderSettings.compressionTargetBytesPerSecond = options.onlyMakeSummaryFile ? 0
+		: options.compressionTargetBytesPerSecond;
+	builder = new ArchiveBuilder(builderSettings, throttle, manifest, progress, cancel);
+	return true;
+}
+
+bool SplitterRun::startWatching() {
+	watcher = new DirectoryWatcher();
+	if (!filter.empty()) {
+		watcher->setFilter(&filter);
+	}
+	if (!watcher->start(options.inputDirectory, options.watchSettleSeconds)) {
+		result.errorMessage = watcher->errorMessage();
+		return false;
+	}
+	for (size_t i = 0; i < fileInfo.files.size(); i ++) {
+		knownFiles.insert(fileInfo.files[i].fileName);
+	}
+	lastRescan = std::chrono::steady_clock::now();
+	return true;
+}
+
+bool SplitterRun::waitForOpenArchive() {
+	bool watchIdle = false;
+	while (!cancel.cancelled()) {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+		long long openGroupSize = totalFileSize(fileInfo.files);
+		if (openGroupSize >= options.maxFileSize || (fileInfo.files.size() > 0
+			&& now - openGroupStarted >= std::chrono::seconds(options.watchGroupAgeSeconds))) {
+			return true;
+		}
+
+		//Nothing to archive yet: let the archives in progress finish and
+		//bring the summary and the locator index up to date
+		if (!watchIdle) {
+			builder->finish();
+			builder->collectVerification(true);
+			manifest.flush();
+			writeLocatorIndex();
+			writeFileSets(false);
+			progress.report(PROGRESS_MESSAGE, "Watching " + options.inputDirectory + " (" + itos(fileInfo.files.size())
+				+ " files, " + getFormattedSizeTitle(openGroupSize) + " waiting)");
+			progress.report(PROGRESS_STATUS, "Watching: " + itos(fileInfo.files.size()) + " files waiting");
+			watchIdle = true;
+		}
+
+		std::vector<std::string> finishedFiles = watcher->waitForFiles(WATCH_WAIT_MILLISECONDS);
+
+		//Look over the whole directory now and then, in case notifications were missed.
+		//The files it turns up are only added once they are finished, too.
+		if (watcher->overflowed() || now - lastRescan >= std::chrono::seconds(options.watchRescanSeconds)) {
+			rescan();
+		}
+
+		unsigned int filesAdded = 0;
+		for (size_t i = 0; i < finishedFiles.size(); i ++) {
+			FileInformationPiece file;
+			if (knownFiles.count(finishedFiles[i]) > 0 || !fileInformationGet(finishedFiles[i], file)) {
+				continue;
+			}
+			knownFiles.insert(finishedFiles[i]);
+			if (!filter.empty() && !filter.includesPath(relativeFilePath(finishedFiles[i], options.inputDirectory), file)) {
+				continue;
+			}
+
+			if (fileInfo.files.empty()) {
+				openGroupStarted = std::chrono::steady_clock::now();
+			}
+			fileInfo.files.push_back(file);
+			filesAdded ++;
+		}
+
+		if (filesAdded > 0) {
+			totalFiles += filesAdded;
+			result.filesFound = totalFiles;
+			packer->sortFiles(fileInfo.files);
+			progress.setFileCounts(totalFiles - fileInfo.files.size(), totalFiles);
+			progress.report(PROGRESS_MESSAGE, itos(filesAdded) + " new files found.");
+		}
+	}
+	return false;
+}
+
+void SplitterRun::rescan() {
+	//Rescans aren't reported file by file
+	ProgressReporter quiet((ProgressCallback()));
+	FileScanner scanner(quiet, cancel);
+	//New files are counted against the rules when they are added, not here
+	FileFilter rescanFilter(filter);
+	if (!rescanFilter.empty()) {
+		scanner.setFilter(&rescanFilter);
+	}
+	FileInformation rescanned;
+	scanner.scan(options.inputDirectory, rescanned);
+	for (size_t i = 0; i < rescanned.files.size(); i ++) {
+		if (knownFiles.count(rescanned.files[i].fileName) == 0) {
+			watcher->addCandidate(rescanned.files[i].fileName);
+		}
+	}
+	lastRescan = std::chrono::steady_clock::now();
+}
+
+void SplitterRun::makeArchive(std::vector<FileInformationPiece> &archiveFiles) {
+	unsigned long long filesDone = totalFiles - fileInfo.files.size();
+	progress.setFileCounts(filesDone, totalFiles);
+	progress.report(PROGRESS_STATUS, dtos(floorDoubleAt((double)filesDone / (double)totalFiles, 00.001) * 100.0)
+		+ "% completed.");
+
+	std::string idString = itos(currentArchiveId);
+	padWithZeroes(idString, options.idStringPaddingAmount);
+
+	//Archive names in the locator index are relative to the output directory
+	std::string locatorName = options.namingConvention;
+	stringReplaceAll(locatorName, "+ID_HERE+", idString);
+
+	ArchiveJob job;
+	job.archiveId = currentArchiveId;
+	job.archivePath = options.outputDirectory + locatorName;
+	job.archiveName = "\"" + job.archivePath + "\"";
+	job.files = archiveFiles;
+	job.inputSize = totalFileSize(archiveFiles);
+
+	std::vector<long long> fileSizes;
+	for (size_t i = 0; i < archiveFiles.size(); i ++) {
+		job.entryNames.push_back(relativeFilePath(archiveFiles[i].fileName, options.inputDirectory));
+		fileSizes.push_back(archiveFiles[i].fileSize);
+	}
+
+	//Every file goes in the locator index, including the files of skipped archives
+	manifest.addLocatorArchive(currentArchiveId, locatorName, job.entryNames, fileSizes);
+	bool builtinWritesArchive = options.useBuiltinCompressor && !options.onlyMakeSummaryFile
+		&& currentArchiveId >= options.archiveToStartAt;
+	if (options.archiveType == ARCHIVE_FILE_TYPE_ZIP && !builtinWritesArchive) {
+		manifest.locateZipArchive(currentArchiveId, job.archivePath);
+	}
+
+	if (currentArchiveId < options.archiveToStartAt) {
+		if (setIndex != NULL) {
+			setIndex->keep(locatorName);
+		}
+		return;
+	}
+
+	//Output total archive size
+	progress.report(PROGRESS_MESSAGE, itos(archiveFiles.size()) + " files in archive list of archive #"
+		+ itos(currentArchiveId) + ".  Total archive size: " + getFormattedSizeTitle(job.inputSize), currentArchiveId);
+
+	manifest.addArchive(job.archiveName, job.entryNames, fileSizes);
+
+	if (options.onlyMakeSummaryFile) {
+		progress.report(PROGRESS_ARCHIVE_STARTED, "Finished creating archive #" + itos(currentArchiveId),
+			currentArchiveId);
+		return;
+	}
+
+	//Keep the previous run's archive of the same files
+	if (setIndex != NULL) {
+		NewFileSet fileSet;
+		fileSet.archiveId = currentArchiveId;
+		fileSet.hash = ArchiveSetIndex::fileSetHash(archiveSettings, job.entryNames, job.files);
+		fileSet.archiveName = locatorName;
+
+		if (setIndex->reuse(fileSet.hash, locatorName)) {
+			if (options.archiveType == ARCHIVE_FILE_TYPE_ZIP && builtinWritesArchive) {
+				manifest.locateZipArchive(currentArchiveId, job.archivePath);
+			}
+			result.archivesReused ++;
+			progress.report(PROGRESS_ARCHIVE_FINISHED, "Archive #" + itos(currentArchiveId) + " is unchanged; kept "
+				+ job.archiveName, currentArchiveId);
+			return;
+		}
+
+		setIndex->clearPath(locatorName);
+		newFileSets.push_back(fileSet);
+	}
+
+	builder->build(job, (unsigned long long)(job.inputSize + totalFileSize(fileInfo.files)));
+}
+
+void SplitterRun::finish() {
+	//Wait for the last 7-Zip processes (stopping them if cancelled)
+	builder->finish();
+
+	//Wait for the last archives to be checked, and list the results in the summary file
+	if (options.verifyArchives && !options.onlyMakeSummaryFile) {
+		builder->collectVerification(true);
+		const std::vector<VerificationResult> &results = builder->verificationResults();
+		for (size_t i = 0; i < results.size(); i ++) {
+			if (!results[i].ok) {
+				result.archivesFailedVerification ++;
+			}
+		}
+		manifest.addVerification(results);
+		progress.report(PROGRESS_MESSAGE, "Verified " + itos(results.size()) + " archives: "
+			+ itos(result.archivesFailedVerification) + " failed");
+	}
+
+	//List the compression levels that were picked, and how each archive went
+	if (builder->compressionPlanner() != NULL) {
+		std::string target = options.compressionDeadlineSeconds > 0
+			? "deadline " + dtos(options.compressionDeadlineSeconds) + " seconds"
+			: "target " + getFormattedSizeTitle((long long)options.compressionTargetBytesPerSecond) + "/s";
+		manifest.addCompressionLevels(target, builder->compressionPlanner()->measurements());
+	}
+
+	if (!filter.empty()) {
+		manifest.addFilterRules(filter.rules());
+	}
+
+	writeLocatorIndex();
+	writeFileSets(true);
+	manifest.close();
+
+	result.archivesMade = builder->archivesMade();
+	result.cancelled = cancel.cancelled();
+}
+
+//Puts the archives that were made in the file set index, and writes it.  At
+//the end of a complete run, the previous archives that weren't reused are
+//deleted (after a cancelled one, they are kept for the next run).
+void SplitterRun::writeFileSets(bool final) {
+	if (setIndex == NULL) {
+		return;
+	}
+
+	//The archives are all finished here, so the ones that weren't made failed
+	for (size_t i = 0; i < newFileSets.size(); i ++) {
+		if (builder->archiveMade(newFileSets[i].archiveId)) {
+			setIndex->record(newFileSets[i].hash, newFileSets[i].archiveName);
+		}
+	}
+	newFileSets.clear();
+
+	if (final && !cancel.cancelled()) {
+		std::vector<std::string> removed = setIndex->removeUnused();
+		for (size_t i = 0; i < removed.size(); i ++) {
+			progress.report(PROGRESS_MESSAGE, "Removed " + removed[i] + " (its files have changed)");
+		}
+	}
+
+	if (!setIndex->write()) {
+		progress.report(PROGRESS_ERROR, setIndex->errorMessage());
+	}
+}
+
+//How many entries of the scan each rule decided on (the files and
+//directories in an excluded directory aren't counted, as it isn't opened)
+void SplitterRun::reportFilterRules() {
+	const std::vector<FilterRule> &rules = filter.rules();
+	for (size_t i = 0; i < rules.size(); i ++) {
+		progress.report(PROGRESS_MESSAGE, "Filter rule " + itos(i + 1) + " (" + rules[i].text + "): "
+			+ itos(rules[i].filesMatched) + " files, " + itos(rules[i].directoriesMatched) + " directories");
+	}
+}
+
+void SplitterRun::writeLocatorIndex() {
+	if (!options.makeLocatorIndex) {
+		return;
+	}
+
+	std::vector<std::string> warnings;
+	bool written = manifest.writeLocatorIndex(warnings);
+	for (size_t i = 0; i < warnings.size(); i ++) {
+		progress.report(PROGRESS_WARNING, warnings[i]);
+	}
+	if (written) {
+		progress.report(PROGRESS_MESSAGE, "Locator index written for " + itos(manifest.locatorFileCount()) + " files");
+	} else {
+		progress.report(PROGRESS_ERROR, manifest.errorMessage());
+	}
+}
+
+}
+
+////////////////
+//   OPTIONS
+////////////////
+
+SplitterOptions::SplitterOptions()
+	: namingConvention("+ID_HERE+.7z"),
+	  idStringPaddingAmount(4),
+	  archiveType(ARCHIVE_FILE_TYPE_7Z),
+	  //Maximum archive file size = 1 GiB
+	  maxFileSize(1024 * 1024 * 1024),
+	  compressFiles(false),
+	  useBuiltinCompressor(false),
+	  builtinCompressionLevel(6),
+	  packingMode(PACK_IN_ORDER),
+	  skipUnchangedArchives(false),
+	  archiveToStartAt(0),
+	  makeSummaryFile(true),
+	  onlyMakeSummaryFile(false),
+	  summaryDetailLevel(1),
+	  verifyArchives(false),
+	  makeLocatorIndex(true),
+	  maxArchiverProcesses(1),
+	  archiverTimeoutSeconds(0),
+	  compressionDeadlineSeconds(0),
+	  compressionTargetBytesPerSecond(0),
+	  watchMode(false),
+	  watchGroupAgeSeconds(15 * 60),
+	  watchRescanSeconds(60 * 60),
+	  watchSettleSeconds(5),
+#ifdef _WIN32
+	  sevenZipFile("7za.exe"),
+#else
+	  sevenZipFile("7za"),
+#endif
+	  summaryFilename("summary.txt"),
+	  locatorIndexFilename("locator.idx"),
+	  throttleControlFilename("throttle.txt"),
+	  fileSetsFilename("filesets.txt") {
+}
+
+////////////////
+//   RUN
+////////////////
+
+SplitterResult splitterRun(const SplitterOptions &options, const ProgressCallback &progress,
+						   const CancellationToken &cancel) {
+	SplitterRun run(options, progress, cancel);
+	return run.run();
+}
@@ -0,0 +1,168 @@
+// Archiver and Splitter
+// splitter.h
+// Splits a directory into archives: the whole run, for embedding in other programs
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "archivepacker.h"
+#include "cancellation.h"
+#include "progress.h"
+
+#define ARCHIVE_FILE_TYPE_7Z 0
+#define ARCHIVE_FILE_TYPE_ZIP 1
+
+//Everything a run can be told.  The constructor fills in the defaults the
+//command line uses.
+struct SplitterOptions {
+	SplitterOptions();
+
+	//The directory to archive, and where the archives go
+	std::string inputDirectory;
+	std::string outputDirectory;
+
+	//Include and exclude rules for the files to archive (see FilterRule),
+	//and a file of more of them, one per line ("" = none).  The rules from
+	//the file come after these.  Excluded directories aren't scanned.
+	std::vector<std::string> filterRules;
+	std::string filterRulesFile;
+
+	//+ID_HERE+ is replaced with the archive's number
+	std::string namingConvention;
+
+	//The minimum number of digits for the ID to use
+	//--Padding Amount--    --ID--    --Result--
+	//        4               16         0016
+	//        3               2          002
+	//        1               16         16
+	int idStringPaddingAmount;
+
+	//ARCHIVE_FILE_TYPE_7Z or ARCHIVE_FILE_TYPE_ZIP
+	int archiveType;
+
+	std::string password;
+
+	//Maximum total size of the files in each archive
+	long long maxFileSize;
+
+	//If this option is enabled, files will be compressed (slower)
+	//Otherwise, files will only be stored in the archive (faster)
+	bool compressFiles;
+
+	//If this option is enabled, ZIP archives are compressed by the built-in
+	//multi-threaded deflate compressor instead of 7-Zip.  Files are read
+	//straight from the input directory (no copy to the temp directory) and
+	//large files are split into blocks that are compressed on all cores.
+	bool useBuiltinCompressor;
+
+	//Deflate level used by the built-in compressor (0 = store only, 1 = fastest, 9 = smallest)
+	int builtinCompressionLevel;
+
+	//PACK_IN_ORDER keeps the order of the files, PACK_FIT_SIZE tries to fit
+	//the files together nicely, and PACK_STABLE keeps the order with archive
+	//boundaries that stay put from one run to the next
+	PackingMode packingMode;
+
+	//If this option is enabled, an archive whose files (names, sizes and
+	//modification times) are the same as one of the previous run's is kept
+	//instead of being made again.  The file sets are kept in the output
+	//directory, in fileSetsFilename.
+	bool skipUnchangedArchives;
+
+	//Archives numbered below this are skipped (their files still go in the
+	//summary and the locator index)
+	int archiveToStartAt;
+
+	//If this option is enabled, the program will make a summary file detailing
+	//the files in each archive
+	bool makeSummaryFile;
+
+	//If the option is enabled, the program will only make the summary file
+	bool onlyMakeSummaryFile;
+
+	//If this option is 0, the summary will include only the names of the files.
+	//If it is 1, the summary will also include approximated file sizes.
+	int summaryDetailLevel;
+
+	//If this option is enabled, each finished archive is read back on other
+	//threads (while the next archives are being made) and checked against
+	//the files that were supposed to go in it
+	bool verifyArchives;
+
+	//If this option is enabled, the program will write an index of which
+	//archive (and where in it) each file is, for "locate" and "extract-one"
+	bool makeLocatorIndex;
+
+	//Maximum number of 7-Zip processes running at once.  With more than one,
+	//the next archive is copied to the temp directory while 7-Zip is still
+	//working on the previous ones (each archive gets its own temp directory,
+	//so this takes more disk space).
+	unsigned int maxArchiverProcesses;
+
+	//7-Zip is stopped if it works on one archive for longer than this
+	//many seconds (0 = no limit)
+	unsigned int archiverTimeoutSeconds;
+
+	//Automatic compression level: finish within this many seconds, or keep
+	//up this many bytes per second (0 = off; the level is fixed)
+	double compressionDeadlineSeconds;
+	double compressionTargetBytesPerSecond;
+
+	//If this option is enabled, the run keeps watching the input directory
+	//after the first pass and archives new files once they are finished,
+	//until it is cancelled
+	bool watchMode;
+
+	//Watch mode: the open archive is made once its first file has waited this
+	//many seconds, even if it isn't full
+	unsigned int watchGroupAgeSeconds;
+
+	//Watch mode: the input directory is scanned again this often, for files
+	//the change notifications missed
+	unsigned int watchRescanSeconds;
+
+	//Watch mode: a file counts as finished once it has gone this many seconds
+	//without changing (where closing it isn't reported directly)
+	unsigned int watchSettleSeconds;
+
+	//The 7-Zip command-line executable, and the directory it runs in ("" =
+	//the current one)
+	std::string sevenZipFile;
+	std::string workingDirectory;
+
+	//Temp directory the files are copied to for 7-Zip ("" = archiver_splitter
+	//in the system's temp directory).  Runs at the same time need different ones.
+	std::string stagingDirectory;
+
+	//File names in the output directory
+	std::string summaryFilename;
+	std::string locatorIndexFilename;
+	std::string throttleControlFilename;
+	std::string fileSetsFilename;
+};
+
+struct SplitterResult {
+	//False if the run couldn't get started (errorMessage says why)
+	bool ok;
+	//True if the run was stopped by its cancellation token
+	bool cancelled;
+	std::string errorMessage;
+
+	unsigned long long filesFound;
+	//Archives made in this run (not counting skipped ones), and the ones
+	//that failed verification
+	unsigned int archivesMade;
+	//Archives kept from the previous run, because their files hadn't changed
+	unsigned int archivesReused;
+	unsigned int archivesFailedVerification;
+};
+
+//Archives options.inputDirectory into options.outputDirectory.  Progress is
+//reported through progress (on the calling thread); the run stops early once
+//cancel is cancelled.  Runs share nothing, so a long-lived program can make
+//any number of them, one after another or on several threads at once (with
+//different staging directories).
+SplitterResult splitterRun(const SplitterOptions &options, const ProgressCallback &progress,
+						   const CancellationToken &cancel);
@@ -0,0 +1,430 @@
+// Archiver and Splitter
+// splittertests.cpp
+// Unit tests for the library: packing, ZIP files, throttling, progress and cancellation
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "archivepacker.h"
+#include "cancellation.h"
+#include "iothrottle.h"
+#include "progress.h"
+#include "splitter.h"
+#include "threadpool.h"
+#include "utilities.h"
+#include "zipreader.h"
+#include "zipwriter.h"
+
+////////////////
+//   CHECKS
+////////////////
+
+namespace {
+
+int checksFailed = 0;
+
+void checkFailed(const char *expression, const char *file, int line) {
+	std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+	checksFailed ++;
+}
+
+}
+
+#define CHECK(expression) ((expression) ? (void)0 : checkFailed(#expression, __FILE__, __LINE__))
+
+////////////////
+//   HELPERS
+////////////////
+
+namespace {
+
+//An empty directory of its own in the system's temp directory
+std::string makeTestDirectory(const std::string &name) {
+	std::random_device random;
+	std::string directory = getTempDirectory() + "archiver_splitter_tests_" + name + "_" + itos(random() & 0xffffff);
+	directory = directoryWithSeparator(directory);
+	clearTempDirectory(directory);
+	return directory;
+}
+
+//Text repeats, so it compresses; random bytes don't
+std::string makeContents(size_t length, bool compressible, unsigned int seed) {
+	std::string contents(length, '\0');
+	std::mt19937 generator(seed);
+	for (size_t i = 0; i < length; i ++) {
+		contents[i] = compressible ? "archiver splitter "[(i + seed) % 18] : (char)(generator() & 0xff);
+	}
+	return contents;
+}
+
+bool writeFile(const std::string &path, const std::string &contents) {
+	std::ofstream file(path.c_str(), std::ios::binary);
+	file.write(contents.data(), contents.size());
+	return file.good();
+}
+
+std::vector<FileInformationPiece> makeFiles(const std::string &baseDirectory, const std::vector<long long> &sizes) {
+	std::vector<FileInformationPiece> files;
+	for (size_t i = 0; i < sizes.size(); i ++) {
+		FileInformationPiece file;
+		file.fileName = baseDirectory + "file" + itos((int)i);
+		file.fileSize = sizes[i];
+		file.modifiedTime = 0;
+		files.push_back(file);
+	}
+	return files;
+}
+
+//The names in each archive, in the order nextArchive gave them
+std::vector<std::vector<std::string> > packAll(PackingMode mode, long long maxFileSize,
+											   std::vector<FileInformationPiece> files) {
+	ArchivePacker packer(mode, maxFileSize, "/base/");
+	packer.sortFiles(files);
+	std::vector<std::vector<std::string> > archives;
+	while (!files.empty()) {
+		std::vector<FileInformationPiece> archiveFiles = packer.nextArchive(files);
+		std::vector<std::string> names;
+		for (size_t i = 0; i < archiveFiles.size(); i ++) {
+			names.push_back(archiveFiles[i].fileName);
+		}
+		archives.push_back(names);
+	}
+	return archives;
+}
+
+}
+
+////////////////
+//   PACKING
+////////////////
+
+namespace {
+
+void testPackInOrder() {
+	long long sizes[] = {40, 40, 40, 150, 10};
+	std::vector<std::vector<std::string> > archives = packAll(PACK_IN_ORDER, 100,
+		makeFiles("/base/", std::vector<long long>(sizes, sizes + 5)));
+
+	CHECK(archives.size() == 4);
+	if (archives.size() == 4) {
+		CHECK(archives[0].size() == 2 && archives[0][0] == "/base/file0" && archives[0][1] == "/base/file1");
+		CHECK(archives[1].size() == 1 && archives[1][0] == "/base/file2");
+		//Bigger than the maximum: an archive of its own
+		CHECK(archives[2].size() == 1 && archives[2][0] == "/base/file3");
+		CHECK(archives[3].size() == 1 && archives[3][0] == "/base/file4");
+	}
+}
+
+void testPackFitSize() {
+	long long sizes[] = {40, 70, 20, 50, 150};
+	std::vector<std::vector<std::string> > archives = packAll(PACK_FIT_SIZE, 100,
+		makeFiles("/base/", std::vector<long long>(sizes, sizes + 5)));
+
+	//Biggest first, filled with the files that still fit
+	CHECK(archives.size() == 3);
+	if (archives.size() == 3) {
+		CHECK(archives[0].size() == 1 && archives[0][0] == "/base/file4");
+		CHECK(archives[1].size() == 2 && archives[1][0] == "/base/file1" && archives[1][1] == "/base/file2");
+		CHECK(archives[2].size() == 2 && archives[2][0] == "/base/file3" && archives[2][1] == "/base/file0");
+	}
+}
+
+void testPackStable() {
+	const long long maxFileSize = 10000;
+	std::mt19937 generator(1);
+	std::vector<long long> sizes;
+	for (int i = 0; i < 400; i ++) {
+		sizes.push_back(1 + generator() % 1000);
+	}
+	std::vector<FileInformationPiece> files = makeFiles("/base/", sizes);
+	std::vector<std::vector<std::string> > archives = packAll(PACK_STABLE, maxFileSize, files);
+
+	//Every file once, in order, and every archive but the last between a
+	//quarter of the maximum and the maximum
+	size_t next = 0;
+	bool inOrder = true;
+	bool sizesInRange = true;
+	for (size_t a = 0; a < archives.size(); a ++) {
+		long long archiveSize = 0;
+		for (size_t i = 0; i < archives[a].size(); i ++, next ++) {
+			inOrder = inOrder && next < files.size() && archives[a][i] == files[next].fileName;
+			archiveSize += next < files.size() ? files[next].fileSize : 0;
+		}
+		sizesInRange = sizesInRange && archiveSize < maxFileSize
+			&& (a + 1 == archives.size() || archiveSize >= maxFileSize / 4);
+	}
+	CHECK(inOrder && next == files.size());
+	CHECK(sizesInRange);
+
+	//Adding a file in the middle only changes the archives next to it
+	FileInformationPiece added;
+	added.fileName = "/base/added";
+	added.fileSize = 500;
+	added.modifiedTime = 0;
+	files.insert(files.begin() + 200, added);
+	std::vector<std::vector<std::string> > changedArchives = packAll(PACK_STABLE, maxFileSize, files);
+
+	std::set<std::vector<std::string> > before(archives.begin(), archives.end());
+	size_t unchanged = 0;
+	for (size_t a = 0; a < changedArchives.size(); a ++) {
+		unchanged += before.count(changedArchives[a]);
+	}
+	CHECK(archives.size() > 10);
+	CHECK(unchanged + 3 >= archives.size());
+}
+
+}
+
+////////////////
+//   ZIP FILES
+////////////////
+
+namespace {
+
+//Writes the files with ZipWriter and reads them back with ZipReader
+void checkZipRoundTrip(const std::string &directory, int level, const std::string &password) {
+	std::vector<std::string> contents;
+	//Empty, several blocks of text, and bytes that don't compress
+	contents.push_back("");
+	contents.push_back(makeContents(3 * ZIP_DEFAULT_BLOCK_SIZE + 1000, true, 1));
+	contents.push_back(makeContents(ZIP_DEFAULT_BLOCK_SIZE / 2, false, 2));
+
+	std::vector<ZipEntrySource> sources;
+	for (size_t i = 0; i < contents.size(); i ++) {
+		ZipEntrySource source;
+		source.sourcePath = directory + "input" + itos((int)i);
+		source.entryName = "folder/entry" + itos((int)i) + ".bin";
+		CHECK(writeFile(source.sourcePath, contents[i]));
+		sources.push_back(source);
+	}
+
+	std::string archivePath = directory + "roundtrip" + itos(level) + (password.empty() ? "" : "e") + ".zip";
+	ThreadPool pool(4);
+	ZipWriter writer(pool, level);
+	writer.setPassword(password);
+	CHECK(writer.open(archivePath));
+	CHECK(writer.addFiles(sources));
+	CHECK(writer.close());
+	CHECK(writer.entries().size() == sources.size());
+
+	ZipReader reader;
+	std::vector<ZipEntryInfo> entries;
+	CHECK(reader.open(archivePath));
+	CHECK(reader.readCentralDirectory(entries));
+	CHECK(entries.size() == sources.size());
+	for (size_t i = 0; i < entries.size() && i < sources.size(); i ++) {
+		CHECK(entries[i].entryName == sources[i].entryName);
+		CHECK(entries[i].uncompressedSize == contents[i].size());
+		CHECK(entries[i].encrypted == !password.empty());
+
+		std::string extracted;
+		bool extractedOk = reader.extractEntry(entries[i], password, [&](const unsigned char *data, size_t size) {
+			extracted.append((const char *)data, size);
+			return true;
+		});
+		CHECK(extractedOk);
+		CHECK(extracted == contents[i]);
+	}
+	//The text compresses, unless it is only stored
+	if (entries.size() == sources.size()) {
+		CHECK(level == 0 ? entries[1].compressedSize >= contents[1].size()
+			: entries[1].compressedSize < contents[1].size() / 10);
+	}
+	//The wrong password is caught
+	if (!password.empty() && entries.size() == sources.size()) {
+		CHECK(!reader.extractEntry(entries[1], password + "x", [](const unsigned char *, size_t) {
+			return true;
+		}));
+	}
+	reader.close();
+}
+
+void testZipRoundTrip() {
+	std::string directory = makeTestDirectory("zip");
+	checkZipRoundTrip(directory, 0, "");
+	checkZipRoundTrip(directory, 6, "");
+	checkZipRoundTrip(directory, 6, "secret");
+	deleteDirectory(directory);
+}
+
+}
+
+////////////////
+//   THROTTLING
+////////////////
+
+namespace {
+
+double timedCopy(const std::string &sourcePath, const std::string &destinationPath, IoThrottle &throttle) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CHECK(throttledCopyFile(sourcePath, destinationPath, throttle));
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void testThrottledCopy() {
+	std::string directory = makeTestDirectory("throttle");
+	std::string smallFile = makeContents(4 * 1024, false, 3);
+	std::string largerFile = makeContents(32 * 1024, false, 4);
+	CHECK(writeFile(directory + "small", smallFile));
+	CHECK(writeFile(directory + "larger", largerFile));
+
+	ThrottleSettings settings;
+	settings.readBytesPerSecond = 64 * 1024;
+	settings.writeBytesPerSecond = 0;
+	settings.compressionThreads = 0;
+	settings.latencyTargetMilliseconds = 0;
+
+	//A small file costs what it reads (about 0.06 seconds here), not a
+	//whole copy buffer
+	IoThrottle throttle;
+	throttle.apply(settings);
+	CHECK(timedCopy(directory + "small", directory + "small copy", throttle) < 1.0);
+
+	//A bigger one is still held to the limit (half a second)
+	IoThrottle largerThrottle;
+	largerThrottle.apply(settings);
+	CHECK(timedCopy(directory + "larger", directory + "larger copy", largerThrottle) > 0.4);
+
+	std::ifstream copy((directory + "small copy").c_str(), std::ios::binary);
+	std::string copied((std::istreambuf_iterator<char>(copy)), std::istreambuf_iterator<char>());
+	CHECK(copied == smallFile);
+	copy.close();
+
+	deleteDirectory(directory);
+}
+
+}
+
+////////////////
+//   RUNS
+////////////////
+
+namespace {
+
+//An input directory of small files, split into several ZIP files
+SplitterOptions makeRunOptions(const std::string &directory) {
+	std::string inputDirectory = directory + "input/";
+	directoryCreate(inputDirectory + "sub/");
+	for (int i = 0; i < 12; i ++) {
+		writeFile(inputDirectory + (i % 2 == 0 ? "" : "sub/") + "file" + itos(i) + ".txt",
+			makeContents(20000 + i * 1000, true, i));
+	}
+
+	SplitterOptions options;
+	options.inputDirectory = inputDirectory;
+	options.outputDirectory = directory + "output/";
+	options.stagingDirectory = directory + "staging/";
+	options.archiveType = ARCHIVE_FILE_TYPE_ZIP;
+	options.namingConvention = "+ID_HERE+.zip";
+	options.useBuiltinCompressor = true;
+	options.compressFiles = true;
+	options.builtinCompressionLevel = 1;
+	//About three files per archive
+	options.maxFileSize = 80000;
+	return options;
+}
+
+void testProgressEvents() {
+	std::string directory = makeTestDirectory("progress");
+	SplitterOptions options = makeRunOptions(directory);
+
+	std::vector<ProgressEvent> events;
+	SplitterResult result = splitterRun(options, [&](const ProgressEvent &event) {
+		events.push_back(event);
+	}, CancellationToken());
+
+	CHECK(result.ok);
+	CHECK(!result.cancelled);
+	CHECK(result.filesFound == 12);
+	CHECK(result.archivesMade >= 4);
+
+	unsigned int started = 0;
+	unsigned int finished = 0;
+	bool totalsKnown = true;
+	bool countsInOrder = true;
+	unsigned long long lastFilesDone = 0;
+	std::set<int> finishedIds;
+	for (size_t i = 0; i < events.size(); i ++) {
+		const ProgressEvent &event = events[i];
+		CHECK(event.type != PROGRESS_ERROR);
+		if (event.type == PROGRESS_ARCHIVE_STARTED) {
+			started ++;
+			totalsKnown = totalsKnown && event.filesTotal == 12;
+		}
+		if (event.type == PROGRESS_ARCHIVE_FINISHED) {
+			finished ++;
+			finishedIds.insert(event.archiveId);
+			CHECK(FileExists(options.outputDirectory + itos(event.archiveId) + ".zip")
+				|| FileExists(options.outputDirectory + "000" + itos(event.archiveId) + ".zip"));
+		}
+		countsInOrder = countsInOrder && event.filesDone >= lastFilesDone && event.filesDone <= event.filesTotal;
+		lastFilesDone = event.filesDone;
+	}
+	CHECK(totalsKnown);
+	CHECK(countsInOrder);
+	CHECK(started == result.archivesMade);
+	CHECK(finished == result.archivesMade);
+	CHECK(finishedIds.size() == result.archivesMade);
+	CHECK(!events.empty() && events.back().filesDone == 12 && events.back().filesTotal == 12);
+	CHECK(FileExists(options.outputDirectory + options.summaryFilename));
+	CHECK(FileExists(options.outputDirectory + options.locatorIndexFilename));
+
+	deleteDirectory(directory);
+}
+
+void testCancellation() {
+	std::string directory = makeTestDirectory("cancel");
+	SplitterOptions options = makeRunOptions(directory);
+
+	//Cancelled from the callback once the first archive is finished
+	CancellationToken cancel;
+	unsigned int finished = 0;
+	SplitterResult result = splitterRun(options, [&](const ProgressEvent &event) {
+		if (event.type == PROGRESS_ARCHIVE_FINISHED) {
+			finished ++;
+			cancel.cancel();
+		}
+	}, cancel);
+
+	CHECK(result.ok);
+	CHECK(result.cancelled);
+	CHECK(result.filesFound == 12);
+	CHECK(result.archivesMade >= 1);
+	CHECK(result.archivesMade < 4);
+	CHECK(finished == result.archivesMade);
+	//What was finished is still listed
+	CHECK(FileExists(options.outputDirectory + options.summaryFilename));
+	CHECK(FileExists(options.outputDirectory + options.locatorIndexFilename));
+
+	deleteDirectory(directory);
+}
+
+}
+
+////////////////
+//   MAIN
+////////////////
+
+int main() {
+	testPackInOrder();
+	testPackFitSize();
+	testPackStable();
+	testZipRoundTrip();
+	testThrottledCopy();
+	testProgressEvents();
+	testCancellation();
+
+	if (checksFailed > 0) {
+		std::cerr << checksFailed << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed" << std::endl;
+	return 0;
+}
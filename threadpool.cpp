@@ -0,0 +1,59 @@
+// Archiver and Splitter
+// threadpool.cpp
+
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false) {
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+	}
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount; i ++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i ++) {
+		workers[i].join();
+	}
+}
+
+unsigned int ThreadPool::size() const {
+	return (unsigned int)workers.size();
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(task);
+	}
+	taskAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && tasks.empty()) {
+				taskAvailable.wait(lock);
+			}
+			if (tasks.empty()) {
+				return;
+			}
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+	}
+}
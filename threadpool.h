@@ -0,0 +1,48 @@
+// Archiver and Splitter
+// threadpool.h
+// A fixed set of worker threads shared by everything that runs in parallel
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+	//threadCount = 0 uses one thread per hardware thread
+	explicit ThreadPool(unsigned int threadCount);
+	//Finishes the queued tasks and joins the workers
+	~ThreadPool();
+
+	unsigned int size() const;
+
+	//Queues a task and returns a future for its result.
+	//Tasks start in the order they were submitted.
+	template <class F>
+	auto submit(F task) -> std::future<decltype(task())> {
+		typedef decltype(task()) Result;
+		std::shared_ptr<std::packaged_task<Result()> > packaged(new std::packaged_task<Result()>(task));
+		std::future<Result> future = packaged->get_future();
+		enqueue([packaged]() { (*packaged)(); });
+		return future;
+	}
+
+private:
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+
+	void enqueue(std::function<void()> task);
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	bool stopping;
+};
@@ -0,0 +1,221 @@
+// Archiver and Splitter
+// utilities.cpp
+
+#include "utilities.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "iothrottle.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <ShlObj.h>
+#include <Shlwapi.h>
+#pragma comment(lib,"shlwapi.lib")
+#else
+#include <cerrno>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////
+//   STRINGS
+////////////////
+
+//Converts an integer to an std::string
+std::string itos(int i) {
+	std::ostringstream convert;
+	convert << i;
+	return convert.str();
+}
+
+//Converts a double to an std::string
+std::string dtos(double i) {
+	std::ostringstream convert;
+	convert << i;
+	return convert.str();
+}
+
+double floorDoubleAt(double db, double roundTo) {
+	return (double)floor(db / roundTo) * roundTo;
+}
+
+void padWithZeroes(std::string &num, unsigned int minimumNumberLength) {
+	while (num.length() < minimumNumberLength) {
+		num = "0" + num;
+	}
+}
+
+//Replaces all 'search string' occurances in 's string' and replaces them with 'replace string'
+void stringReplaceAll(std::string &s, const std::string &search, const std::string &replace) {
+	for(size_t pos = 0; ; pos += replace.length()) {
+		// Locate the substring to replace
+		pos = s.find(search, pos);
+		if (pos == std::string::npos) {
+			break;
+		}
+		// Replace by erasing and inserting
+		s.erase(pos, search.length());
+		s.insert(pos, replace);
+	}
+}
+
+//Updated 7/8/2014 to include a fixed decimal size (1 decimal place)
+std::string getFormattedSizeTitle(long long size) {
+
+	if (size < 1024) {
+		return itos(size) + " bytes";
+	} if (size < pow(1024,2)) {
+		std::ostringstream strs;
+		strs << std::fixed;
+		strs.precision(1);
+		strs << floorDoubleAt((double)size / 1024.0,0.1);
+		return strs.str() + " KiB";
+	} if (size < pow(1024,3)) {
+		std::ostringstream strs;
+		strs << std::fixed;
+		strs.precision(1);
+		strs << floorDoubleAt((double)size / (double)(pow(1024,2)),0.1);
+		return strs.str() + " MiB";
+	} else {
+		std::ostringstream strs;
+		strs << std::fixed;
+		strs.precision(1);
+		strs << floorDoubleAt((double)size / (double)(pow(1024,3)),0.1);
+		return strs.str() + " GiB";
+	}
+}
+
+std::string directoryWithSeparator(const std::string &directory) {
+	if (directory.empty() || directory[directory.length() - 1] == '/' || directory[directory.length() - 1] == '\\') {
+		return directory;
+	}
+	return directory + DIRECTORY_SEPARATOR;
+}
+
+////////////////
+//   FILES
+////////////////
+
+namespace {
+
+#ifndef _WIN32
+int removeTreeEntry(const char *path, const struct stat *, int, struct FTW *) {
+	return remove(path);
+}
+#endif
+
+}
+
+//Checks if a file exists
+bool FileExists(std::string filename) {
+	std::ifstream ifile(filename.c_str());
+	return ifile.is_open();
+}
+
+int FileSize(std::string name, long long &file_size) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if (!GetFileAttributesEx(name.c_str(), GetFileExInfoStandard, &fad)) {
+		return -1; // error condition, could call GetLastError to find out more
+	}
+	LARGE_INTEGER size;
+	size.HighPart = fad.nFileSizeHigh;
+	size.LowPart = fad.nFileSizeLow;
+	file_size = size.QuadPart;
+	return 0;
+#else
+	struct stat status;
+	if (stat(name.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+		return -1;
+	}
+	file_size = (long long)status.st_size;
+	return 0;
+#endif
+}
+
+bool fileCopy(const std::string &sourcePath, const std::string &destinationPath) {
+#ifdef _WIN32
+	return CopyFile(sourcePath.c_str(), destinationPath.c_str(), false) != 0;
+#else
+	//Without limits, the throttled copy goes at full speed
+	IoThrottle unlimited;
+	return throttledCopyFile(sourcePath, destinationPath, unlimited);
+#endif
+}
+
+bool directoryCreate(const std::string &directory) {
+#ifdef _WIN32
+	int result = SHCreateDirectoryEx(NULL, directory.c_str(), NULL);
+	return result == ERROR_SUCCESS || result == ERROR_ALREADY_EXISTS || result == ERROR_FILE_EXISTS;
+#else
+	for (size_t i = 1; i <= directory.length(); i ++) {
+		if (i < directory.length() && directory[i] != '/') {
+			continue;
+		}
+		std::string parent = directory.substr(0, i);
+		if (mkdir(parent.c_str(), 0777) != 0 && errno != EEXIST) {
+			return false;
+		}
+	}
+	struct stat status;
+	return stat(directory.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+#endif
+}
+
+bool deleteDirectory(std::string directory) {
+#ifdef _WIN32
+	//Delete it if it already exists
+	if (!PathIsDirectory(directory.c_str())) {
+		return true;
+	}
+
+	SHFILEOPSTRUCT fileOperation;
+	fileOperation.hwnd = NULL;
+	fileOperation.wFunc = FO_DELETE;
+
+	//Must be double null-terminated
+	std::string directoryDoubleNull = directory;
+	directoryDoubleNull.push_back('\0');
+
+	fileOperation.pFrom = directoryDoubleNull.c_str();
+	fileOperation.pTo = NULL;
+	fileOperation.fFlags = FOF_NO_UI;
+	fileOperation.hNameMappings = NULL;
+
+	fileOperation.fAnyOperationsAborted = FALSE;
+
+	//Not used
+	fileOperation.lpszProgressTitle = "";
+
+	return SHFileOperation(&fileOperation) == ERROR_SUCCESS;
+#else
+	struct stat status;
+	if (lstat(directory.c_str(), &status) != 0) {
+		return true;
+	}
+	//Children first, without following links out of the tree
+	return nftw(directory.c_str(), removeTreeEntry, 16, FTW_DEPTH | FTW_PHYS) == 0;
+#endif
+}
+
+bool clearTempDirectory(std::string tempDirectory) {
+	deleteDirectory(tempDirectory);
+	return directoryCreate(tempDirectory);
+}
+
+std::string getTempDirectory() {
+#ifdef _WIN32
+	char dirBuffer[MAX_PATH + 1];
+	GetTempPath(MAX_PATH + 1, dirBuffer);
+	return dirBuffer;
+#else
+	const char *tempDirectory = getenv("TMPDIR");
+	return directoryWithSeparator(tempDirectory != NULL && tempDirectory[0] != '\0' ? tempDirectory : "/tmp");
+#endif
+}
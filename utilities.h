@@ -0,0 +1,60 @@
+// Archiver and Splitter
+// utilities.h
+// String formatting and file system helpers shared by the library and the command line
+
+#pragma once
+
+#include <string>
+
+#ifdef _WIN32
+const char DIRECTORY_SEPARATOR = '\\';
+#else
+const char DIRECTORY_SEPARATOR = '/';
+#endif
+
+////////////////
+//   STRINGS
+////////////////
+
+std::string itos(int i);
+std::string dtos(double i);
+
+//Floors a double at a certain place
+//Example: number: 45.67 roundTo: 0.1 Output: 45.6
+double floorDoubleAt(double db, double roundTo);
+
+//Example: num = "45", minimumNumberLength = 4, RESULT = "0045"
+void padWithZeroes(std::string &num, unsigned int minimumNumberLength);
+
+void stringReplaceAll(std::string &s, const std::string &search, const std::string &replace);
+
+//"512 bytes", "1.5 KiB", "20.0 MiB", ...
+std::string getFormattedSizeTitle(long long size);
+
+//Adds a final path separator if there isn't one
+std::string directoryWithSeparator(const std::string &directory);
+
+////////////////
+//   FILES
+////////////////
+
+bool FileExists(std::string filename);
+
+//Returns -1 on error, 0 for normal
+int FileSize(std::string name, long long &file_size);
+
+//Copies a file, keeping its modification time
+bool fileCopy(const std::string &sourcePath, const std::string &destinationPath);
+
+//Creates a directory and any of its parents that are missing.
+//Returns true if the directory exists afterwards.
+bool directoryCreate(const std::string &directory);
+
+//Deletes a directory and everything in it.  A directory that doesn't exist is fine.
+bool deleteDirectory(std::string directory);
+
+//Deletes a directory if it exists, and creates it again empty
+bool clearTempDirectory(std::string tempDirectory);
+
+//The system's temporary directory (with final separator)
+std::string getTempDirectory();
@@ -0,0 +1,80 @@
+// Archiver and Splitter
+// winzipaes.cpp
+
+#include "winzipaes.h"
+
+#include <cstring>
+
+namespace {
+
+const unsigned int WINZIP_AES_ITERATIONS = 1000;
+
+}
+
+void winZipAesDeriveKeys(const std::string &password, const unsigned char salt[WINZIP_AES_SALT_SIZE],
+						 WinZipAesKeys &keys) {
+	unsigned char material[32 + 32 + WINZIP_AES_VERIFIER_SIZE];
+	pbkdf2HmacSha1(password.data(), password.length(), salt, WINZIP_AES_SALT_SIZE,
+		WINZIP_AES_ITERATIONS, material, sizeof(material));
+
+	memcpy(keys.salt, salt, WINZIP_AES_SALT_SIZE);
+	memcpy(keys.encryptionKey, material, 32);
+	memcpy(keys.authenticationKey, material + 32, 32);
+	memcpy(keys.passwordVerifier, material + 64, WINZIP_AES_VERIFIER_SIZE);
+}
+
+WinZipAesCipher::WinZipAesCipher(const WinZipAesKeys &keys) : keystreamUsed(16) {
+	aes.setKey(keys.encryptionKey);
+	hmac.setKey(keys.authenticationKey, 32);
+
+	//The counter starts at 1
+	memset(counter, 0, sizeof(counter));
+	counter[0] = 1;
+	memset(keystream, 0, sizeof(keystream));
+}
+
+void WinZipAesCipher::encrypt(unsigned char *data, size_t length) {
+	applyKeystream(data, length);
+	hmac.update(data, length);
+}
+
+void WinZipAesCipher::decrypt(unsigned char *data, size_t length) {
+	hmac.update(data, length);
+	applyKeystream(data, length);
+}
+
+void WinZipAesCipher::authenticationCode(unsigned char code[WINZIP_AES_AUTH_CODE_SIZE]) {
+	unsigned char mac[SHA1_DIGEST_SIZE];
+	hmac.final(mac);
+	memcpy(code, mac, WINZIP_AES_AUTH_CODE_SIZE);
+}
+
+bool WinZipAesCipher::hardwareAccelerated() const {
+	return aes.hardwareAccelerated();
+}
+
+void WinZipAesCipher::applyKeystream(unsigned char *data, size_t length) {
+	//Finish the block left over from the last call
+	while (length > 0 && keystreamUsed < 16) {
+		*data ^= keystream[keystreamUsed ++];
+		data ++;
+		length --;
+	}
+
+	//Whole blocks in one go
+	size_t blocks = length / 16;
+	if (blocks > 0) {
+		aes.ctrLittleEndian(counter, data, blocks);
+		data += blocks * 16;
+		length -= blocks * 16;
+	}
+
+	//Start a new block for the rest
+	if (length > 0) {
+		memset(keystream, 0, sizeof(keystream));
+		aes.ctrLittleEndian(counter, keystream, 1);
+		for (keystreamUsed = 0; keystreamUsed < length; keystreamUsed ++) {
+			data[keystreamUsed] ^= keystream[keystreamUsed];
+		}
+	}
+}
@@ -0,0 +1,60 @@
+// Archiver and Splitter
+// winzipaes.h
+// WinZip AES encryption for ZIP entries (AES-256 in CTR mode, HMAC-SHA1)
+
+#pragma once
+
+#include <string>
+
+#include "aes.h"
+#include "sha1.h"
+
+//Each encrypted entry's data is: salt, password verifier, encrypted data, authentication code
+#define WINZIP_AES_SALT_SIZE 16
+#define WINZIP_AES_VERIFIER_SIZE 2
+#define WINZIP_AES_AUTH_CODE_SIZE 10
+#define WINZIP_AES_OVERHEAD (WINZIP_AES_SALT_SIZE + WINZIP_AES_VERIFIER_SIZE + WINZIP_AES_AUTH_CODE_SIZE)
+
+//ZIP compression method for AES entries (the real method is in the 0x9901 extra field)
+#define WINZIP_AES_METHOD 99
+#define WINZIP_AES_EXTRA_ID 0x9901
+
+//Keys for one entry, derived from the password and that entry's salt
+struct WinZipAesKeys {
+	unsigned char salt[WINZIP_AES_SALT_SIZE];
+	unsigned char encryptionKey[32];
+	unsigned char authenticationKey[32];
+	unsigned char passwordVerifier[WINZIP_AES_VERIFIER_SIZE];
+};
+
+//Derives the keys with PBKDF2-HMAC-SHA1 (1000 iterations), as WinZip does.
+//This is deliberately slow (a few milliseconds), so it's worth running on a worker thread.
+void winZipAesDeriveKeys(const std::string &password, const unsigned char salt[WINZIP_AES_SALT_SIZE],
+						 WinZipAesKeys &keys);
+
+//Encrypts or decrypts one entry as a stream.  The data can be passed in
+//pieces of any size.
+class WinZipAesCipher {
+public:
+	explicit WinZipAesCipher(const WinZipAesKeys &keys);
+
+	//Encrypts in place
+	void encrypt(unsigned char *data, size_t length);
+	//Decrypts in place
+	void decrypt(unsigned char *data, size_t length);
+
+	//Authentication code of all the encrypted data so far
+	void authenticationCode(unsigned char code[WINZIP_AES_AUTH_CODE_SIZE]);
+
+	bool hardwareAccelerated() const;
+
+private:
+	void applyKeystream(unsigned char *data, size_t length);
+
+	Aes256 aes;
+	HmacSha1 hmac;
+	unsigned char counter[16];
+	unsigned char keystream[16];
+	//How much of 'keystream' has been used (16 = none left)
+	size_t keystreamUsed;
+};
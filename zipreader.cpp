@@ -0,0 +1,368 @@
+// Archiver and Splitter
+// zipreader.cpp
+
+#include "zipreader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "crc32.h"
+#include "winzipaes.h"
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+const uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;
+const uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+const uint32_t ZIP_END_SIGNATURE = 0x06054b50;
+const uint32_t ZIP64_END_SIGNATURE = 0x06064b50;
+const uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+
+const uint16_t ZIP_METHOD_STORE = 0;
+const uint16_t ZIP_METHOD_DEFLATE = 8;
+const uint16_t ZIP64_EXTRA_ID = 0x0001;
+const uint16_t ZIP_FLAG_ENCRYPTED = 0x0001;
+
+const uint32_t ZIP32_MAX = 0xFFFFFFFF;
+
+const size_t ZIP_END_SIZE = 22;
+const size_t ZIP64_END_SIZE = 56;
+const size_t ZIP64_LOCATOR_SIZE = 20;
+const size_t ZIP_COMMENT_MAX = 65535;
+
+const size_t READ_CHUNK_SIZE = 65536;
+
+////////////////
+//   HELPERS
+////////////////
+
+uint16_t get16(const unsigned char *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t get32(const unsigned char *p) {
+	return (uint32_t)get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+unsigned long long get64(const unsigned char *p) {
+	return (unsigned long long)get32(p) | ((unsigned long long)get32(p + 4) << 32);
+}
+
+//Finds one extra field; returns NULL if it isn't there
+const unsigned char *findExtra(const unsigned char *extra, size_t extraLength, uint16_t id, uint16_t &size) {
+	size_t position = 0;
+	while (position + 4 <= extraLength) {
+		uint16_t fieldId = get16(extra + position);
+		uint16_t fieldSize = get16(extra + position + 2);
+		if (position + 4 + fieldSize > extraLength) {
+			break;
+		}
+		if (fieldId == id) {
+			size = fieldSize;
+			return extra + position + 4;
+		}
+		position += 4 + fieldSize;
+	}
+	return NULL;
+}
+
+}
+
+////////////////
+//   ZIPREADER
+////////////////
+
+ZipReader::ZipReader() : archiveSize(0) {
+}
+
+bool ZipReader::open(const std::string &archivePath) {
+	close();
+	archive.open(archivePath.c_str(), std::ios::in | std::ios::binary);
+	if (!archive.is_open()) {
+		error = "Could not open " + archivePath;
+		return false;
+	}
+	archive.seekg(0, std::ios::end);
+	archiveSize = (unsigned long long)archive.tellg();
+	return true;
+}
+
+void ZipReader::close() {
+	if (archive.is_open()) {
+		archive.close();
+	}
+	archive.clear();
+	archiveSize = 0;
+}
+
+bool ZipReader::read(void *data, size_t length) {
+	archive.read((char *)data, length);
+	if ((size_t)archive.gcount() != length) {
+		error = "Unexpected end of the archive";
+		archive.clear();
+		return false;
+	}
+	return true;
+}
+
+bool ZipReader::readCentralDirectory(std::vector<ZipEntryInfo> &entries) {
+	entries.clear();
+
+	//The end record is at the end, after a comment of up to 64 KiB
+	size_t tailSize = (size_t)std::min<unsigned long long>(archiveSize, ZIP_END_SIZE + ZIP_COMMENT_MAX);
+	std::vector<unsigned char> tail(tailSize);
+	archive.seekg(archiveSize - tailSize);
+	if (tailSize < ZIP_END_SIZE || !read(&tail[0], tailSize)) {
+		error = "Not a ZIP archive";
+		return false;
+	}
+
+	size_t end = tailSize - ZIP_END_SIZE;
+	while (get32(&tail[end]) != ZIP_END_SIGNATURE) {
+		if (end == 0) {
+			error = "Not a ZIP archive";
+			return false;
+		}
+		end --;
+	}
+
+	unsigned long long entryCount = get16(&tail[end + 10]);
+	unsigned long long directorySize = get32(&tail[end + 12]);
+	unsigned long long directoryOffset = get32(&tail[end + 16]);
+
+	//ZIP64 archives have the real values in a second end record
+	if (end >= ZIP64_LOCATOR_SIZE && get32(&tail[end - ZIP64_LOCATOR_SIZE]) == ZIP64_LOCATOR_SIGNATURE) {
+		unsigned char zip64End[ZIP64_END_SIZE];
+		archive.seekg(get64(&tail[end - ZIP64_LOCATOR_SIZE + 8]));
+		if (!read(zip64End, ZIP64_END_SIZE) || get32(zip64End) != ZIP64_END_SIGNATURE) {
+			error = "The ZIP64 end of central directory record is damaged";
+			return false;
+		}
+		entryCount = get64(zip64End + 32);
+		directorySize = get64(zip64End + 40);
+		directoryOffset = get64(zip64End + 48);
+	}
+
+	if (directoryOffset + directorySize > archiveSize) {
+		error = "The central directory is damaged";
+		return false;
+	}
+
+	std::vector<unsigned char> directory((size_t)directorySize + 1);
+	archive.seekg(directoryOffset);
+	if (!read(&directory[0], (size_t)directorySize)) {
+		return false;
+	}
+
+	size_t position = 0;
+	for (unsigned long long i = 0; i < entryCount; i ++) {
+		const unsigned char *header = &directory[position];
+		if (position + 46 > directorySize || get32(header) != ZIP_CENTRAL_HEADER_SIGNATURE) {
+			error = "The central directory is damaged";
+			return false;
+		}
+
+		uint16_t flags = get16(header + 8);
+		uint16_t nameLength = get16(header + 28);
+		uint16_t extraLength = get16(header + 30);
+		uint16_t commentLength = get16(header + 32);
+		if (position + 46 + nameLength + extraLength + commentLength > directorySize) {
+			error = "The central directory is damaged";
+			return false;
+		}
+
+		ZipEntryInfo entry;
+		entry.entryName.assign((const char *)header + 46, nameLength);
+		entry.method = get16(header + 10);
+		entry.crc = get32(header + 16);
+		entry.compressedSize = get32(header + 20);
+		entry.uncompressedSize = get32(header + 24);
+		entry.localHeaderOffset = get32(header + 42);
+		entry.encrypted = (flags & ZIP_FLAG_ENCRYPTED) != 0;
+
+		const unsigned char *extra = header + 46 + nameLength;
+		uint16_t fieldSize = 0;
+
+		//ZIP64 values are only there for the fields that are set to 0xFFFFFFFF
+		const unsigned char *zip64 = findExtra(extra, extraLength, ZIP64_EXTRA_ID, fieldSize);
+		if (zip64 != NULL) {
+			size_t used = 0;
+			if (entry.uncompressedSize == ZIP32_MAX && used + 8 <= fieldSize) {
+				entry.uncompressedSize = get64(zip64 + used);
+				used += 8;
+			}
+			if (entry.compressedSize == ZIP32_MAX && used + 8 <= fieldSize) {
+				entry.compressedSize = get64(zip64 + used);
+				used += 8;
+			}
+			if (entry.localHeaderOffset == ZIP32_MAX && used + 8 <= fieldSize) {
+				entry.localHeaderOffset = get64(zip64 + used);
+			}
+		}
+
+		const unsigned char *aes = findExtra(extra, extraLength, WINZIP_AES_EXTRA_ID, fieldSize);
+		if (entry.method == WINZIP_AES_METHOD && aes != NULL && fieldSize >= 7) {
+			entry.method = get16(aes + 5);
+		}
+
+		entries.push_back(entry);
+		position += 46 + nameLength + extraLength + commentLength;
+	}
+	return true;
+}
+
+bool ZipReader::extractEntry(const ZipEntryInfo &entry, const std::string &password, const InflateSink &sink) {
+	//One seek; the header, the name and the data are read one after another
+	unsigned char header[30];
+	archive.seekg(entry.localHeaderOffset);
+	if (!read(header, sizeof(header)) || get32(header) != ZIP_LOCAL_HEADER_SIGNATURE) {
+		error = "No entry at offset " + std::to_string(entry.localHeaderOffset);
+		return false;
+	}
+
+	uint16_t flags = get16(header + 6);
+	uint16_t method = get16(header + 8);
+	size_t nameLength = get16(header + 26);
+	size_t extraLength = get16(header + 28);
+	std::vector<unsigned char> nameAndExtra(nameLength + extraLength + 1);
+	if (!read(&nameAndExtra[0], nameLength + extraLength)) {
+		return false;
+	}
+
+	//AE-2 entries have no CRC; the authentication code is checked instead
+	bool aes = false;
+	bool checkCrc = true;
+	if (method == WINZIP_AES_METHOD) {
+		uint16_t fieldSize = 0;
+		const unsigned char *field = findExtra(&nameAndExtra[nameLength], extraLength, WINZIP_AES_EXTRA_ID, fieldSize);
+		if (field == NULL || fieldSize < 7 || field[4] != 3) {
+			error = "Only WinZip AES-256 encryption is supported";
+			return false;
+		}
+		aes = true;
+		checkCrc = get16(field) != 2;
+		method = get16(field + 5);
+	} else if (flags & ZIP_FLAG_ENCRYPTED) {
+		error = "ZipCrypto encrypted entries are not supported (use 7-Zip to extract them)";
+		return false;
+	}
+
+	if (method != ZIP_METHOD_STORE && method != ZIP_METHOD_DEFLATE) {
+		error = "Unsupported compression method " + std::to_string(method);
+		return false;
+	}
+
+	unsigned long long remaining = entry.compressedSize;
+	std::unique_ptr<WinZipAesCipher> cipher;
+	if (aes) {
+		if (password.empty()) {
+			error = "The entry is encrypted; a password is needed";
+			return false;
+		}
+		if (remaining < WINZIP_AES_OVERHEAD) {
+			error = "The encrypted entry is too short";
+			return false;
+		}
+
+		unsigned char saltAndVerifier[WINZIP_AES_SALT_SIZE + WINZIP_AES_VERIFIER_SIZE];
+		if (!read(saltAndVerifier, sizeof(saltAndVerifier))) {
+			return false;
+		}
+		WinZipAesKeys keys;
+		winZipAesDeriveKeys(password, saltAndVerifier, keys);
+		if (memcmp(keys.passwordVerifier, saltAndVerifier + WINZIP_AES_SALT_SIZE, WINZIP_AES_VERIFIER_SIZE) != 0) {
+			error = "Wrong password";
+			return false;
+		}
+		cipher.reset(new WinZipAesCipher(keys));
+		remaining -= WINZIP_AES_OVERHEAD;
+	}
+
+	//Compressed data, decrypted as it is read
+	bool readFailed = false;
+	InflateSource source = [&](unsigned char *buffer, size_t size) -> size_t {
+		size_t take = (size_t)std::min<unsigned long long>(size, remaining);
+		if (take == 0) {
+			return 0;
+		}
+		if (!read(buffer, take)) {
+			readFailed = true;
+			return 0;
+		}
+		if (cipher) {
+			cipher->decrypt(buffer, take);
+		}
+		remaining -= take;
+		return take;
+	};
+
+	uint32_t crc = 0;
+	unsigned long long written = 0;
+	bool sinkStopped = false;
+	InflateSink checkedSink = [&](const unsigned char *data, size_t size) -> bool {
+		crc = crc32Update(crc, data, size);
+		written += size;
+		if (!sink(data, size)) {
+			sinkStopped = true;
+			return false;
+		}
+		return true;
+	};
+
+	bool ok = true;
+	if (method == ZIP_METHOD_STORE) {
+		std::vector<unsigned char> buffer(READ_CHUNK_SIZE);
+		size_t length;
+		while (ok && (length = source(&buffer[0], buffer.size())) > 0) {
+			ok = checkedSink(&buffer[0], length);
+		}
+	} else {
+		ok = inflateStream(source, checkedSink);
+	}
+
+	if (readFailed || sinkStopped) {
+		if (sinkStopped) {
+			error = "Extraction was stopped";
+		}
+		return false;
+	}
+	if (!ok) {
+		error = "The compressed data is damaged";
+		return false;
+	}
+
+	if (cipher) {
+		//Skip anything the decompressor didn't need, then check the authentication code
+		std::vector<unsigned char> rest(READ_CHUNK_SIZE);
+		while (source(&rest[0], rest.size()) > 0) {
+		}
+		unsigned char storedCode[WINZIP_AES_AUTH_CODE_SIZE];
+		unsigned char code[WINZIP_AES_AUTH_CODE_SIZE];
+		if (readFailed || !read(storedCode, sizeof(storedCode))) {
+			return false;
+		}
+		cipher->authenticationCode(code);
+		if (memcmp(code, storedCode, sizeof(code)) != 0) {
+			error = "The authentication code does not match (the data is damaged)";
+			return false;
+		}
+	}
+
+	if (written != entry.uncompressedSize) {
+		error = "The entry has the wrong size";
+		return false;
+	}
+	if (checkCrc && crc != entry.crc) {
+		error = "CRC mismatch";
+		return false;
+	}
+	return true;
+}
+
+const std::string &ZipReader::errorMessage() const {
+	return error;
+}
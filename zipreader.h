@@ -0,0 +1,52 @@
+// Archiver and Splitter
+// zipreader.h
+// Reads the entries of ZIP archives (stored, deflate and WinZip AES)
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "inflate.h"
+
+//One entry of an archive.  readCentralDirectory() fills in everything;
+//extractEntry() only needs the offset and sizes (it reads the rest from the
+//entry's local header), so entries can come from the locator index too.
+struct ZipEntryInfo {
+	std::string entryName;
+	uint32_t crc;
+	unsigned long long compressedSize;
+	unsigned long long uncompressedSize;
+	//Offset of the entry's local file header in the archive
+	unsigned long long localHeaderOffset;
+	//Compression method of the data (inside the encryption, for AES entries)
+	uint16_t method;
+	bool encrypted;
+};
+
+class ZipReader {
+public:
+	ZipReader();
+
+	bool open(const std::string &archivePath);
+	void close();
+
+	//Reads the list of entries from the central directory (ZIP64 included)
+	bool readCentralDirectory(std::vector<ZipEntryInfo> &entries);
+
+	//Seeks to one entry and passes its decrypted, decompressed data to sink.
+	//Fails if the data is corrupt, the CRC or AES authentication code doesn't
+	//match, or the password is wrong.
+	bool extractEntry(const ZipEntryInfo &entry, const std::string &password, const InflateSink &sink);
+
+	const std::string &errorMessage() const;
+
+private:
+	bool read(void *data, size_t length);
+
+	std::ifstream archive;
+	unsigned long long archiveSize;
+	std::string error;
+};
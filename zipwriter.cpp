@@ -0,0 +1,581 @@
+// Archiver and Splitter
+// zipwriter.cpp
+
+#include "zipwriter.h"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <sys/stat.h>
+
+#include "crc32.h"
+#include "deflate.h"
+
+////////////////
+//   CONSTANTS
+////////////////
+
+namespace {
+
+const uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;
+const uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+const uint32_t ZIP_END_SIGNATURE = 0x06054b50;
+const uint32_t ZIP64_END_SIGNATURE = 0x06064b50;
+const uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+
+const uint16_t ZIP_VERSION_DEFLATE = 20;
+const uint16_t ZIP_VERSION_ZIP64 = 45;
+const uint16_t ZIP_VERSION_AES = 51;
+const uint16_t ZIP_METHOD_STORE = 0;
+const uint16_t ZIP_METHOD_DEFLATE = 8;
+const uint16_t ZIP64_EXTRA_ID = 0x0001;
+
+const uint16_t ZIP_FLAG_ENCRYPTED = 0x0001;
+
+//AE-2: the CRC is left out (it would leak information about the
+//contents); the authentication code protects the data instead
+const uint16_t WINZIP_AES_VENDOR_VERSION = 2;
+const unsigned char WINZIP_AES_STRENGTH_256 = 3;
+
+const unsigned long long ZIP32_MAX = 0xFFFFFFFFull;
+
+//Files at least this big get ZIP64 sizes in their local header.  The
+//margin leaves room for deflate to grow incompressible data slightly.
+const unsigned long long ZIP64_LOCAL_THRESHOLD = 0xFF000000ull;
+
+//FILE_ATTRIBUTE_ARCHIVE, as 7-Zip sets it
+const uint32_t ZIP_EXTERNAL_ATTRIBUTES = 0x20;
+
+////////////////
+//   HELPERS
+////////////////
+
+void put16(std::vector<unsigned char> &buffer, uint16_t value) {
+	buffer.push_back((unsigned char)value);
+	buffer.push_back((unsigned char)(value >> 8));
+}
+
+void put32(std::vector<unsigned char> &buffer, uint32_t value) {
+	put16(buffer, (uint16_t)value);
+	put16(buffer, (uint16_t)(value >> 16));
+}
+
+void put64(std::vector<unsigned char> &buffer, unsigned long long value) {
+	put32(buffer, (uint32_t)value);
+	put32(buffer, (uint32_t)(value >> 32));
+}
+
+//Gets the size and modification time (seconds since 1970) of a file
+bool fileStat(const std::string &path, unsigned long long &size, long long &modifiedTime) {
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0) {
+		return false;
+	}
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+#endif
+	size = (unsigned long long)st.st_size;
+	modifiedTime = (long long)st.st_mtime;
+	return true;
+}
+
+//Version needed to extract, for the headers
+uint16_t zipVersionNeeded(bool zip64, bool encrypted) {
+	if (encrypted) {
+		return ZIP_VERSION_AES;
+	}
+	return zip64 ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFLATE;
+}
+
+//The 0x9901 extra field that marks an entry as WinZip AES encrypted
+void putAesExtra(std::vector<unsigned char> &buffer, uint16_t method) {
+	put16(buffer, WINZIP_AES_EXTRA_ID);
+	put16(buffer, 7);
+	put16(buffer, WINZIP_AES_VENDOR_VERSION);
+	buffer.push_back('A');
+	buffer.push_back('E');
+	buffer.push_back(WINZIP_AES_STRENGTH_256);
+	put16(buffer, method);
+}
+
+//Converts a time to the MS-DOS format ZIP uses (local time, 2 second resolution)
+void dosDateTime(long long modifiedTime, uint16_t &dosTime, uint16_t &dosDate) {
+	time_t t = (time_t)modifiedTime;
+	struct tm local;
+#ifdef _WIN32
+	bool ok = localtime_s(&local, &t) == 0;
+#else
+	bool ok = localtime_r(&t, &local) != NULL;
+#endif
+	if (!ok || local.tm_year < 80) {
+		//MS-DOS dates start at 1980
+		dosTime = 0;
+		dosDate = (1 << 5) | 1;
+		return;
+	}
+
+	dosTime = (uint16_t)((local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+	dosDate = (uint16_t)(((local.tm_year - 80) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday);
+}
+
+}
+
+////////////////
+//   ZIPWRITER
+////////////////
+
+ZipWriter::ZipWriter(ThreadPool &pool, int level)
+	: blockSize(ZIP_DEFAULT_BLOCK_SIZE), pool(pool), level(level), throttle(NULL), position(0) {
+}
+
+void ZipWriter::setPassword(const std::string &password) {
+	this->password = password;
+}
+
+void ZipWriter::setThrottle(IoThrottle *throttle) {
+	this->throttle = throttle;
+}
+
+void ZipWriter::setCancellation(const CancellationToken &cancel) {
+	this->cancel = cancel;
+}
+
+bool ZipWriter::open(const std::string &archivePath) {
+	archive.open(archivePath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!archive.is_open()) {
+		error = "Could not create " + archivePath;
+		return false;
+	}
+	position = 0;
+	records.clear();
+	return true;
+}
+
+bool ZipWriter::write(const void *data, size_t length) {
+	std::chrono::steady_clock::time_point start;
+	if (throttle != NULL) {
+		throttle->beforeWrite(length);
+		start = std::chrono::steady_clock::now();
+	}
+	archive.write((const char *)data, length);
+	if (archive.fail()) {
+		error = "Writing the archive failed";
+		return false;
+	}
+	if (throttle != NULL) {
+		throttle->recordLatency(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	position += length;
+	return true;
+}
+
+bool ZipWriter::addFiles(const std::vector<ZipEntrySource> &sources) {
+	size_t base = records.size();
+	for (size_t i = 0; i < sources.size(); i ++) {
+		EntryRecord record;
+		record.result.entryName = sources[i].entryName;
+		record.result.crc = 0;
+		record.result.uncompressedSize = 0;
+		record.result.compressedSize = 0;
+		record.result.localHeaderOffset = 0;
+		record.result.ok = false;
+		record.written = false;
+		record.zip64Local = false;
+		record.encrypted = false;
+		record.dosTime = 0;
+		record.dosDate = 0;
+		records.push_back(record);
+	}
+
+	ReadState state;
+	state.entryIndex = 0;
+	state.fileOpen = false;
+	state.firstBlock = false;
+	state.plannedSize = 0;
+	state.modifiedTime = 0;
+
+	//Enough blocks queued that no worker waits on the reader,
+	//while the writer takes them back in order
+	std::deque<std::future<CompressedBlock> > inFlight;
+	size_t maxInFlight = pool.size() * 4 + 2;
+	bool success = true;
+
+	while (true) {
+		if (cancel.cancelled()) {
+			error = "Cancelled";
+			success = false;
+			break;
+		}
+
+		//With a cap on compression threads, only that many blocks are out at once
+		if (throttle != NULL) {
+			unsigned int threads = throttle->compressionThreads();
+			maxInFlight = threads > 0 ? threads : pool.size() * 4 + 2;
+		}
+
+		while (inFlight.size() < maxInFlight && state.entryIndex < sources.size()) {
+			inFlight.push_back(submitNextBlock(sources, state));
+		}
+		if (inFlight.empty()) {
+			break;
+		}
+
+		CompressedBlock block = inFlight.front().get();
+		inFlight.pop_front();
+
+		if (!writeCompressedBlock(records[base + block.entryIndex], block)) {
+			success = false;
+			break;
+		}
+	}
+
+	//Let anything still queued finish before returning
+	for (size_t i = 0; i < inFlight.size(); i ++) {
+		inFlight[i].wait();
+	}
+
+	return success;
+}
+
+//Reads the next block from the sources and queues it for compression
+std::future<ZipWriter::CompressedBlock> ZipWriter::submitNextBlock(const std::vector<ZipEntrySource> &sources,
+																	 ReadState &state) {
+	const ZipEntrySource &source = sources[state.entryIndex];
+
+	CompressedBlock header;
+	header.entryIndex = state.entryIndex;
+	header.openFailed = false;
+	header.readFailed = false;
+	header.encrypted = !password.empty();
+	memset(&header.keys, 0, sizeof(header.keys));
+	header.crc = 0;
+	header.inputSize = 0;
+
+	if (!state.fileOpen) {
+		state.file.clear();
+		state.file.open(source.sourcePath.c_str(), std::ios::in | std::ios::binary);
+		bool statOk = fileStat(source.sourcePath, state.plannedSize, state.modifiedTime);
+
+		if (!state.file.is_open() || !statOk) {
+			state.file.close();
+			state.entryIndex ++;
+
+			header.firstBlock = true;
+			header.lastBlock = true;
+			header.openFailed = true;
+			header.plannedSize = 0;
+			header.modifiedTime = 0;
+			return pool.submit([header]() { return header; });
+		}
+
+		state.fileOpen = true;
+		state.firstBlock = true;
+		state.dictionary.clear();
+	}
+
+	size_t dictionarySize = state.dictionary.size();
+	std::shared_ptr<std::vector<unsigned char> > window(new std::vector<unsigned char>(dictionarySize + blockSize));
+	if (dictionarySize > 0) {
+		memcpy(&(*window)[0], &state.dictionary[0], dictionarySize);
+	}
+
+	std::chrono::steady_clock::time_point readStart = std::chrono::steady_clock::now();
+	state.file.read((char *)&(*window)[0] + dictionarySize, blockSize);
+	size_t bytesRead = (size_t)state.file.gcount();
+	if (throttle != NULL) {
+		throttle->recordLatency(std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count());
+		throttle->afterRead(bytesRead);
+	}
+	window->resize(dictionarySize + bytesRead);
+
+	header.readFailed = state.file.bad();
+	header.firstBlock = state.firstBlock;
+	header.lastBlock = bytesRead < blockSize || header.readFailed
+		|| state.file.peek() == std::char_traits<char>::eof();
+	header.plannedSize = state.plannedSize;
+	header.modifiedTime = state.modifiedTime;
+	header.inputSize = bytesRead;
+
+	//The end of this block primes the next one
+	size_t keep = window->size() < DEFLATE_DICTIONARY_SIZE ? window->size() : DEFLATE_DICTIONARY_SIZE;
+	state.dictionary.assign(window->end() - keep, window->end());
+	state.firstBlock = false;
+
+	if (header.lastBlock) {
+		state.file.close();
+		state.fileOpen = false;
+		state.entryIndex ++;
+	}
+
+	//A fresh salt for each encrypted entry; the keys are derived on the worker
+	unsigned char salt[WINZIP_AES_SALT_SIZE] = {0};
+	std::string keyPassword;
+	if (header.encrypted && header.firstBlock) {
+		for (int i = 0; i < WINZIP_AES_SALT_SIZE; i += 4) {
+			unsigned int random = saltSource();
+			memcpy(salt + i, &random, 4);
+		}
+		keyPassword = password;
+	}
+
+	int blockLevel = level;
+	return pool.submit([window, dictionarySize, blockLevel, header, salt, keyPassword]() {
+		CompressedBlock block = header;
+		const unsigned char *data = window->empty() ? NULL : &(*window)[0];
+		block.crc = crc32Update(0, data + dictionarySize, block.inputSize);
+
+		if (blockLevel == 0) {
+			block.data.assign(data + dictionarySize, data + dictionarySize + block.inputSize);
+		} else {
+			block.data.reserve(block.inputSize + block.inputSize / 8 + 64);
+			deflateCompressBlock(data, dictionarySize, block.inputSize, blockLevel, block.lastBlock, block.data);
+		}
+
+		if (!keyPassword.empty()) {
+			winZipAesDeriveKeys(keyPassword, salt, block.keys);
+		}
+		return block;
+	});
+}
+
+bool ZipWriter::writeCompressedBlock(EntryRecord &record, CompressedBlock &block) {
+	ZipEntryResult &result = record.result;
+
+	if (block.openFailed) {
+		result.ok = false;
+		return true;
+	}
+
+	if (block.firstBlock) {
+		//Local header; the CRC and sizes are filled in once the entry is done
+		result.localHeaderOffset = position;
+		record.zip64Local = block.plannedSize >= ZIP64_LOCAL_THRESHOLD;
+		record.encrypted = block.encrypted;
+		dosDateTime(block.modifiedTime, record.dosTime, record.dosDate);
+
+		//The ZIP64 field comes first so its position is known when patching
+		std::vector<unsigned char> extra;
+		if (record.zip64Local) {
+			put16(extra, ZIP64_EXTRA_ID);
+			put16(extra, 16);
+			put64(extra, 0);
+			put64(extra, 0);
+		}
+		if (record.encrypted) {
+			putAesExtra(extra, level == 0 ? ZIP_METHOD_STORE : ZIP_METHOD_DEFLATE);
+		}
+
+		std::vector<unsigned char> local;
+		put32(local, ZIP_LOCAL_HEADER_SIGNATURE);
+		put16(local, zipVersionNeeded(record.zip64Local, record.encrypted));
+		put16(local, record.encrypted ? ZIP_FLAG_ENCRYPTED : 0);
+		put16(local, entryMethod(record));
+		put16(local, record.dosTime);
+		put16(local, record.dosDate);
+		put32(local, 0);
+		put32(local, record.zip64Local ? (uint32_t)ZIP32_MAX : 0);
+		put32(local, record.zip64Local ? (uint32_t)ZIP32_MAX : 0);
+		put16(local, (uint16_t)result.entryName.size());
+		put16(local, (uint16_t)extra.size());
+		local.insert(local.end(), result.entryName.begin(), result.entryName.end());
+		local.insert(local.end(), extra.begin(), extra.end());
+
+		if (record.encrypted) {
+			//Salt and password verifier go in front of the encrypted data
+			local.insert(local.end(), block.keys.salt, block.keys.salt + WINZIP_AES_SALT_SIZE);
+			local.insert(local.end(), block.keys.passwordVerifier,
+				block.keys.passwordVerifier + WINZIP_AES_VERIFIER_SIZE);
+			result.compressedSize += WINZIP_AES_SALT_SIZE + WINZIP_AES_VERIFIER_SIZE;
+			cipher.reset(new WinZipAesCipher(block.keys));
+		}
+
+		if (!write(&local[0], local.size())) {
+			return false;
+		}
+		record.written = true;
+	}
+
+	if (record.encrypted && !block.data.empty()) {
+		cipher->encrypt(&block.data[0], block.data.size());
+	}
+
+	if (!block.data.empty() && !write(&block.data[0], block.data.size())) {
+		return false;
+	}
+
+	result.crc = crc32Combine(result.crc, block.crc, block.inputSize);
+	result.uncompressedSize += block.inputSize;
+	result.compressedSize += block.data.size();
+
+	if (block.lastBlock) {
+		result.ok = !block.readFailed;
+
+		if (record.encrypted) {
+			unsigned char code[WINZIP_AES_AUTH_CODE_SIZE];
+			cipher->authenticationCode(code);
+			cipher.reset();
+			if (!write(code, WINZIP_AES_AUTH_CODE_SIZE)) {
+				return false;
+			}
+			result.compressedSize += WINZIP_AES_AUTH_CODE_SIZE;
+		}
+
+		//Go back and fill in the local header.  If a file grew past 4 GiB
+		//after it was planned, only the central directory has its real sizes.
+		std::vector<unsigned char> patch;
+		put32(patch, record.encrypted ? 0 : result.crc);
+		bool small = !record.zip64Local && result.compressedSize < ZIP32_MAX
+			&& result.uncompressedSize < ZIP32_MAX;
+		put32(patch, small ? (uint32_t)result.compressedSize : (uint32_t)ZIP32_MAX);
+		put32(patch, small ? (uint32_t)result.uncompressedSize : (uint32_t)ZIP32_MAX);
+
+		archive.seekp(result.localHeaderOffset + 14);
+		archive.write((const char *)&patch[0], patch.size());
+
+		if (record.zip64Local) {
+			patch.clear();
+			put64(patch, result.uncompressedSize);
+			put64(patch, result.compressedSize);
+			archive.seekp(result.localHeaderOffset + 30 + result.entryName.size() + 4);
+			archive.write((const char *)&patch[0], patch.size());
+		}
+
+		archive.seekp(position);
+		if (archive.fail()) {
+			error = "Updating a local header failed";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ZipWriter::close() {
+	unsigned long long centralStart = position;
+	unsigned long long entryCount = 0;
+	std::vector<unsigned char> central;
+
+	for (size_t i = 0; i < records.size(); i ++) {
+		const EntryRecord &record = records[i];
+		const ZipEntryResult &result = record.result;
+		if (!record.written) {
+			continue;
+		}
+
+		bool bigUncompressed = result.uncompressedSize >= ZIP32_MAX;
+		bool bigCompressed = result.compressedSize >= ZIP32_MAX;
+		bool bigOffset = result.localHeaderOffset >= ZIP32_MAX;
+		bool zip64 = record.zip64Local || bigUncompressed || bigCompressed || bigOffset;
+
+		//Only the fields that don't fit go in the ZIP64 extra field
+		std::vector<unsigned char> extra;
+		if (bigUncompressed) {
+			put64(extra, result.uncompressedSize);
+		}
+		if (bigCompressed) {
+			put64(extra, result.compressedSize);
+		}
+		if (bigOffset) {
+			put64(extra, result.localHeaderOffset);
+		}
+
+		std::vector<unsigned char> extraFields;
+		if (!extra.empty()) {
+			put16(extraFields, ZIP64_EXTRA_ID);
+			put16(extraFields, (uint16_t)extra.size());
+			extraFields.insert(extraFields.end(), extra.begin(), extra.end());
+		}
+		if (record.encrypted) {
+			putAesExtra(extraFields, level == 0 ? ZIP_METHOD_STORE : ZIP_METHOD_DEFLATE);
+		}
+
+		put32(central, ZIP_CENTRAL_HEADER_SIGNATURE);
+		put16(central, zipVersionNeeded(zip64, record.encrypted));
+		put16(central, zipVersionNeeded(zip64, record.encrypted));
+		put16(central, record.encrypted ? ZIP_FLAG_ENCRYPTED : 0);
+		put16(central, entryMethod(record));
+		put16(central, record.dosTime);
+		put16(central, record.dosDate);
+		put32(central, record.encrypted ? 0 : result.crc);
+		put32(central, bigCompressed ? (uint32_t)ZIP32_MAX : (uint32_t)result.compressedSize);
+		put32(central, bigUncompressed ? (uint32_t)ZIP32_MAX : (uint32_t)result.uncompressedSize);
+		put16(central, (uint16_t)result.entryName.size());
+		put16(central, (uint16_t)extraFields.size());
+		put16(central, 0);
+		put16(central, 0);
+		put16(central, 0);
+		put32(central, ZIP_EXTERNAL_ATTRIBUTES);
+		put32(central, bigOffset ? (uint32_t)ZIP32_MAX : (uint32_t)result.localHeaderOffset);
+		central.insert(central.end(), result.entryName.begin(), result.entryName.end());
+		central.insert(central.end(), extraFields.begin(), extraFields.end());
+
+		entryCount ++;
+	}
+
+	unsigned long long centralSize = central.size();
+	bool zip64End = entryCount >= 0xFFFF || centralStart >= ZIP32_MAX || centralSize >= ZIP32_MAX;
+
+	std::vector<unsigned char> end;
+	if (zip64End) {
+		unsigned long long zip64EndOffset = centralStart + centralSize;
+
+		put32(end, ZIP64_END_SIGNATURE);
+		put64(end, 44);
+		put16(end, ZIP_VERSION_ZIP64);
+		put16(end, ZIP_VERSION_ZIP64);
+		put32(end, 0);
+		put32(end, 0);
+		put64(end, entryCount);
+		put64(end, entryCount);
+		put64(end, centralSize);
+		put64(end, centralStart);
+
+		put32(end, ZIP64_LOCATOR_SIGNATURE);
+		put32(end, 0);
+		put64(end, zip64EndOffset);
+		put32(end, 1);
+	}
+
+	put32(end, ZIP_END_SIGNATURE);
+	put16(end, 0);
+	put16(end, 0);
+	put16(end, zip64End ? 0xFFFF : (uint16_t)entryCount);
+	put16(end, zip64End ? 0xFFFF : (uint16_t)entryCount);
+	put32(end, zip64End ? (uint32_t)ZIP32_MAX : (uint32_t)centralSize);
+	put32(end, zip64End ? (uint32_t)ZIP32_MAX : (uint32_t)centralStart);
+	put16(end, 0);
+
+	bool success = (central.empty() || write(&central[0], central.size())) && write(&end[0], end.size());
+
+	archive.close();
+	if (success && archive.fail()) {
+		error = "Closing the archive failed";
+		success = false;
+	}
+	return success;
+}
+
+//Compression method as written in the headers
+uint16_t ZipWriter::entryMethod(const EntryRecord &record) const {
+	if (record.encrypted) {
+		return WINZIP_AES_METHOD;
+	}
+	return level == 0 ? ZIP_METHOD_STORE : ZIP_METHOD_DEFLATE;
+}
+
+std::vector<ZipEntryResult> ZipWriter::entries() const {
+	std::vector<ZipEntryResult> list;
+	for (size_t i = 0; i < records.size(); i ++) {
+		list.push_back(records[i].result);
+	}
+	return list;
+}
+
+const std::string &ZipWriter::errorMessage() const {
+	return error;
+}
@@ -0,0 +1,139 @@
+// Archiver and Splitter
+// zipwriter.h
+// Writes ZIP archives with the built-in parallel deflate compressor
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cancellation.h"
+#include "iothrottle.h"
+#include "threadpool.h"
+#include "winzipaes.h"
+
+//Size of the pieces each file is split into for compression.
+//Every piece is primed with the last 32 KiB of the piece before it.
+#define ZIP_DEFAULT_BLOCK_SIZE (128 * 1024)
+
+//One file to put in the archive
+struct ZipEntrySource {
+	//Path of the file to read
+	std::string sourcePath;
+	//Name inside the archive ('/' separated, no leading slash)
+	std::string entryName;
+};
+
+//What ended up in the archive for one ZipEntrySource
+struct ZipEntryResult {
+	std::string entryName;
+	uint32_t crc;
+	unsigned long long uncompressedSize;
+	unsigned long long compressedSize;
+	//Offset of the entry's local file header in the archive
+	unsigned long long localHeaderOffset;
+	//False if the source couldn't be opened (the entry is then left out)
+	//or couldn't be read to the end (the entry holds what was read)
+	bool ok;
+};
+
+class ZipWriter {
+public:
+	//Blocks are compressed on 'pool', which can be shared between writers.
+	//Level 0 stores the files without compressing them.
+	ZipWriter(ThreadPool &pool, int level);
+
+	//Encrypts the entries added after this with WinZip AES-256 (AE-2).
+	//Encryption happens as each block is written, in the same pass that
+	//reads and compresses the files.  An empty password turns it off.
+	void setPassword(const std::string &password);
+
+	//Reads of the source files and writes of the archive go through the
+	//throttle's limits, and it caps the number of blocks compressed at once.
+	//NULL (the default) turns throttling off.
+	void setThrottle(IoThrottle *throttle);
+
+	//Once the token is cancelled, addFiles stops between blocks and fails
+	void setCancellation(const CancellationToken &cancel);
+
+	bool open(const std::string &archivePath);
+
+	//Compresses and appends the files.  Blocks from all of the files are
+	//compressed in parallel, so both one huge file and many small ones
+	//keep every thread busy.
+	//Returns false if the archive couldn't be written.
+	bool addFiles(const std::vector<ZipEntrySource> &sources);
+
+	//Writes the central directory and closes the archive
+	bool close();
+
+	std::vector<ZipEntryResult> entries() const;
+	const std::string &errorMessage() const;
+
+	size_t blockSize;
+
+private:
+	//Output of one compression task
+	struct CompressedBlock {
+		size_t entryIndex;
+		bool firstBlock;
+		bool lastBlock;
+		bool openFailed;
+		bool readFailed;
+		bool encrypted;
+		//Derived on the worker for an encrypted entry's first block
+		WinZipAesKeys keys;
+		unsigned long long plannedSize;
+		long long modifiedTime;
+		uint32_t crc;
+		size_t inputSize;
+		std::vector<unsigned char> data;
+	};
+
+	//Where the reader is in the list of sources
+	struct ReadState {
+		size_t entryIndex;
+		bool fileOpen;
+		bool firstBlock;
+		std::ifstream file;
+		unsigned long long plannedSize;
+		long long modifiedTime;
+		//Tail of the previous block, used to prime the next one
+		std::vector<unsigned char> dictionary;
+	};
+
+	struct EntryRecord {
+		ZipEntryResult result;
+		bool written;
+		bool zip64Local;
+		bool encrypted;
+		uint16_t dosTime;
+		uint16_t dosDate;
+	};
+
+	std::future<CompressedBlock> submitNextBlock(const std::vector<ZipEntrySource> &sources, ReadState &state);
+	bool writeCompressedBlock(EntryRecord &record, CompressedBlock &block);
+	bool write(const void *data, size_t length);
+	uint16_t entryMethod(const EntryRecord &record) const;
+
+	ThreadPool &pool;
+	int level;
+	IoThrottle *throttle;
+	CancellationToken cancel;
+
+	std::string password;
+	std::random_device saltSource;
+	//Cipher for the entry being written
+	std::unique_ptr<WinZipAesCipher> cipher;
+
+	std::fstream archive;
+	unsigned long long position;
+
+	std::vector<EntryRecord> records;
+	std::string error;
+};